@@ -1,4 +1,5 @@
 // gcc shm_file_demo.c -o shm_file_demo -pthread
+// Dùng chung layout Shared và ring_push/ring_pop với src/ (không định nghĩa lại).
 // (nếu hệ thống yêu cầu thêm -lrt thì thêm vào cuối dòng lệnh)
 
 #define _GNU_SOURCE
@@ -10,20 +11,9 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
-#include <semaphore.h>
 #include <signal.h>
 #include <errno.h>
-
-#define SHM_NAME "/shm_file_demo"
-#define CAP 4
-#define MSG_MAX 128
-#define END_TOKEN "END"
-
-typedef struct {
-    sem_t empty, full, mutex;
-    size_t in, out;
-    char buf[CAP][MSG_MAX];
-} Shared;
+#include "../src/segment.h"
 
 static volatile sig_atomic_t stop_flag = 0;
 void on_sigint(int){ stop_flag = 1; }
@@ -45,10 +35,7 @@ int main() {
     Shared* shm = mmap(NULL, sizeof(Shared), PROT_READ|PROT_WRITE, MAP_SHARED, shmfd, 0);
     if (shm == MAP_FAILED) { perror("mmap"); return 1; }
 
-    memset(shm, 0, sizeof(*shm));
-    sem_init(&shm->empty, 1, CAP);
-    sem_init(&shm->full,  1, 0);
-    sem_init(&shm->mutex, 1, 1);
+    if (seg_init_sems(shm, 1, 0, 0) == -1) { cleanup(shmfd, shm); return 1; }
 
     pid_t pid = fork();
     if (pid < 0) { perror("fork"); cleanup(shmfd, shm); return 1; }
@@ -59,17 +46,11 @@ int main() {
         if (!fout) { perror("open output.txt"); return 1; }
 
         while (!stop_flag) {
-            sem_wait(&shm->full);
-            sem_wait(&shm->mutex);
-
             char msg[MSG_MAX];
-            strncpy(msg, shm->buf[shm->out], MSG_MAX);
-            shm->out = (shm->out + 1) % CAP;
-
-            sem_post(&shm->mutex);
-            sem_post(&shm->empty);
-
-            if (strncmp(msg, END_TOKEN, MSG_MAX) == 0) break;
+            RecMeta meta;
+            int rc = ring_pop(shm, &meta, msg, 0);
+            if (rc == -1) { perror("ring_pop"); break; }
+            if (rc == RING_EOS) break; // producer đã stream_end và vòng đệm đã cạn
 
             fprintf(fout, "%s\n", msg);
             fflush(fout);
@@ -86,26 +67,17 @@ int main() {
         FILE* fin = fopen("input.txt", "r");
         if (!fin) { perror("open input.txt"); cleanup(shmfd, shm); return 1; }
 
+        int stream = stream_open(shm);
         char line[MSG_MAX];
         while (!stop_flag && fgets(line, sizeof(line), fin)) {
-            line[strcspn(line, "\r\n")] = '\0'; // bỏ newline
-            sem_wait(&shm->empty);
-            sem_wait(&shm->mutex);
-
-            strncpy(shm->buf[shm->in], line, MSG_MAX);
-            shm->in = (shm->in + 1) % CAP;
-
-            sem_post(&shm->mutex);
-            sem_post(&shm->full);
+            size_t len = strcspn(line, "\r\n");
+            line[len] = '\0'; // bỏ newline
+            RecMeta meta = { .len = (uint32_t)len };
+            if (ring_push(shm, &meta, line, 0) == -1) { perror("ring_push"); break; }
         }
 
-        // Gửi END token
-        sem_wait(&shm->empty);
-        sem_wait(&shm->mutex);
-        strncpy(shm->buf[shm->in], END_TOKEN, MSG_MAX);
-        shm->in = (shm->in + 1) % CAP;
-        sem_post(&shm->mutex);
-        sem_post(&shm->full);
+        // Báo hết luồng (ngoài dải dữ liệu): consumer lấy nốt rồi nhận RING_EOS
+        stream_end(shm, stream);
 
         fclose(fin);
         waitpid(pid, NULL, 0);
@@ -0,0 +1,351 @@
+#pragma once
+// arena.h — nhiều kênh (mỗi kênh một Shared) trong một segment POSIX shm duy nhất.
+// Tên "arena:kênh" (vd. -n pipes:orders) thay cho một shm riêng mỗi kênh: 500
+// kênh là một shm_open và một mmap mỗi process thay vì 500.
+//
+//   ArenaHeader | thư mục ArenaDirEntry[ndir] | next[nblocks] | khối Shared...
+//
+// Thư mục: bảng băm dò tuyến tính theo tên. Tra cứu và xóa không khóa; tạo kênh
+// giữ insert_owner (khóa quay theo pid, lấy lại được khi chủ khóa chết): dò hết
+// chuỗi tìm tên, nếu chưa có thì chiếm mục DEAD đầu tiên (hoặc mục trống cuối
+// chuỗi) thành CREATING|hash, ghi tên, lấy khối, publish READY|hash. Ai gặp mục
+// CREATING cùng hash thì chờ nó READY rồi mới so tên; creator chết giữa chừng thì
+// thôi chờ (mục đó coi như không khớp, lần tạo sau biến nó thành DEAD). Mục bị xóa
+// thành DEAD chứ không về 0 (để chuỗi dò không bị cắt) và được dùng lại khi tạo.
+// Slab: khối Shared cỡ cố định, danh sách trống là Treiber stack với tag chống ABA.
+//
+// Trong một process, các kênh của cùng arena dùng chung một mapping (đếm tham chiếu).
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shared.h"
+#include "stream.h"
+
+#define ARENA_MAGIC 0x41524e32u // "ARN2"
+#define ARENA_CHANNELS 1024      // số kênh tối đa khi tạo arena
+#define ARENA_NAME_MAX 48        // gồm '\0'
+#define ARENA_MAPS 8             // số arena tối đa mở cùng lúc trong một process
+
+enum { ARENA_EMPTY = 0, ARENA_CREATING = 1, ARENA_READY = 2, ARENA_DEAD = 3 };
+
+typedef struct {
+    uint64_t word;               // state << 32 | hash
+    uint32_t block;              // chỉ số khối Shared
+    int32_t creator;             // pid của process tạo mục (ghi trước khi chiếm mục)
+    char name[ARENA_NAME_MAX];
+} ArenaDirEntry;
+
+typedef struct {
+    unsigned magic;              // ghi sau cùng khi khởi tạo xong
+    uint32_t nblocks;            // số kênh tối đa
+    uint32_t ndir;               // số mục thư mục (lũy thừa của 2)
+    uint32_t channels;           // số kênh đang có
+    uint64_t block_size;         // sizeof(Shared) làm tròn lên trang
+    uint64_t dir_off, next_off, blocks_off, total;
+    uint64_t free_head;          // tag << 32 | (chỉ số khối + 1), 0 = hết
+    int insert_owner;            // pid đang tạo kênh, 0 = không ai
+} ArenaHeader;
+
+typedef struct {
+    char name[256];
+    ArenaHeader* h;
+    size_t size;
+    int refs;
+} ArenaMap;
+
+static ArenaMap arena_maps[ARENA_MAPS];
+static pthread_mutex_t arena_maps_mu = PTHREAD_MUTEX_INITIALIZER;
+
+// "arena:kênh" -> tên shm của arena ("/arena") và tên kênh. 0 nếu spec không phải dạng đó.
+static inline int arena_split(const char* spec, char* arena, size_t acap, char* chan, size_t ccap) {
+    const char* colon = strchr(spec, ':');
+    if (!colon || colon == spec || !colon[1]) return 0;
+    int n = (int)(colon - spec);
+    snprintf(arena, acap, "%s%.*s", spec[0] == '/' ? "" : "/", n, spec);
+    snprintf(chan, ccap, "%s", colon + 1);
+    return 1;
+}
+
+static inline uint32_t arena_hash(const char* s) {
+    uint32_t h = 2166136261u; // FNV-1a
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+static inline ArenaDirEntry* arena_dir(const ArenaHeader* h) {
+    return (ArenaDirEntry*)((char*)h + h->dir_off);
+}
+
+static inline uint32_t* arena_next(const ArenaHeader* h) {
+    return (uint32_t*)((char*)h + h->next_off);
+}
+
+static inline Shared* arena_block(const ArenaHeader* h, uint32_t i) {
+    return (Shared*)((char*)h + h->blocks_off + (uint64_t)i * h->block_size);
+}
+
+static inline uint64_t arena_layout(uint32_t nblocks, ArenaHeader* out) {
+    const uint64_t page = 4096;
+    uint32_t ndir = 1;
+    while (ndir < 2 * nblocks) ndir <<= 1;
+    memset(out, 0, sizeof(*out));
+    out->nblocks = nblocks;
+    out->ndir = ndir;
+    out->block_size = (sizeof(Shared) + page - 1) & ~(page - 1);
+    out->dir_off = (sizeof(ArenaHeader) + 63) & ~(uint64_t)63;
+    out->next_off = out->dir_off + (uint64_t)ndir * sizeof(ArenaDirEntry);
+    out->blocks_off = (out->next_off + (uint64_t)nblocks * sizeof(uint32_t) + page - 1) & ~(page - 1);
+    out->total = out->blocks_off + (uint64_t)nblocks * out->block_size;
+    return out->total;
+}
+
+// ---- Slab ----
+
+static inline int64_t arena_slab_pop(ArenaHeader* h) {
+    uint32_t* next = arena_next(h);
+    uint64_t head = __atomic_load_n(&h->free_head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint32_t top = (uint32_t)head;
+        if (top == 0) return -1;
+        uint64_t nh = ((head >> 32) + 1) << 32 | __atomic_load_n(&next[top - 1], __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&h->free_head, &head, nh, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return top - 1;
+    }
+}
+
+static inline void arena_slab_push(ArenaHeader* h, uint32_t i) {
+    uint32_t* next = arena_next(h);
+    uint64_t head = __atomic_load_n(&h->free_head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        __atomic_store_n(&next[i], (uint32_t)head, __ATOMIC_RELAXED);
+        uint64_t nh = ((head >> 32) + 1) << 32 | (i + 1);
+        if (__atomic_compare_exchange_n(&h->free_head, &head, nh, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return;
+    }
+}
+
+// ---- Thư mục ----
+
+#define ARENA_LIVENESS_SPINS 1024 // số vòng chờ giữa hai lần xem pid còn sống
+
+// Chờ mục CREATING xong. Creator chết giữa chừng thì trả về word vẫn CREATING
+// (không khớp tên nào) thay vì chờ mãi.
+static inline uint64_t arena_wait_settled(const ArenaDirEntry* e) {
+    uint64_t w;
+    for (int spins = 1; (w = __atomic_load_n(&e->word, __ATOMIC_ACQUIRE)) >> 32 == ARENA_CREATING; ++spins) {
+        if (spins > 64) sched_yield();
+        if (spins % ARENA_LIVENESS_SPINS == 0 && !stream_pid_alive(__atomic_load_n(&e->creator, __ATOMIC_ACQUIRE)))
+            break;
+    }
+    return w;
+}
+
+static inline void arena_insert_lock(ArenaHeader* h) {
+    int me = getpid();
+    for (int spins = 1;; ++spins) {
+        int owner = 0;
+        if (__atomic_compare_exchange_n(&h->insert_owner, &owner, me, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return;
+        if (spins > 64) sched_yield();
+        // Chủ khóa chết khi đang tạo kênh: lấy lại khóa
+        if (spins % ARENA_LIVENESS_SPINS == 0 && !stream_pid_alive(owner) &&
+            __atomic_compare_exchange_n(&h->insert_owner, &owner, me, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+    }
+}
+
+static inline void arena_insert_unlock(ArenaHeader* h) {
+    __atomic_store_n(&h->insert_owner, 0, __ATOMIC_RELEASE);
+}
+
+// Mục READY có tên name, hoặc NULL.
+static inline ArenaDirEntry* arena_lookup(const ArenaHeader* h, const char* name) {
+    uint32_t hash = arena_hash(name);
+    ArenaDirEntry* dir = arena_dir(h);
+    for (uint32_t k = 0; k < h->ndir; ++k) {
+        ArenaDirEntry* e = &dir[(hash + k) & (h->ndir - 1)];
+        uint64_t w = __atomic_load_n(&e->word, __ATOMIC_ACQUIRE);
+        if (w == 0) return NULL;
+        if ((uint32_t)w != hash) continue;
+        w = arena_wait_settled(e);
+        if (w >> 32 == ARENA_READY && strcmp(e->name, name) == 0) return e;
+    }
+    return NULL;
+}
+
+// Tìm hoặc tạo kênh. *created = 1 nếu process này vừa tạo (caller khởi tạo Shared).
+// NULL nếu arena hết khối hoặc hết mục thư mục (errno = ENOSPC).
+static inline ArenaDirEntry* arena_create(ArenaHeader* h, const char* name, int* created) {
+    ArenaDirEntry* e = arena_lookup(h, name);
+    *created = 0;
+    if (e) return e;
+    uint32_t hash = arena_hash(name);
+    ArenaDirEntry* dir = arena_dir(h);
+    ArenaDirEntry* slot = NULL;
+    arena_insert_lock(h);
+    for (uint32_t k = 0; k < h->ndir; ++k) {
+        e = &dir[(hash + k) & (h->ndir - 1)];
+        uint64_t w = __atomic_load_n(&e->word, __ATOMIC_ACQUIRE);
+        if (w == 0) {
+            if (!slot) slot = e;
+            break;
+        }
+        if (w >> 32 == ARENA_CREATING) {
+            // Đang giữ khóa mà thấy CREATING: creator trước đã chết giữa chừng
+            // (khối nó có thể đã lấy thì mất). Biến thành mục DEAD để dùng lại.
+            __atomic_store_n(&e->word, (uint64_t)ARENA_DEAD << 32 | (uint32_t)w, __ATOMIC_RELEASE);
+            w = (uint64_t)ARENA_DEAD << 32 | (uint32_t)w;
+        }
+        if (w >> 32 == ARENA_DEAD) {
+            if (!slot) slot = e;
+            continue;
+        }
+        if ((uint32_t)w == hash && strcmp(e->name, name) == 0) {
+            arena_insert_unlock(h); // process khác vừa tạo xong
+            return e;
+        }
+    }
+    if (!slot) {
+        arena_insert_unlock(h);
+        errno = ENOSPC;
+        return NULL;
+    }
+    e = slot;
+    __atomic_store_n(&e->creator, (int32_t)getpid(), __ATOMIC_RELAXED);
+    __atomic_store_n(&e->word, (uint64_t)ARENA_CREATING << 32 | hash, __ATOMIC_RELEASE);
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    int64_t b = arena_slab_pop(h);
+    if (b < 0) {
+        __atomic_store_n(&e->word, (uint64_t)ARENA_DEAD << 32 | hash, __ATOMIC_RELEASE);
+        arena_insert_unlock(h);
+        errno = ENOSPC;
+        return NULL;
+    }
+    e->block = (uint32_t)b;
+    __atomic_store_n(&arena_block(h, e->block)->magic, 0, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->channels, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->word, (uint64_t)ARENA_READY << 32 | hash, __ATOMIC_RELEASE);
+    arena_insert_unlock(h);
+    *created = 1;
+    return e;
+}
+
+// Xóa kênh, trả khối về slab. Chỉ gọi khi không còn writer/reader nào gắn vào kênh.
+static inline int arena_remove(ArenaHeader* h, const char* name) {
+    ArenaDirEntry* e = arena_lookup(h, name);
+    if (!e) { errno = ENOENT; return -1; }
+    uint64_t w = (uint64_t)ARENA_READY << 32 | (uint32_t)e->word;
+    if (!__atomic_compare_exchange_n(&e->word, &w, (uint64_t)ARENA_DEAD << 32 | (uint32_t)w, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) { errno = ENOENT; return -1; }
+    __atomic_store_n(&arena_block(h, e->block)->magic, 0, __ATOMIC_RELEASE);
+    arena_slab_push(h, e->block);
+    __atomic_fetch_sub(&h->channels, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Gọi fn cho mọi kênh READY; dừng nếu fn trả về khác 0.
+static inline void arena_foreach(const ArenaHeader* h, int (*fn)(void* ctx, const char* name, const Shared* shm), void* ctx) {
+    const ArenaDirEntry* dir = arena_dir(h);
+    for (uint32_t i = 0; i < h->ndir; ++i) {
+        if (__atomic_load_n(&dir[i].word, __ATOMIC_ACQUIRE) >> 32 != ARENA_READY) continue;
+        if (fn(ctx, dir[i].name, arena_block(h, dir[i].block))) return;
+    }
+}
+
+// ---- Mapping ----
+
+// Map toàn bộ arena (tạo mới nếu create). prot: PROT_READ cho observer.
+// Không dùng bộ đệm mapping; caller tự munmap(h, size).
+static inline ArenaHeader* arena_map_raw(const char* arena, int create, int prot, int wait_secs, size_t* size, const char* tag) {
+    int fd = -1, creator = 0;
+    int oflag = prot & PROT_WRITE ? O_RDWR : O_RDONLY;
+    if (create) {
+        fd = shm_open(arena, O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd >= 0) creator = 1;
+        else if (errno == EEXIST) fd = shm_open(arena, oflag, 0666);
+    } else {
+        for (int i = 0; i <= wait_secs * 10; ++i) {
+            fd = shm_open(arena, oflag, 0666);
+            if (fd >= 0 || errno != ENOENT) break;
+            usleep(100 * 1000);
+        }
+    }
+    if (fd < 0) { perror("shm_open arena"); return NULL; }
+
+    ArenaHeader lay;
+    arena_layout(ARENA_CHANNELS, &lay);
+    if (creator && ftruncate(fd, (off_t)lay.total) == -1) { perror("ftruncate arena"); close(fd); return NULL; }
+    struct stat st;
+    for (int i = 0; i <= 100; ++i) { // creator ftruncate ngay sau khi tạo
+        if (fstat(fd, &st) == -1) { perror("fstat arena"); close(fd); return NULL; }
+        if ((size_t)st.st_size >= sizeof(ArenaHeader)) break;
+        usleep(10 * 1000);
+    }
+    if ((size_t)st.st_size < sizeof(ArenaHeader)) { fprintf(stderr, "arena '%s' too small\n", arena); close(fd); return NULL; }
+    ArenaHeader* h = (ArenaHeader*)mmap(NULL, (size_t)st.st_size, prot, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) { perror("mmap arena"); return NULL; }
+    *size = (size_t)st.st_size;
+
+    if (creator) {
+        memcpy(h, &lay, sizeof(lay));
+        for (uint32_t i = h->nblocks; i-- > 0; ) arena_slab_push(h, i);
+        __atomic_store_n(&h->magic, ARENA_MAGIC, __ATOMIC_RELEASE);
+        if (tag) fprintf(stderr, "[%s] created arena '%s' (%u channels, %llu MiB)\n", tag, arena,
+                         h->nblocks, (unsigned long long)(lay.total >> 20));
+        return h;
+    }
+    for (int i = 0; __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != ARENA_MAGIC; ++i) {
+        if (i > 100 * (wait_secs > 0 ? wait_secs : 1)) {
+            fprintf(stderr, "arena '%s' not initialized (bad magic)\n", arena);
+            munmap(h, *size);
+            return NULL;
+        }
+        usleep(10 * 1000);
+    }
+    if (h->total > *size) {
+        fprintf(stderr, "arena '%s' truncated\n", arena);
+        munmap(h, *size);
+        return NULL;
+    }
+    return h;
+}
+
+// Mapping đọc/ghi dùng chung trong process.
+static inline ArenaMap* arena_attach(const char* arena, int create, int wait_secs, const char* tag) {
+    pthread_mutex_lock(&arena_maps_mu);
+    ArenaMap* free_slot = NULL;
+    for (int i = 0; i < ARENA_MAPS; ++i) {
+        ArenaMap* m = &arena_maps[i];
+        if (m->refs > 0 && strcmp(m->name, arena) == 0) {
+            m->refs++;
+            pthread_mutex_unlock(&arena_maps_mu);
+            return m;
+        }
+        if (m->refs == 0 && !free_slot) free_slot = m;
+    }
+    ArenaMap* m = NULL;
+    if (!free_slot) {
+        fprintf(stderr, "too many arenas open (max %d)\n", ARENA_MAPS);
+    } else if ((free_slot->h = arena_map_raw(arena, create, PROT_READ | PROT_WRITE, wait_secs, &free_slot->size, tag))) {
+        m = free_slot;
+        snprintf(m->name, sizeof(m->name), "%s", arena);
+        m->refs = 1;
+    }
+    pthread_mutex_unlock(&arena_maps_mu);
+    return m;
+}
+
+static inline void arena_detach(ArenaMap* m) {
+    pthread_mutex_lock(&arena_maps_mu);
+    if (--m->refs == 0) {
+        munmap(m->h, m->size);
+        m->h = NULL;
+    }
+    pthread_mutex_unlock(&arena_maps_mu);
+}
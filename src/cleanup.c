@@ -1,17 +1,31 @@
 // cleanup.c
-// gcc cleanup.c -o cleanup
+// gcc cleanup.c -o cleanup -pthread
+// ./cleanup /tên_shm     xóa segment (cả arena nếu là tên arena)
+// ./cleanup arena:kênh   chỉ xóa một kênh trong arena, trả khối cho slab
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include "shared.h"
+#include "segment.h"
 
 int main(int argc, char** argv){
     const char* shm_name = (argc > 1) ? argv[1] : SHM_NAME;
-    // chỉ cần unlink tên; kernel sẽ giải phóng khi không còn process nào giữ mmap/FD
-    if (shm_unlink(shm_name) == -1) {
+    char arena[256], chan[ARENA_NAME_MAX];
+    if (arena_split(shm_name, arena, sizeof(arena), chan, sizeof(chan))) {
+        size_t size;
+        ArenaHeader* h = arena_map_raw(arena, 0, PROT_READ | PROT_WRITE, 0, &size, NULL);
+        if (!h) return 1;
+        int rc = arena_remove(h, chan);
+        if (rc == -1) perror("arena_remove");
+        else printf("Removed channel '%s' (%u left in arena)\n", shm_name, h->channels);
+        munmap(h, size);
+        return rc == -1;
+    }
+    // chỉ cần unlink tên (cả vùng dữ liệu "tên.data"); kernel sẽ giải phóng khi
+    // không còn process nào giữ mmap/FD
+    if (seg_unlink(shm_name) == -1) {
         perror("shm_unlink");
         return 1;
     }
@@ -0,0 +1,137 @@
+// coreader.cpp — reader.c viết lại bằng coroutine (shm_coro.hpp)
+// g++ -std=c++20 -O2 coreader.cpp -o coreader -pthread
+// Mỗi vòng đệm là một coroutine; các vòng đệm được chia đều cho -t thread,
+// mỗi thread chạy một reactor epoll.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "shm_coro.hpp"
+#include "crc32c.h"
+
+struct Output {
+    FILE* fout = nullptr;
+    FILE* fq = nullptr;
+    const char* quarantine_path = nullptr;
+    bool prefix = false; // nhiều vòng đệm: ghi "tên\t" trước mỗi dòng
+    std::mutex mu;
+};
+
+static std::atomic<int> g_failed{0};
+static int g_drain_ms = 5000;
+
+// SIGINT/SIGTERM: như reader.c, lấy nốt bản ghi đang có (tối đa --drain ms) rồi thoát
+static void on_term(int) { shm_request_drain((unsigned)g_drain_ms); }
+
+static shm_task consume(shm_reactor& r, const char* name, Output& out, int wait_secs, size_t batch, bool dedup) {
+    shm_async_ring ring(r, name, wait_secs);
+    if (!ring.ok()) { g_failed++; co_return; }
+    ring.set_dedup(dedup);
+
+    for (;;) {
+        auto recs = co_await ring.next_batch(batch);
+        if (recs.empty()) break;
+
+        std::lock_guard<std::mutex> lk(out.mu);
+        for (const shm_record& rec : recs) {
+            if (rec.meta.flags & REC_F_CRC) {
+                uint32_t got = crc32c(rec.data, rec.meta.len);
+                if (got != rec.meta.crc) {
+                    shm_stat_add(&ring.shm()->stats.crc_errors, 1);
+                    if (!out.fq) out.fq = fopen(out.quarantine_path, "a");
+                    if (out.fq) {
+                        fprintf(out.fq, "crc=%08x expected=%08x len=%u: %s\n", got, rec.meta.crc, rec.meta.len, rec.data);
+                        fflush(out.fq);
+                    }
+                    fprintf(stderr, "[coreader] %s: CRC mismatch, record quarantined\n", name);
+                    continue;
+                }
+            }
+            if (out.prefix) fprintf(out.fout, "%s\t%s\n", name, rec.data);
+            else fprintf(out.fout, "%s\n", rec.data);
+        }
+        fflush(out.fout);
+    }
+    fprintf(stderr, "[coreader] %s: end of stream.\n", name);
+    lz_report(name, "decompress", &ring.lz_stats());
+    seq_report(&ring.seq_stats(), name);
+}
+
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s [-o output.txt] [-n /shm_name]... [-t threads] [-b batch] [-w wait_secs] [-q quarantine] [--dedup] [--drain MS]\n"
+        "  -n  vòng đệm cần đọc, lặp lại để đọc nhiều vòng đệm (mặc định: %s)\n"
+        "  -t  số thread reactor (mặc định: 1)\n"
+        "  -b  số bản ghi tối đa mỗi lần co_await next_batch (mặc định: 64)\n"
+        "  --dedup     bỏ bản ghi lặp seq (writer --producer chạy lại), như reader --dedup\n"
+        "  --drain MS  SIGINT/SIGTERM: lấy nốt bản ghi đang có tối đa MS ms rồi thoát (mặc định: 5000)\n",
+        prog, SHM_NAME);
+}
+
+int main(int argc, char** argv){
+    const char* out_path = "output.txt";
+    const char* quarantine_path = nullptr;
+    std::vector<const char*> names;
+    int threads = 1, wait_secs = 5;
+    size_t batch = 64;
+    bool dedup = false;
+
+    static const struct option long_opts[] = {
+        { "dedup", no_argument, NULL, 'I' },
+        { "drain", required_argument, NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:n:t:b:w:q:h", long_opts, NULL)) != -1){
+        if (opt == 'o') out_path = optarg;
+        else if (opt == 'n') names.push_back(optarg);
+        else if (opt == 't') threads = atoi(optarg);
+        else if (opt == 'b') batch = strtoul(optarg, NULL, 10);
+        else if (opt == 'w') wait_secs = atoi(optarg);
+        else if (opt == 'q') quarantine_path = optarg;
+        else if (opt == 'I') dedup = true;
+        else if (opt == 'T') g_drain_ms = atoi(optarg);
+        else { usage(argv[0]); return 1; }
+    }
+    if (names.empty()) names.push_back(SHM_NAME);
+    if (threads < 1) threads = 1;
+    if ((size_t)threads > names.size()) threads = (int)names.size();
+
+    Output out;
+    out.fout = fopen(out_path, "w");
+    if (!out.fout) { perror("open output"); return 1; }
+    std::string default_quarantine = std::string(out_path) + ".corrupt";
+    out.quarantine_path = quarantine_path ? quarantine_path : default_quarantine.c_str();
+    out.prefix = names.size() > 1;
+
+    // Không SA_RESTART: epoll_wait trả EINTR để reactor thử lại các vòng đệm ngay
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_term;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // Khởi chạy mọi coroutine trước khi các reactor chạy trên thread riêng
+    std::vector<std::unique_ptr<shm_reactor>> reactors;
+    for (int i = 0; i < threads; ++i) reactors.push_back(std::make_unique<shm_reactor>());
+    for (size_t i = 0; i < names.size(); ++i)
+        consume(*reactors[i % threads], names[i], out, wait_secs, batch, dedup);
+    fprintf(stderr, "[coreader] %zu ring(s) on %d thread(s)\n", names.size(), threads);
+
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i) pool.emplace_back([&r = *reactors[i]] { r.run(); });
+    reactors[0]->run();
+    for (auto& t : pool) t.join();
+
+    fclose(out.fout);
+    if (out.fq) fclose(out.fq);
+    return g_failed ? 1 : 0;
+}
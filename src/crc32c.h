@@ -0,0 +1,76 @@
+#pragma once
+// crc32c.h — CRC32C (Castagnoli). Dùng lệnh crc32 của SSE4.2 nếu CPU hỗ trợ
+// (kiểm tra một lần lúc chạy), ngược lại dùng bảng tra 8 bit.
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42_PATH 1
+#endif
+
+static uint32_t crc32c_table[256];
+
+static inline void crc32c_init_table(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1u)));
+        crc32c_table[i] = c;
+    }
+}
+
+static inline uint32_t crc32c_sw(uint32_t crc, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    if (crc32c_table[1] == 0) crc32c_init_table();
+    crc = ~crc;
+    while (n--) crc = crc32c_table[(crc ^ *p++) & 0xffu] ^ (crc >> 8);
+    return ~crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42_PATH
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32c_hw(uint32_t crc, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+#if defined(__x86_64__)
+    uint64_t c = crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+#endif
+    for (; n >= 4; n -= 4, p += 4) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+    while (n--) crc = _mm_crc32_u8(crc, *p++);
+    return ~crc;
+}
+#endif
+
+// 1 nếu đang dùng đường SSE4.2 (để in ra cho người dùng biết).
+static inline int crc32c_hw_available(void) {
+#ifdef CRC32C_HAVE_SSE42_PATH
+    static int have = -1;
+    if (have < 0) have = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    return have;
+#else
+    return 0;
+#endif
+}
+
+// Nối tiếp CRC đã có (crc = giá trị trả về của lần gọi trước, 0 lúc đầu).
+static inline uint32_t crc32c_extend(uint32_t crc, const void* data, size_t n) {
+#ifdef CRC32C_HAVE_SSE42_PATH
+    if (crc32c_hw_available()) return crc32c_hw(crc, data, n);
+#endif
+    return crc32c_sw(crc, data, n);
+}
+
+static inline uint32_t crc32c(const void* data, size_t n) {
+    return crc32c_extend(0, data, n);
+}
@@ -0,0 +1,171 @@
+#pragma once
+// doorbell.h — chuông báo dạng fd để một consumer epoll trên nhiều vòng đệm.
+//
+// Consumer tạo một eventfd cho mỗi vòng đệm và lắng nghe trên UNIX socket
+// trừu tượng "\0shm_doorbell:<tên>". Writer kết nối, nhận eventfd qua
+// SCM_RIGHTS và chỉ write() vào đó khi consumer đã "arm" (Shared.db_armed = 1
+// ngay trước khi ngủ), nên lúc consumer đang bận không tốn syscall nào.
+//
+// Chống mất tín hiệu: consumer ghi armed = 1 rồi kiểm tra lại vòng đệm; writer
+// publish rồi mới đọc armed. Cả hai dùng seq_cst nên ít nhất một bên thấy bên kia.
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include "shared.h"
+
+#define DB_PREFIX "shm_doorbell:"
+
+static inline socklen_t db_addr(struct sockaddr_un* addr, const char* name) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    // sun_path[0] = '\0': namespace trừu tượng, tự biến mất khi socket đóng
+    int n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, DB_PREFIX "%s", name);
+    if (n < 0) n = 0;
+    if ((size_t)n > sizeof(addr->sun_path) - 2) n = (int)sizeof(addr->sun_path) - 2;
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + (size_t)n);
+}
+
+// ---- Truyền fd qua UNIX socket ----
+
+static inline int send_fd(int sock, int fd) {
+    char dummy = 'D';
+    struct iovec iov = { &dummy, 1 };
+    union { char buf[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } u;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &fd, sizeof(int));
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+static inline int recv_fd(int sock) {
+    char dummy;
+    struct iovec iov = { &dummy, 1 };
+    union { char buf[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } u;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) return -1;
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    if (!c || c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) { errno = EPROTO; return -1; }
+    int fd;
+    memcpy(&fd, CMSG_DATA(c), sizeof(int));
+    return fd;
+}
+
+// ---- Phía consumer ----
+
+// Socket lắng nghe (non-blocking) cho vòng đệm name; -1 nếu đã có consumer khác giữ tên.
+static inline int db_listen(const char* name) {
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s < 0) return -1;
+    struct sockaddr_un addr;
+    socklen_t len = db_addr(&addr, name);
+    if (bind(s, (struct sockaddr*)&addr, len) == -1 || listen(s, 16) == -1) { close(s); return -1; }
+    return s;
+}
+
+// Consumer mới bắt đầu phục vụ: writer đang giữ eventfd cũ sẽ kết nối lại.
+static inline void db_publish_gen(Shared* shm) {
+    __atomic_fetch_add(&shm->db_gen, 1u, __ATOMIC_RELEASE);
+}
+
+// Chấp nhận mọi kết nối đang chờ và gửi eventfd cho từng writer.
+static inline void db_serve(int listen_fd, int efd) {
+    for (;;) {
+        int c = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (c < 0) return;
+        if (send_fd(c, efd) == -1) perror("doorbell send_fd");
+        close(c);
+    }
+}
+
+// Trước khi ngủ: arm chuông. Caller phải kiểm tra lại vòng đệm sau khi gọi.
+static inline void db_arm(Shared* shm) {
+    __atomic_store_n(&shm->db_armed, 1u, __ATOMIC_SEQ_CST);
+}
+
+static inline void db_disarm(Shared* shm) {
+    __atomic_store_n(&shm->db_armed, 0u, __ATOMIC_RELAXED);
+}
+
+// Xóa bộ đếm eventfd sau khi epoll báo.
+static inline void db_ack(int efd) {
+    uint64_t v;
+    while (read(efd, &v, sizeof(v)) == (ssize_t)sizeof(v)) {}
+}
+
+// ---- Phía producer ----
+
+typedef struct {
+    const char* name;
+    int efd;               // eventfd nhận từ consumer, -1 nếu chưa có
+    unsigned gen;          // Shared.db_gen lúc nhận efd
+    unsigned retry_budget; // số lần publish còn lại trước khi thử kết nối lại
+} Doorbell;
+
+static inline int db_connect(const char* name) {
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0) return -1;
+    struct sockaddr_un addr;
+    socklen_t len = db_addr(&addr, name);
+    int fd = -1;
+    if (connect(s, (struct sockaddr*)&addr, len) == 0) fd = recv_fd(s);
+    close(s);
+    return fd;
+}
+
+static inline void db_producer_init(Doorbell* db, Shared* shm, const char* name) {
+    db->name = name;
+    db->gen = __atomic_load_n(&shm->db_gen, __ATOMIC_ACQUIRE);
+    db->efd = db_connect(name); // consumer chưa chạy thì thử lại khi nó arm
+    db->retry_budget = 0;
+}
+
+// Gọi sau mỗi lần publish. Chỉ tốn một load khi consumer không ngủ.
+static inline void db_ring(Doorbell* db, Shared* shm) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&shm->db_armed, __ATOMIC_RELAXED)) return;
+    unsigned gen = __atomic_load_n(&shm->db_gen, __ATOMIC_ACQUIRE);
+    if (db->efd >= 0 && gen != db->gen) {
+        // Consumer cũ đã thoát, consumer mới có eventfd khác.
+        close(db->efd);
+        db->efd = -1;
+        db->retry_budget = 0;
+    }
+    if (db->efd < 0) {
+        // Consumer đang ngủ mà ta chưa có fd: kết nối, nhưng không thử ở mọi bản ghi.
+        // Ngân sách < CAP để kịp thử lại trước khi vòng đệm đầy và writer bị chặn.
+        if (db->retry_budget) { db->retry_budget--; return; }
+        db->gen = gen;
+        db->efd = db_connect(db->name);
+        if (db->efd < 0) { db->retry_budget = CAP - 1; return; }
+    }
+    if (!__atomic_exchange_n(&shm->db_armed, 0u, __ATOMIC_ACQ_REL)) return;
+    uint64_t one = 1;
+    if (write(db->efd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        close(db->efd);
+        db->efd = -1;
+    }
+}
+
+static inline void db_producer_close(Doorbell* db) {
+    if (db->efd >= 0) close(db->efd);
+    db->efd = -1;
+}
@@ -0,0 +1,249 @@
+#pragma once
+// filter.h — lọc dòng trong reader trước khi ghi output (--match/--exclude/--regex).
+//  - Ít mẫu: tìm từng mẫu bằng bộ lọc SIMD byte đầu/byte cuối: so 32 (AVX2) hoặc
+//    16 (SSE2) vị trí một lúc xem byte đầu và byte cuối của mẫu có khớp không,
+//    chỉ memcmp ở các vị trí ứng viên. Chọn AVX2/SSE2 lúc chạy như crc32c.h.
+//  - Từ FILTER_AC_MIN mẫu trở lên: automaton Aho-Corasick, quét dòng một lần
+//    bất kể số mẫu.
+//  - Regex: POSIX ERE (regcomp), kiểm tra sau cùng vì đắt nhất.
+// filter_pass() chỉ đọc mẫu/automaton (bộ đếm cập nhật atomic) nên gọi song
+// song từ nhiều worker được.
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILTER_HAVE_X86 1
+#endif
+
+#define FILTER_AC_MIN 4
+
+typedef struct {
+    int (*next)[256]; // bảng chuyển trạng thái đầy đủ (đã gộp liên kết fail)
+    unsigned char* out; // 1 nếu trạng thái kết thúc một mẫu nào đó
+    int states;
+} AhoCorasick;
+
+typedef struct {
+    const char** pat;
+    size_t* len;
+    int n;
+    AhoCorasick ac; // chỉ dùng khi n >= FILTER_AC_MIN
+} LitSet;
+
+typedef struct {
+    LitSet match;   // giữ dòng chứa ít nhất một mẫu (rỗng: giữ mọi dòng)
+    LitSet exclude; // bỏ dòng chứa bất kỳ mẫu nào
+    int has_re;
+    regex_t re;
+    uint64_t seen, kept; // cập nhật atomic
+} Filter;
+
+static inline int filter_active(const Filter* f) {
+    return f->match.n > 0 || f->exclude.n > 0 || f->has_re;
+}
+
+// ---- Tìm một mẫu ----
+
+static inline const char* lit_find_tail(const char* s, size_t n, const char* p, size_t m, size_t i) {
+    for (; i + m <= n; ++i)
+        if (s[i] == p[0] && s[i + m - 1] == p[m - 1] && memcmp(s + i + 1, p + 1, m - 2) == 0) return s + i;
+    return NULL;
+}
+
+#ifdef FILTER_HAVE_X86
+// Cùng thuật toán, 32 vị trí mỗi vòng; chỉ gọi khi CPU có AVX2 (kiểm tra lúc chạy).
+__attribute__((target("avx2")))
+static inline const char* lit_find_avx2(const char* s, size_t n, const char* p, size_t m) {
+    const __m256i first = _mm256_set1_epi8(p[0]);
+    const __m256i last = _mm256_set1_epi8(p[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i bf = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i bl = _mm256_loadu_si256((const __m256i*)(s + i + m - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+        while (mask) {
+            unsigned b = (unsigned)__builtin_ctz(mask);
+            if (memcmp(s + i + b + 1, p + 1, m - 2) == 0) return s + i + b;
+            mask &= mask - 1;
+        }
+    }
+    return lit_find_tail(s, n, p, m, i);
+}
+
+__attribute__((target("sse2")))
+static inline const char* lit_find_sse2(const char* s, size_t n, const char* p, size_t m) {
+    const __m128i first = _mm_set1_epi8(p[0]);
+    const __m128i last = _mm_set1_epi8(p[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i bl = _mm_loadu_si128((const __m128i*)(s + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+        while (mask) {
+            unsigned b = (unsigned)__builtin_ctz(mask);
+            if (memcmp(s + i + b + 1, p + 1, m - 2) == 0) return s + i + b;
+            mask &= mask - 1;
+        }
+    }
+    return lit_find_tail(s, n, p, m, i);
+}
+
+static inline int filter_simd_level(void) {
+    static int level = -1; // 2 = AVX2, 1 = SSE2, 0 = không
+    if (level < 0) level = __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("sse2") ? 1 : 0;
+    return level;
+}
+#endif
+
+static inline const char* lit_find(const char* s, size_t n, const char* p, size_t m) {
+    if (m == 0) return s;
+    if (m > n) return NULL;
+    if (m == 1) return (const char*)memchr(s, (unsigned char)p[0], n);
+#ifdef FILTER_HAVE_X86
+    int level = filter_simd_level();
+    if (level == 2) return lit_find_avx2(s, n, p, m);
+    if (level == 1) return lit_find_sse2(s, n, p, m);
+#endif
+    return lit_find_tail(s, n, p, m, 0);
+}
+
+// ---- Aho-Corasick ----
+
+static inline int ac_build(AhoCorasick* ac, const char** pat, const size_t* len, int n) {
+    size_t total = 1;
+    for (int i = 0; i < n; ++i) total += len[i];
+    ac->next = (int (*)[256])malloc(total * sizeof(*ac->next));
+    ac->out = (unsigned char*)calloc(total, 1);
+    int* fail = (int*)calloc(total, sizeof(int));
+    int* queue = (int*)malloc(total * sizeof(int));
+    if (!ac->next || !ac->out || !fail || !queue) { free(fail); free(queue); return -1; }
+    memset(ac->next, -1, total * sizeof(*ac->next));
+    ac->states = 1;
+
+    // Trie
+    for (int i = 0; i < n; ++i) {
+        int s = 0;
+        for (size_t k = 0; k < len[i]; ++k) {
+            unsigned char c = (unsigned char)pat[i][k];
+            if (ac->next[s][c] < 0) ac->next[s][c] = ac->states++;
+            s = ac->next[s][c];
+        }
+        ac->out[s] = 1;
+    }
+
+    // BFS: điền chuyển thiếu bằng chuyển của trạng thái fail
+    int qh = 0, qt = 0;
+    for (int c = 0; c < 256; ++c) {
+        int t = ac->next[0][c];
+        if (t < 0) ac->next[0][c] = 0;
+        else { fail[t] = 0; queue[qt++] = t; }
+    }
+    while (qh < qt) {
+        int s = queue[qh++];
+        ac->out[s] |= ac->out[fail[s]];
+        for (int c = 0; c < 256; ++c) {
+            int t = ac->next[s][c];
+            if (t < 0) {
+                ac->next[s][c] = ac->next[fail[s]][c];
+            } else {
+                fail[t] = ac->next[fail[s]][c];
+                queue[qt++] = t;
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+static inline int ac_search(const AhoCorasick* ac, const char* s, size_t n) {
+    int st = 0;
+    for (size_t i = 0; i < n; ++i) {
+        st = ac->next[st][(unsigned char)s[i]];
+        if (ac->out[st]) return 1;
+    }
+    return 0;
+}
+
+// ---- Tập mẫu ----
+
+// -1 (errno = ENOMEM) nếu không cấp phát được: caller phải dừng, vì bỏ qua mẫu
+// --match thì bộ lọc cho mọi dòng đi qua.
+static inline int lit_add(LitSet* ls, const char* p) {
+    const char** np = (const char**)realloc(ls->pat, (size_t)(ls->n + 1) * sizeof(*np));
+    if (!np) return -1;
+    ls->pat = np;
+    size_t* nl = (size_t*)realloc(ls->len, (size_t)(ls->n + 1) * sizeof(*nl));
+    if (!nl) return -1;
+    ls->len = nl;
+    ls->pat[ls->n] = p;
+    ls->len[ls->n] = strlen(p);
+    ls->n++;
+    return 0;
+}
+
+static inline int lit_any(const LitSet* ls, const char* s, size_t n) {
+    if (ls->n >= FILTER_AC_MIN) return ac_search(&ls->ac, s, n);
+    for (int i = 0; i < ls->n; ++i)
+        if (lit_find(s, n, ls->pat[i], ls->len[i])) return 1;
+    return 0;
+}
+
+static inline void lit_free(LitSet* ls) {
+    free(ls->pat);
+    free(ls->len);
+    free(ls->ac.next);
+    free(ls->ac.out);
+    memset(ls, 0, sizeof(*ls));
+}
+
+// ---- Filter ----
+
+static inline int filter_add_match(Filter* f, const char* p) { return lit_add(&f->match, p); }
+static inline int filter_add_exclude(Filter* f, const char* p) { return lit_add(&f->exclude, p); }
+
+static inline int filter_set_regex(Filter* f, const char* expr) {
+    int rc = regcomp(&f->re, expr, REG_EXTENDED | REG_NOSUB);
+    if (rc != 0) {
+        char msg[256];
+        regerror(rc, &f->re, msg, sizeof(msg));
+        fprintf(stderr, "bad regex '%s': %s\n", expr, msg);
+        return -1;
+    }
+    f->has_re = 1;
+    return 0;
+}
+
+// Gọi sau khi đã thêm hết mẫu, trước khi lọc (và trước khi tạo thread).
+static inline int filter_compile(Filter* f) {
+#ifdef FILTER_HAVE_X86
+    (void)filter_simd_level();
+#endif
+    LitSet* sets[2] = { &f->match, &f->exclude };
+    for (int i = 0; i < 2; ++i)
+        if (sets[i]->n >= FILTER_AC_MIN && ac_build(&sets[i]->ac, sets[i]->pat, sets[i]->len, sets[i]->n) == -1) {
+            perror("filter");
+            return -1;
+        }
+    return 0;
+}
+
+// 1 nếu giữ dòng s (s[n] phải là '\0' khi có regex).
+static inline int filter_pass(Filter* f, const char* s, size_t n) {
+    __atomic_fetch_add(&f->seen, 1, __ATOMIC_RELAXED);
+    if (f->match.n > 0 && !lit_any(&f->match, s, n)) return 0;
+    if (f->exclude.n > 0 && lit_any(&f->exclude, s, n)) return 0;
+    if (f->has_re && regexec(&f->re, s, 0, NULL, 0) != 0) return 0;
+    __atomic_fetch_add(&f->kept, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static inline void filter_free(Filter* f) {
+    lit_free(&f->match);
+    lit_free(&f->exclude);
+    if (f->has_re) regfree(&f->re);
+    f->has_re = 0;
+}
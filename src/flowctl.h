@@ -0,0 +1,207 @@
+#pragma once
+// flowctl.h — điều tiết phía writer, không tốn syscall nào cho mỗi bản ghi:
+//  - Token bucket (--rate/--burst): giới hạn số bản ghi mỗi giây, đồng hồ là TSC
+//    (rdtsc, hiệu chỉnh một lần lúc khởi động) hoặc clock_gettime qua vDSO nếu CPU
+//    không có TSC bất biến. Chỉ ngủ khi thực sự vượt tốc độ.
+//  - Tín dụng trong segment (ProducerSlot, shared.h): mỗi writer có tối đa
+//    ceil(CAP / số writer) bản ghi chưa được lấy; ring_pop trả tín dụng. Ô của
+//    writer đã chết (SIGKILL, không kịp credit_unregister) được thu hồi khi một
+//    writer phải chờ tín dụng, để hạn mức không bị chia cho writer không còn.
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "shared.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define FLOWCTL_HAVE_TSC 1
+#endif
+
+// ---- Đồng hồ ----
+
+typedef struct {
+    int use_tsc;
+    double ticks_per_ns;
+} FcClock;
+
+static inline uint64_t fc_mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline int fc_tsc_invariant(void) {
+#ifdef FLOWCTL_HAVE_TSC
+    unsigned a, b, c, d;
+    if (__get_cpuid_max(0x80000000u, NULL) < 0x80000007u) return 0;
+    __cpuid(0x80000007u, a, b, c, d);
+    return (d >> 8) & 1u;
+#else
+    return 0;
+#endif
+}
+
+// Hiệu chỉnh TSC theo CLOCK_MONOTONIC trong khoảng 10ms.
+static inline void fc_clock_init(FcClock* c) {
+    c->use_tsc = 0;
+    c->ticks_per_ns = 1.0;
+#ifdef FLOWCTL_HAVE_TSC
+    if (!fc_tsc_invariant()) return;
+    uint64_t n0 = fc_mono_ns(), t0 = __rdtsc();
+    struct timespec d = { 0, 10 * 1000 * 1000 };
+    nanosleep(&d, NULL);
+    uint64_t n1 = fc_mono_ns(), t1 = __rdtsc();
+    if (n1 <= n0 || t1 <= t0) return;
+    c->ticks_per_ns = (double)(t1 - t0) / (double)(n1 - n0);
+    c->use_tsc = 1;
+#endif
+}
+
+static inline uint64_t fc_now(const FcClock* c) {
+#ifdef FLOWCTL_HAVE_TSC
+    if (c->use_tsc) return __rdtsc();
+#endif
+    return fc_mono_ns();
+}
+
+// ---- Token bucket ----
+
+typedef struct {
+    FcClock clk;
+    double per_tick; // token mỗi tick
+    double burst;    // số token tối đa tích lũy được
+    double tokens;   // có thể âm: nợ sẽ được trả bằng cách ngủ
+    uint64_t last;
+    uint64_t waits, wait_ns;
+} TokenBucket;
+
+// rate: bản ghi/giây; burst: số bản ghi được gửi dồn sau một lúc rảnh (>= 1).
+static inline void tb_init(TokenBucket* tb, double rate, double burst) {
+    fc_clock_init(&tb->clk);
+    tb->per_tick = rate / 1e9 / tb->clk.ticks_per_ns;
+    tb->burst = burst < 1 ? 1 : burst;
+    tb->tokens = tb->burst;
+    tb->last = fc_now(&tb->clk);
+    tb->waits = tb->wait_ns = 0;
+}
+
+// Lấy một token; thiếu thì chờ tới khi đủ. Dưới 50µs thì quay vòng trên đồng hồ
+// thay vì nanosleep (ngủ ngắn như vậy thường bị kernel kéo dài gấp nhiều lần).
+static inline void tb_take(TokenBucket* tb) {
+    uint64_t now = fc_now(&tb->clk);
+    tb->tokens += (double)(now - tb->last) * tb->per_tick;
+    if (tb->tokens > tb->burst) tb->tokens = tb->burst;
+    tb->last = now;
+    tb->tokens -= 1;
+    if (tb->tokens >= 0) return;
+
+    uint64_t wait_ticks = (uint64_t)(-tb->tokens / tb->per_tick);
+    uint64_t ns = (uint64_t)((double)wait_ticks / tb->clk.ticks_per_ns);
+    tb->waits++;
+    tb->wait_ns += ns;
+    if (ns >= 50 * 1000) {
+        struct timespec d = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+        while (nanosleep(&d, &d) == -1 && errno == EINTR) {}
+    } else {
+        while (fc_now(&tb->clk) - now < wait_ticks) {
+#ifdef FLOWCTL_HAVE_TSC
+            _mm_pause();
+#endif
+        }
+    }
+}
+
+// ---- Tín dụng producer ----
+
+typedef struct {
+    Shared* shm;
+    int slot;      // -1: bảng đầy, chạy không tín dụng
+    uint32_t tag;  // giá trị RecMeta.prod
+} Credit;
+
+// Chiếm một ô trong bảng; ô của process đã chết được lấy lại.
+static inline int credit_register(Credit* cr, Shared* shm) {
+    cr->shm = shm;
+    cr->slot = -1;
+    cr->tag = 0;
+    int me = (int)getpid();
+    for (int k = 0; k < MAX_PRODUCERS; ++k) {
+        ProducerSlot* ps = &shm->producers[k];
+        int pid = __atomic_load_n(&ps->pid, __ATOMIC_ACQUIRE);
+        int stale = pid != 0 && kill(pid, 0) == -1 && errno == ESRCH;
+        if (pid != 0 && !stale) continue;
+        if (!__atomic_compare_exchange_n(&ps->pid, &pid, me, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) continue;
+        uint32_t gen = __atomic_add_fetch(&ps->gen, 1, __ATOMIC_ACQ_REL) & 0xffffffu;
+        __atomic_store_n(&ps->inflight, 0, __ATOMIC_RELEASE);
+        if (!stale) __atomic_fetch_add(&shm->nproducers, 1, __ATOMIC_ACQ_REL);
+        cr->slot = k;
+        cr->tag = gen << 8 | (uint32_t)(k + 1);
+        return 0;
+    }
+    return -1;
+}
+
+static inline void credit_unregister(Credit* cr) {
+    if (cr->slot < 0) return;
+    ProducerSlot* ps = &cr->shm->producers[cr->slot];
+    __atomic_add_fetch(&ps->gen, 1, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&ps->pid, 0, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&cr->shm->nproducers, 1, __ATOMIC_ACQ_REL);
+    cr->slot = -1;
+}
+
+// Thu hồi ô của các writer đã chết và trả về số writer còn lại. Tăng gen để bản
+// ghi của writer cũ còn trong vòng đệm không trả tín dụng nhầm cho chủ ô mới.
+static inline unsigned credit_reap(Shared* shm) {
+    for (int k = 0; k < MAX_PRODUCERS; ++k) {
+        ProducerSlot* ps = &shm->producers[k];
+        int pid = __atomic_load_n(&ps->pid, __ATOMIC_ACQUIRE);
+        if (pid == 0 || !(kill(pid, 0) == -1 && errno == ESRCH)) continue;
+        if (!__atomic_compare_exchange_n(&ps->pid, &pid, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) continue;
+        __atomic_add_fetch(&ps->gen, 1, __ATOMIC_ACQ_REL);
+        __atomic_store_n(&ps->inflight, 0, __ATOMIC_RELEASE);
+        __atomic_fetch_sub(&shm->nproducers, 1, __ATOMIC_ACQ_REL);
+    }
+    return __atomic_load_n(&shm->nproducers, __ATOMIC_RELAXED);
+}
+
+#define CREDIT_REAP_SPINS 1024 // số lần ngủ 50µs giữa hai lần thu hồi ô chết khi đang chờ
+
+// Gọi ngay trước ring_push: chờ tới khi còn tín dụng rồi ghi nhận một bản ghi
+// đang bay và đóng dấu meta->prod. Chỉ một load khi còn dưới hạn mức.
+// stop (có thể NULL): khác 0 trong lúc chờ thì trả về -1, không ghi nhận gì.
+static inline int credit_acquire(Credit* cr, RecMeta* meta, const volatile sig_atomic_t* stop) {
+    if (cr->slot < 0) return 0;
+    Shared* shm = cr->shm;
+    ProducerSlot* ps = &shm->producers[cr->slot];
+    unsigned n = __atomic_load_n(&shm->nproducers, __ATOMIC_RELAXED);
+    uint64_t quota = n > 1 ? (CAP + n - 1) / n : CAP;
+    // Một writer thì vòng đệm đầy đã chặn ở sem empty, không cần chờ thêm ở đây
+    if (n > 1 && __atomic_load_n(&ps->inflight, __ATOMIC_ACQUIRE) >= quota) {
+        // Hết hạn mức: có thể do writer đã chết vẫn được tính, thu hồi trước khi chờ
+        n = credit_reap(shm);
+        quota = n > 1 ? (CAP + n - 1) / n : CAP;
+        if (n > 1 && __atomic_load_n(&ps->inflight, __ATOMIC_ACQUIRE) >= quota)
+            __atomic_fetch_add(&ps->waits, 1, __ATOMIC_RELAXED);
+        for (unsigned spins = 0; n > 1 && __atomic_load_n(&ps->inflight, __ATOMIC_ACQUIRE) >= quota; ++spins) {
+            if (spins < 64) continue;
+            if (stop && *stop) return -1;
+            usleep(50);
+            n = spins % CREDIT_REAP_SPINS == 0 ? credit_reap(shm) : __atomic_load_n(&shm->nproducers, __ATOMIC_RELAXED);
+            if (n <= 1) break;
+            quota = (CAP + n - 1) / n;
+        }
+    }
+    __atomic_fetch_add(&ps->inflight, 1, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&ps->sent, ps->sent + 1, __ATOMIC_RELAXED); // chỉ chủ ô ghi
+    meta->prod = cr->tag;
+    return 0;
+}
+
+// ring_push thất bại sau credit_acquire: trả lại tín dụng đã ghi nhận.
+static inline void credit_cancel(Credit* cr) {
+    if (cr->slot >= 0) __atomic_fetch_sub(&cr->shm->producers[cr->slot].inflight, 1, __ATOMIC_RELEASE);
+}
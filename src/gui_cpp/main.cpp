@@ -11,8 +11,11 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <string>
+#include <optional>
+#include <vector>
 
-#include "../shared.h"
+#include "../shm_ring.hpp"
+#include "proc_supervisor.h"
 
 // GLAD must be included BEFORE glfw3.h to prevent system GL headers collision
 #include <glad/gl.h>
@@ -25,21 +28,6 @@
 
 static const char* glsl_version = "#version 130";
 
-// Read shared memory (non-destructive, safe for demo). Returns false if not available.
-bool read_shared(Shared*& out_shm, size_t& map_size) {
-    const char* name = SHM_NAME;
-    int fd = shm_open(name, O_RDONLY, 0);
-    if (fd < 0) return false;
-    struct stat st;
-    if (fstat(fd, &st) == -1) { close(fd); return false; }
-    map_size = st.st_size;
-    void* ptr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
-    close(fd);
-    if (ptr == MAP_FAILED) return false;
-    out_shm = reinterpret_cast<Shared*>(ptr);
-    return true;
-}
-
 int main(int, char**) {
     if (!glfwInit()) return 1;
     // GL 3.0 + GLSL 130
@@ -76,8 +64,8 @@ int main(int, char**) {
     char shm_name[128];
     strncpy(shm_name, SHM_NAME, sizeof(shm_name));
 
-    Shared* shm = nullptr;
-    size_t shm_map_size = 0;
+    // Read-only mapping; snapshots go through the seqlock, so the GUI never takes the semaphores.
+    std::optional<shm_observer> shm;
 
     // File paths (relative to running from gui_cpp/build). Both files live in src/
     const std::string src_dir = "../../"; // grandparent directory: src/
@@ -141,8 +129,32 @@ int main(int, char**) {
         return std::string(name);
     };
 
+    // Children (writer/reader/cleanup) are owned by the supervisor instead of
+    // being detached through system("... &").
+    ProcSupervisor sup;
+    static int pipeline_count = 1;
+    static bool log_autoscroll = true;
+
+    // Pipeline k uses SHM_NAME for k == 0 and SHM_NAME.k otherwise, with a
+    // matching output file, so N pipelines can run side by side.
+    auto pipeline_shm = [](int k) -> std::string {
+        return k == 0 ? std::string(SHM_NAME) : std::string(SHM_NAME) + "." + std::to_string(k);
+    };
+    auto pipeline_output = [&](int k) -> std::string {
+        return k == 0 ? output_path : src_dir + "output." + std::to_string(k) + ".txt";
+    };
+    auto launch = [&](const std::string& label, const std::vector<std::string>& argv) -> bool {
+        std::string err;
+        if (sup.spawn(label, argv, &err) < 0) {
+            status_msg = "Failed to start " + label + ": " + err; status_color = ImVec4(1,0,0,1);
+            return false;
+        }
+        return true;
+    };
+
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
+        sup.poll();
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -160,44 +172,125 @@ int main(int, char**) {
         ImGui::Text("SHM: %s", SHM_NAME);
         if (shm) {
             ImGui::SameLine();
-            ImGui::Text("  |  Address: %p", (void*)shm);
+            ImGui::Text("  |  Address: %p", (const void*)shm->get());
         }
         ImGui::SameLine();
         if (ImGui::Button("Refresh SHM")) {
-            if (shm) { munmap(shm, shm_map_size); shm = nullptr; }
-            if (!read_shared(shm, shm_map_size)) { shm = nullptr; }
+            shm = shm_observer::open(SHM_NAME);
         }
         ImGui::Separator();
 
         // Primary control buttons
         if (ImGui::Button("Start Writer")) {
-            std::string exe = find_exe("writer");
-            std::string cmd = exe + " -i " + input_path + " -n /shm_file_demo &";
-            system(cmd.c_str());
-            status_msg = "Writer started"; status_color = ImVec4(0,0.5f,0,1);
+            if (launch("writer#0", {find_exe("writer"), "-i", input_path, "-n", pipeline_shm(0)})) {
+                status_msg = "Writer started"; status_color = ImVec4(0,0.5f,0,1);
+            }
         }
         ImGui::SameLine();
         if (ImGui::Button("Start Reader")) {
-            std::string exe = find_exe("reader");
-            std::string cmd = exe + " -o " + output_path + " -n /shm_file_demo -w 10 &";
-            system(cmd.c_str());
-            status_msg = "Reader started"; status_color = ImVec4(0,0.5f,0.5f,1);
+            if (launch("reader#0", {find_exe("reader"), "-o", output_path, "-n", pipeline_shm(0), "-w", "10"})) {
+                status_msg = "Reader started"; status_color = ImVec4(0,0.5f,0.5f,1);
+            }
         }
         ImGui::SameLine();
         if (ImGui::Button("Cleanup SHM")) {
-            std::string exe = find_exe("cleanup");
-            std::string cmd = exe + " /shm_file_demo 2>/dev/null";
-            system(cmd.c_str());
+            for (int k = 0; k < pipeline_count; ++k) launch("cleanup#" + std::to_string(k), {find_exe("cleanup"), pipeline_shm(k)});
             status_msg = "Cleanup executed"; status_color = ImVec4(0.6f,0,0,1);
         }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(ImGui::GetFontSize() * 6);
+        ImGui::InputInt("##pipelines", &pipeline_count);
+        if (pipeline_count < 1) pipeline_count = 1;
+        if (pipeline_count > 64) pipeline_count = 64;
+        ImGui::SameLine();
+        if (ImGui::Button("Start Pipelines")) {
+            int started = 0;
+            for (int k = 0; k < pipeline_count; ++k) {
+                std::string tag = "#" + std::to_string(k);
+                started += launch("reader" + tag, {find_exe("reader"), "-o", pipeline_output(k), "-n", pipeline_shm(k), "-w", "10"});
+                started += launch("writer" + tag, {find_exe("writer"), "-i", input_path, "-n", pipeline_shm(k)});
+            }
+            if (started == 2 * pipeline_count) {
+                status_msg = "Started " + std::to_string(pipeline_count) + " pipeline(s)"; status_color = ImVec4(0,0.5f,0,1);
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Stop All")) {
+            sup.stop_all();
+            status_msg = "Sent SIGTERM to all children"; status_color = ImVec4(0.6f,0.3f,0,1);
+        }
+
+        // Supervised children and their captured output
+        if (ImGui::CollapsingHeader("Processes", ImGuiTreeNodeFlags_DefaultOpen)) {
+            int remove_id = 0;
+            if (ImGui::BeginTable("procs", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+                                  ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 5))) {
+                ImGui::TableSetupColumn("Name");
+                ImGui::TableSetupColumn("PID");
+                ImGui::TableSetupColumn("State");
+                ImGui::TableSetupColumn("Actions");
+                ImGui::TableHeadersRow();
+                for (const ProcSupervisor::Proc& p : sup.procs()) {
+                    ImGui::PushID(p.id);
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(p.name.c_str());
+                    ImGui::TableNextColumn();
+                    if (p.running) ImGui::Text("%d", (int)p.pid); else ImGui::TextDisabled("-");
+                    ImGui::TableNextColumn();
+                    if (p.running) ImGui::TextColored(ImVec4(0,0.5f,0,1), p.restart_pending ? "restarting" : "running");
+                    else if (p.term_signal) ImGui::TextColored(ImVec4(0.8f,0,0,1), "signal %d", p.term_signal);
+                    else ImGui::TextColored(p.exit_code == 0 ? ImVec4(0.3f,0.3f,0.3f,1) : ImVec4(0.8f,0,0,1), "exit %d", p.exit_code);
+                    ImGui::TableNextColumn();
+                    if (p.running) {
+                        if (ImGui::SmallButton("Stop")) sup.stop(p.id);
+                        ImGui::SameLine();
+                        if (ImGui::SmallButton("Kill")) sup.stop(p.id, SIGKILL);
+                        ImGui::SameLine();
+                    }
+                    if (ImGui::SmallButton("Restart")) {
+                        std::string err;
+                        if (!sup.restart(p.id, &err)) { status_msg = "Restart failed: " + err; status_color = ImVec4(1,0,0,1); }
+                    }
+                    if (!p.running) {
+                        ImGui::SameLine();
+                        if (ImGui::SmallButton("Remove")) remove_id = p.id;
+                    }
+                    ImGui::PopID();
+                }
+                ImGui::EndTable();
+            }
+            if (remove_id) sup.remove(remove_id);
 
-        // Optional SHM snapshot
+            ImGui::Checkbox("Auto-scroll", &log_autoscroll);
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Clear log")) sup.clear_log();
+            ImGui::BeginChild("proc_log", ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 6), true);
+                ImGuiListClipper clipper;
+                clipper.Begin((int)sup.log().size());
+                while (clipper.Step()) {
+                    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+                        const ProcSupervisor::LogLine& l = sup.log()[(size_t)i];
+                        const ProcSupervisor::Proc* p = sup.find(l.proc_id);
+                        const char* who = p ? p->name.c_str() : "?";
+                        if (l.is_err) ImGui::TextColored(ImVec4(0.6f,0.2f,0,1), "%s: %s", who, l.text.c_str());
+                        else ImGui::Text("%s: %s", who, l.text.c_str());
+                    }
+                }
+                if (log_autoscroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) ImGui::SetScrollHereY(1.0f);
+            ImGui::EndChild();
+        }
+
+        // Optional SHM snapshot (seqlock: consistent copy, never writes to the segment)
         if (ImGui::CollapsingHeader("Shared Memory Snapshot", ImGuiTreeNodeFlags_DefaultOpen)) {
             if (shm) {
-                ImGui::Text("in=%zu  out=%zu", shm->in, shm->out);
+                static ShmSnapshot snap;
+                bool ok = shm->snapshot(snap);
+                ImGui::Text("in=%llu  out=%llu  used=%llu  seq=%u", (unsigned long long)snap.in, (unsigned long long)snap.out,
+                            (unsigned long long)(snap.in - snap.out), snap.seq);
+                if (!ok) { ImGui::SameLine(); ImGui::TextColored(ImVec4(0.8f,0.4f,0,1), "(busy, may be torn)"); }
                 ImGui::BeginChild("shm_view", ImVec2(0, 120), true);
                 for (size_t i = 0; i < CAP; ++i) {
-                    ImGui::Text("[%zu] %s", i, shm->buf[i]);
+                    ImGui::Text("[%zu] %.*s", i, (int)strnlen(snap.buf[i], MSG_MAX), snap.buf[i]);
                 }
                 ImGui::EndChild();
             } else {
@@ -205,6 +298,55 @@ int main(int, char**) {
             }
         }
 
+        // Channels of a multi-channel arena (writer/reader -n arena:channel)
+        if (ImGui::CollapsingHeader("Arena Channels")) {
+            static char arena_name[128] = "/shm_arena";
+            static std::optional<shm_arena_view> arena;
+            static std::string arena_err;
+            ImGui::SetNextItemWidth(ImGui::GetFontSize() * 12);
+            ImGui::InputText("##arena", arena_name, sizeof(arena_name));
+            ImGui::SameLine();
+            if (ImGui::Button("Open Arena")) {
+                arena = shm_arena_view::open(arena_name, &arena_err);
+            }
+            if (arena) {
+                const ArenaHeader* h = arena->header();
+                std::vector<shm_arena_view::channel> chans = arena->channels();
+                ImGui::SameLine();
+                ImGui::Text("%zu / %u channels", chans.size(), h->nblocks);
+                if (ImGui::BeginTable("arena_chans", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+                                      ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 8))) {
+                    ImGui::TableSetupColumn("Channel");
+                    ImGui::TableSetupColumn("In");
+                    ImGui::TableSetupColumn("Out");
+                    ImGui::TableSetupColumn("Used");
+                    ImGui::TableSetupColumn("");
+                    ImGui::TableHeadersRow();
+                    for (const shm_arena_view::channel& c : chans) {
+                        ShmSnapshot cs;
+                        shm_snapshot(c.shm, &cs, 16);
+                        ImGui::PushID(c.name.c_str());
+                        ImGui::TableNextRow();
+                        ImGui::TableNextColumn(); ImGui::TextUnformatted(c.name.c_str());
+                        ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)cs.in);
+                        ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)cs.out);
+                        ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)(cs.in - cs.out));
+                        ImGui::TableNextColumn();
+                        if (ImGui::SmallButton("Observe")) {
+                            std::string full = std::string(arena_name) + ":" + c.name, err;
+                            shm = shm_observer::open(full.c_str(), false, &err);
+                            if (shm) { status_msg = "Observing " + full; status_color = ImVec4(0,0.4f,0.8f,1); }
+                            else { status_msg = "Observe failed: " + err; status_color = ImVec4(1,0,0,1); }
+                        }
+                        ImGui::PopID();
+                    }
+                    ImGui::EndTable();
+                }
+            } else if (!arena_err.empty()) {
+                ImGui::TextColored(ImVec4(1,0,0,1), "%s", arena_err.c_str());
+            }
+        }
+
         ImGui::Separator();
 
         // Central fixed-ratio split panes
@@ -282,7 +424,7 @@ int main(int, char**) {
         glfwSwapBuffers(window);
     }
 
-    if (shm) munmap(shm, shm_map_size);
+    shm.reset();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,254 @@
+#include "proc_supervisor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+static const int kTermGraceMs = 2000;
+
+static int pidfd_open_compat(pid_t pid) {
+    long fd = syscall(SYS_pidfd_open, pid, 0);
+    return fd < 0 ? -1 : (int)fd;
+}
+
+ProcSupervisor::ProcSupervisor(size_t max_log_lines) : max_log_(max_log_lines) {}
+
+ProcSupervisor::~ProcSupervisor() {
+    // Don't leave orphans behind when the window closes.
+    for (Proc& p : procs_) {
+        if (p.running) kill(p.pid, SIGTERM);
+    }
+    // A child that ignores or stalls on SIGTERM must not freeze the window:
+    // give them kTermGraceMs to exit, then SIGKILL whatever is left.
+    for (int waited = 0; running_count() > 0 && waited < kTermGraceMs; waited += 20) {
+        for (Proc& p : procs_) {
+            if (p.running) reap(p, false);
+        }
+        if (running_count() > 0) usleep(20 * 1000);
+    }
+    for (Proc& p : procs_) {
+        if (p.running) {
+            kill(p.pid, SIGKILL);
+            reap(p, true);
+        }
+        close_fds(p);
+    }
+}
+
+ProcSupervisor::Proc* ProcSupervisor::find_mut(int id) {
+    for (Proc& p : procs_) if (p.id == id) return &p;
+    return nullptr;
+}
+
+const ProcSupervisor::Proc* ProcSupervisor::find(int id) const {
+    for (const Proc& p : procs_) if (p.id == id) return &p;
+    return nullptr;
+}
+
+size_t ProcSupervisor::running_count() const {
+    size_t n = 0;
+    for (const Proc& p : procs_) n += p.running ? 1 : 0;
+    return n;
+}
+
+void ProcSupervisor::close_fds(Proc& p) {
+    if (p.out_fd >= 0) { close(p.out_fd); p.out_fd = -1; }
+    if (p.err_fd >= 0) { close(p.err_fd); p.err_fd = -1; }
+    if (p.pidfd >= 0) { close(p.pidfd); p.pidfd = -1; }
+}
+
+bool ProcSupervisor::start(Proc& p, std::string* err) {
+    int out_pipe[2], err_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) == -1) {
+        if (err) *err = std::string("pipe: ") + strerror(errno);
+        return false;
+    }
+    if (pipe2(err_pipe, O_CLOEXEC) == -1) {
+        if (err) *err = std::string("pipe: ") + strerror(errno);
+        close(out_pipe[0]); close(out_pipe[1]);
+        return false;
+    }
+
+    // dup2 in the child clears FD_CLOEXEC on 1/2; every other pipe end is
+    // closed by exec because of O_CLOEXEC.
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, out_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&fa, err_pipe[1], STDERR_FILENO);
+
+    std::vector<char*> args;
+    for (const std::string& a : p.argv) args.push_back(const_cast<char*>(a.c_str()));
+    args.push_back(nullptr);
+
+    pid_t pid = -1;
+    int rc = posix_spawn(&pid, args[0], &fa, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&fa);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    if (rc != 0) {
+        if (err) *err = p.argv[0] + ": " + strerror(rc);
+        close(out_pipe[0]); close(err_pipe[0]);
+        return false;
+    }
+
+    fcntl(out_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(err_pipe[0], F_SETFL, O_NONBLOCK);
+    p.pid = pid;
+    p.pidfd = pidfd_open_compat(pid);
+    p.out_fd = out_pipe[0];
+    p.err_fd = err_pipe[0];
+    p.running = true;
+    p.exit_code = -1;
+    p.term_signal = 0;
+    p.restart_pending = false;
+    p.out_partial.clear();
+    p.err_partial.clear();
+    return true;
+}
+
+int ProcSupervisor::spawn(const std::string& name, const std::vector<std::string>& argv, std::string* err) {
+    if (argv.empty()) {
+        if (err) *err = "empty argv";
+        return -1;
+    }
+    Proc p;
+    p.id = next_id_++;
+    p.name = name;
+    p.argv = argv;
+    if (!start(p, err)) return -1;
+    procs_.push_back(std::move(p));
+    return procs_.back().id;
+}
+
+bool ProcSupervisor::stop(int id, int sig) {
+    Proc* p = find_mut(id);
+    if (!p || !p->running) return false;
+    return kill(p->pid, sig) == 0;
+}
+
+bool ProcSupervisor::restart(int id, std::string* err) {
+    Proc* p = find_mut(id);
+    if (!p) return false;
+    if (p->running) {
+        p->restart_pending = true;
+        return kill(p->pid, SIGTERM) == 0;
+    }
+    close_fds(*p);
+    return start(*p, err);
+}
+
+void ProcSupervisor::remove(int id) {
+    for (size_t i = 0; i < procs_.size(); ++i) {
+        if (procs_[i].id == id && !procs_[i].running) {
+            close_fds(procs_[i]);
+            procs_.erase(procs_.begin() + (long)i);
+            return;
+        }
+    }
+}
+
+void ProcSupervisor::stop_all() {
+    for (Proc& p : procs_) {
+        if (p.running) kill(p.pid, SIGTERM);
+    }
+}
+
+void ProcSupervisor::push_line(int id, bool is_err, std::string text) {
+    log_.push_back(LogLine{id, is_err, std::move(text)});
+    while (log_.size() > max_log_) log_.pop_front();
+}
+
+void ProcSupervisor::drain_fd(Proc& p, bool is_err) {
+    int& fd = is_err ? p.err_fd : p.out_fd;
+    std::string& partial = is_err ? p.err_partial : p.out_partial;
+    char buf[4096];
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n > 0) {
+            partial.append(buf, (size_t)n);
+            size_t pos;
+            while ((pos = partial.find('\n')) != std::string::npos) {
+                push_line(p.id, is_err, partial.substr(0, pos));
+                partial.erase(0, pos + 1);
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        // EOF or hard error: flush the tail and stop watching this pipe.
+        if (!partial.empty()) { push_line(p.id, is_err, partial); partial.clear(); }
+        close(fd);
+        fd = -1;
+        return;
+    }
+}
+
+void ProcSupervisor::reap(Proc& p, bool block) {
+    int status = 0;
+    pid_t r;
+    do {
+        r = waitpid(p.pid, &status, block ? 0 : WNOHANG);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0) return;
+    p.running = false;
+    if (r > 0) {
+        if (WIFEXITED(status)) p.exit_code = WEXITSTATUS(status);
+        else if (WIFSIGNALED(status)) p.term_signal = WTERMSIG(status);
+    }
+    if (p.pidfd >= 0) { close(p.pidfd); p.pidfd = -1; }
+}
+
+void ProcSupervisor::poll() {
+    // One poll() over every pipe and pidfd with a zero timeout: the frame is
+    // never delayed, and children without readable fds cost nothing.
+    std::vector<struct pollfd> fds;
+    std::vector<std::pair<size_t, int>> owner; // (proc index, 0=out 1=err 2=pidfd)
+    for (size_t i = 0; i < procs_.size(); ++i) {
+        Proc& p = procs_[i];
+        if (p.out_fd >= 0) { fds.push_back({p.out_fd, POLLIN, 0}); owner.push_back({i, 0}); }
+        if (p.err_fd >= 0) { fds.push_back({p.err_fd, POLLIN, 0}); owner.push_back({i, 1}); }
+        if (p.running && p.pidfd >= 0) { fds.push_back({p.pidfd, POLLIN, 0}); owner.push_back({i, 2}); }
+    }
+    if (!fds.empty() && ::poll(fds.data(), fds.size(), 0) > 0) {
+        // Drain pipes before reaping so the last lines of a child are logged
+        // ahead of its exit status.
+        for (size_t k = 0; k < fds.size(); ++k) {
+            if (!fds[k].revents || owner[k].second == 2) continue;
+            drain_fd(procs_[owner[k].first], owner[k].second == 1);
+        }
+        for (size_t k = 0; k < fds.size(); ++k) {
+            if (fds[k].revents && owner[k].second == 2) reap(procs_[owner[k].first], false);
+        }
+    }
+
+    for (Proc& p : procs_) {
+        // Kernels without pidfd support: fall back to a WNOHANG probe.
+        if (p.running && p.pidfd < 0) reap(p, false);
+        if (p.running || p.pid < 0) continue;
+
+        if (p.out_fd >= 0) drain_fd(p, false);
+        if (p.err_fd >= 0) drain_fd(p, true);
+        char msg[96];
+        if (p.term_signal) snprintf(msg, sizeof(msg), "[supervisor] pid %d killed by signal %d", (int)p.pid, p.term_signal);
+        else snprintf(msg, sizeof(msg), "[supervisor] pid %d exited with code %d", (int)p.pid, p.exit_code);
+        push_line(p.id, p.term_signal != 0 || p.exit_code != 0, msg);
+        p.pid = -1;
+
+        if (p.restart_pending) {
+            close_fds(p);
+            std::string err;
+            if (!start(p, &err)) push_line(p.id, true, "[supervisor] restart failed: " + err);
+        }
+    }
+}
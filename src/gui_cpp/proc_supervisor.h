@@ -0,0 +1,75 @@
+// In-process supervisor for the writer/reader/cleanup children launched by the
+// GUI. Children are started with posix_spawn, their stdout/stderr are captured
+// through non-blocking pipes and they are reaped through pidfds, so the render
+// loop never blocks on a child.
+#pragma once
+
+#include <signal.h>
+#include <sys/types.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+class ProcSupervisor {
+public:
+    struct Proc {
+        int id = 0;
+        std::string name;                 // label shown in the GUI, e.g. "writer#0"
+        std::vector<std::string> argv;    // argv[0] is the executable path
+        pid_t pid = -1;
+        int pidfd = -1;                   // -1 if pidfd_open is unavailable
+        int out_fd = -1;                  // read end of child's stdout
+        int err_fd = -1;                  // read end of child's stderr
+        bool running = false;
+        int exit_code = -1;               // valid once !running and pid was reaped
+        int term_signal = 0;              // non-zero if killed by a signal
+        bool restart_pending = false;     // respawn as soon as the old pid is reaped
+        std::string out_partial, err_partial; // incomplete trailing lines
+    };
+
+    struct LogLine {
+        int proc_id;
+        bool is_err;
+        std::string text;
+    };
+
+    explicit ProcSupervisor(size_t max_log_lines = 4000);
+    ~ProcSupervisor();
+
+    ProcSupervisor(const ProcSupervisor&) = delete;
+    ProcSupervisor& operator=(const ProcSupervisor&) = delete;
+
+    // Spawns a child and returns its id (>0), or -1 with errno-style message in err.
+    int spawn(const std::string& name, const std::vector<std::string>& argv, std::string* err = nullptr);
+    // Sends sig to a running child. Reaping happens later in poll().
+    bool stop(int id, int sig = SIGTERM);
+    // Starts the child again with the same argv. A running child is sent
+    // SIGTERM first and respawned by poll() once it has been reaped.
+    bool restart(int id, std::string* err = nullptr);
+    // Forgets an exited child.
+    void remove(int id);
+    // Sends SIGTERM to every running child.
+    void stop_all();
+
+    // Drains pipes and reaps exited children. Never blocks; call once per frame.
+    void poll();
+
+    const std::vector<Proc>& procs() const { return procs_; }
+    const std::deque<LogLine>& log() const { return log_; }
+    const Proc* find(int id) const;
+    size_t running_count() const;
+    void clear_log() { log_.clear(); }
+
+private:
+    Proc* find_mut(int id);
+    bool start(Proc& p, std::string* err);
+    void drain_fd(Proc& p, bool is_err);
+    void push_line(int id, bool is_err, std::string text);
+    void reap(Proc& p, bool block);
+    void close_fds(Proc& p);
+
+    std::vector<Proc> procs_;
+    std::deque<LogLine> log_;
+    size_t max_log_;
+    int next_id_ = 1;
+};
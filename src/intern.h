@@ -0,0 +1,89 @@
+#pragma once
+// intern.h — phía writer của bảng intern (writer -d, xem DictEntry trong shared.h).
+// Dòng gặp lần đầu chỉ được ghi nhớ mã băm trong bộ lọc riêng của writer; gặp lần
+// thứ hai thì được ghi vào bảng dùng chung và từ đó gửi dạng DictRef 8 byte.
+// Nhờ vậy dòng không lặp lại không tốn thêm lần chép nào vào bảng.
+// Chỉ một writer cho mỗi vòng đệm: tra, ghi bảng và đọc shm->in (last_ref) đều
+// nằm ngoài shm->mutex. writer -d giữ luồng độc quyền (stream_open_excl) nên
+// writer khác bị từ chối trong lúc nó chạy, và nó bị từ chối khi đã có writer khác.
+#include <stdint.h>
+#include <string.h>
+#include "shared.h"
+#include "crc32c.h"
+
+#define INTERN_SEEN 4096 // bộ lọc "đã gặp một lần", ánh xạ trực tiếp theo mã băm
+#define INTERN_MIN_LEN 16 // dòng ngắn hơn thì gửi thẳng (tham chiếu không lợi bao nhiêu)
+
+typedef struct {
+    uint32_t seen[INTERN_SEEN];
+    uint64_t refs, inserts, saved;
+} Interner;
+
+static inline int dict_find(const Shared* shm, uint32_t h, const char* msg, uint32_t len) {
+    for (unsigned k = 0; k < DICT_PROBE; ++k) {
+        unsigned i = (h + k) & (DICT_SLOTS - 1);
+        const DictEntry* e = &shm->dict[i];
+        if (e->gen != 0 && e->hash == h && e->len == len && memcmp(e->data, msg, len) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// Chọn ô trong cửa sổ dò: ô trống, nếu không thì ô có tham chiếu cũ nhất đã
+// được trả. -1 nếu mọi ô còn đang được tham chiếu trong vòng đệm.
+static inline int dict_victim(const Shared* shm, uint32_t h) {
+    uint64_t released = __atomic_load_n(&shm->released, __ATOMIC_ACQUIRE);
+    int best = -1;
+    for (unsigned k = 0; k < DICT_PROBE; ++k) {
+        unsigned i = (h + k) & (DICT_SLOTS - 1);
+        const DictEntry* e = &shm->dict[i];
+        if (e->gen == 0) return (int)i;
+        if (e->last_ref > released) continue;
+        if (best < 0 || e->last_ref < shm->dict[best].last_ref) best = (int)i;
+    }
+    return best;
+}
+
+static inline void dict_store(Shared* shm, int i, uint32_t h, const char* msg, uint32_t len) {
+    DictEntry* e = &shm->dict[i];
+    unsigned s = e->seq | 1u; // lẻ kể cả khi writer trước chết giữa chừng
+    __atomic_store_n(&e->seq, s, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(e->data, msg, len);
+    e->len = len;
+    e->hash = h;
+    e->gen = e->gen + 1 ? e->gen + 1 : 1;
+    e->last_ref = 0;
+    __atomic_store_n(&e->seq, s + 1, __ATOMIC_RELEASE);
+}
+
+// Gọi ngay trước ring_push của bản ghi (meta, msg), khi shm->in là offset của nó.
+// Trả về 1 và điền out_meta/out (DictRef) nếu nên gửi tham chiếu thay cho msg.
+// CRC (nếu có) vẫn là CRC của dòng gốc để reader kiểm tra cả kết quả tra bảng.
+static inline int intern_ref(Interner* in, Shared* shm, const RecMeta* meta, const char* msg,
+                             RecMeta* out_meta, char out[sizeof(DictRef)]) {
+    uint32_t len = meta->len < MSG_MAX ? meta->len : MSG_MAX - 1;
+    if ((meta->flags & REC_F_FRAME) || len < INTERN_MIN_LEN) return 0;
+    uint32_t h = (meta->flags & REC_F_CRC) ? meta->crc : crc32c(msg, len);
+
+    int i = dict_find(shm, h, msg, len);
+    if (i < 0) {
+        uint32_t* seen = &in->seen[h & (INTERN_SEEN - 1)];
+        if (*seen != h) { *seen = h; return 0; }
+        if ((i = dict_victim(shm, h)) < 0) return 0;
+        dict_store(shm, i, h, msg, len);
+        in->inserts++;
+    }
+
+    DictEntry* e = &shm->dict[i];
+    e->last_ref = shm->in + 1;
+    DictRef ref = { (uint32_t)i, e->gen };
+    memcpy(out, &ref, sizeof(ref));
+    *out_meta = *meta;
+    out_meta->len = sizeof(ref);
+    out_meta->flags |= REC_F_REF;
+    in->refs++;
+    in->saved += len - sizeof(ref);
+    shm_stat_add(&shm->stats.dict_refs, 1);
+    shm_stat_add(&shm->stats.dict_saved, len - sizeof(ref));
+    return 1;
+}
@@ -0,0 +1,61 @@
+#!/bin/bash
+# lzcheck.sh — frame nén (writer -z) với nhiều writer/reader trên một vòng đệm:
+# mọi dòng phải tới đúng một lần, không frame nào bị bỏ. Chạy: make check
+set -u
+cd "$(dirname "$0")"
+N=${N:-50000}
+SHM=/lzcheck_$$
+TMP=$(mktemp -d)
+fail=0
+trap 'rm -rf "$TMP"; rm -f /dev/shm${SHM} /dev/shm${SHM}.data' EXIT
+
+seq 1 "$N" | sed 's/^/a line /' > "$TMP/a.txt"
+seq 1 "$N" | sed 's/^/b line /' > "$TMP/b.txt"
+
+# check <tên> <số dòng mong đợi> <file input...> -- <file output...>
+check() {
+    local name=$1 want=$2; shift 2
+    local ins=() outs=()
+    while [ "$1" != "--" ]; do ins+=("$1"); shift; done
+    shift
+    outs=("$@")
+    local got dropped
+    got=$(cat "${outs[@]}" | wc -l)
+    dropped=$(grep -ho "[0-9]* dropped" "$TMP"/r*.log | awk '{s += $1} END {print s + 0}')
+    if [ "$got" -eq "$want" ] && [ "$dropped" -eq 0 ] &&
+       cmp -s <(sort "${ins[@]}") <(sort "${outs[@]}"); then
+        echo "[lzcheck] $name: $got/$want line(s) OK"
+    else
+        echo "[lzcheck] $name: $got/$want line(s), $dropped frame(s) dropped FAIL"
+        fail=1
+    fi
+}
+
+# 1) Hai writer -z, một reader
+rm -f /dev/shm${SHM} /dev/shm${SHM}.data
+timeout 60 ./reader -o "$TMP/o1.txt" -n "$SHM" -w 10 > /dev/null 2> "$TMP/r1.log" &
+r=$!
+timeout 60 ./writer -i "$TMP/a.txt" -n "$SHM" -z 64 2> /dev/null &
+w1=$!
+timeout 60 ./writer -i "$TMP/b.txt" -n "$SHM" -z 64 2> /dev/null &
+w2=$!
+wait $w1 $w2 $r
+check "2 writers -z, 1 reader" $((2 * N)) "$TMP/a.txt" "$TMP/b.txt" -- "$TMP/o1.txt"
+
+# 2) Một writer -z, hai reader. Segment được tạo trước bằng một luồng rỗng: cả hai
+# reader gắn vào rồi chờ writer mới, writer chỉ chạy khi cả hai đã chờ.
+rm -f /dev/shm${SHM} /dev/shm${SHM}.data "$TMP"/r*.log
+./writer -i /dev/null -n "$SHM" -z 64 2> /dev/null
+timeout 60 ./reader -o "$TMP/o2.txt" -n "$SHM" -w 10 > /dev/null 2> "$TMP/r2.log" &
+r1=$!
+timeout 60 ./reader -o "$TMP/o3.txt" -n "$SHM" -w 10 > /dev/null 2> "$TMP/r3.log" &
+r2=$!
+for _ in $(seq 1 500); do
+    [ "$(cat "$TMP/r2.log" "$TMP/r3.log" | grep -c "waiting for a writer")" -eq 2 ] && break
+    sleep 0.01
+done
+timeout 60 ./writer -i "$TMP/a.txt" -n "$SHM" -z 64 2> /dev/null
+wait $r1 $r2
+check "1 writer -z, 2 readers" "$N" "$TMP/a.txt" -- "$TMP/o2.txt" "$TMP/o3.txt"
+
+exit $fail
@@ -0,0 +1,416 @@
+#pragma once
+// lzframe.h — nén theo lô cho writer -z: gom nhiều bản ghi thành một frame, nén
+// LZ77 (định dạng block của LZ4: token 4+4 bit, offset 16 bit, khớp tối thiểu 4
+// byte), rồi chia frame thành các mảnh MSG_MAX-1 byte, mỗi mảnh một ô vòng đệm.
+// Mảnh mang cờ REC_F_FRAME (+ FIRST/LAST), offset log = offset vòng đệm như cũ.
+//
+// Frame:  LzfHeader | thân (nén hoặc để nguyên nếu nén không lợi)
+// Thân giải nén: lặp lại [u16 len][u16 flags][u32 src][len byte] cho mỗi bản ghi.
+//
+// Phía đọc gọi ring_pop_frames() thay cho ring_pop(): mảnh được ráp và giải nén
+// bên trong, caller chỉ thấy bản ghi gốc. Mảnh sai CRC được trả nguyên cho caller
+// (để cách ly như mọi bản ghi hỏng) và frame đang ráp bị bỏ.
+//
+// Nhiều writer/reader trên một vòng đệm: writer giữ shm->frame_tx khi đẩy các mảnh
+// của một frame (mảnh của hai frame không xen nhau), reader giữ shm->frame_rx từ
+// mảnh FIRST tới mảnh LAST (một frame không bị hai reader chia nhau). Bản ghi
+// thường của writer không -z vẫn có thể nằm giữa các mảnh; chúng được trả ngay.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "shared.h"
+#include "crc32c.h"
+#include "seqtrack.h"
+#include "stream.h"
+
+#define LZF_RAW_MAX 16384                 // thân chưa nén tối đa của một frame
+#define LZF_REC_HDR 8                     // u16 len, u16 flags, u32 src
+#define LZF_MAX_RECS 1024
+#define LZF_FRAG (MSG_MAX - 1)            // byte mỗi mảnh
+#define LZ_HASH_BITS 12
+
+enum { LZF_STORED = 0, LZF_LZ = 1 };
+
+typedef struct {
+    uint8_t method;   // LZF_*
+    uint8_t pad;
+    uint16_t nrec;
+    uint32_t raw_len; // độ dài thân sau giải nén
+} LzfHeader;
+
+static inline size_t lz_bound(size_t n) { return n + n / 255 + 16; }
+
+#define LZF_WIRE_MAX (sizeof(LzfHeader) + LZF_RAW_MAX + LZF_RAW_MAX / 255 + 16)
+
+// Thống kê kích thước/CPU (mỗi bên tự giữ, in ra khi kết thúc)
+typedef struct {
+    uint64_t frames, records;
+    uint64_t raw_bytes, wire_bytes; // trước/sau nén, gồm cả header
+    uint64_t ns;                    // thời gian nén hoặc giải nén
+    uint64_t dropped;               // frame bỏ (thiếu mảnh, hỏng)
+} LzStats;
+
+static inline uint64_t lz_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void lz_report(const char* who, const char* what, const LzStats* st) {
+    if (st->frames == 0 && st->dropped == 0) return;
+    double mb = st->raw_bytes / 1e6;
+    char extra[48] = "";
+    if (st->dropped) snprintf(extra, sizeof(extra), ", %llu dropped", (unsigned long long)st->dropped);
+    fprintf(stderr, "[%s] lz: %llu frame(s), %llu record(s), %llu -> %llu byte(s) (%.1f%%), %s %.2f ms (%.0f MB/s)%s\n",
+            who, (unsigned long long)st->frames, (unsigned long long)st->records,
+            (unsigned long long)st->raw_bytes, (unsigned long long)st->wire_bytes,
+            st->raw_bytes ? 100.0 * (double)st->wire_bytes / (double)st->raw_bytes : 0.0,
+            what, st->ns / 1e6, st->ns ? mb / (st->ns / 1e9) : 0.0, extra);
+}
+
+// ---- LZ77 (block LZ4) ----
+
+static inline uint32_t lz_read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint8_t* lz_put_len(uint8_t* op, size_t n) {
+    for (; n >= 255; n -= 255) *op++ = 255;
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+static inline uint8_t* lz_put_literals(uint8_t* op, uint8_t* tok, const uint8_t* lit, size_t n) {
+    *tok = (uint8_t)((n >= 15 ? 15 : n) << 4);
+    if (n >= 15) op = lz_put_len(op, n - 15);
+    memcpy(op, lit, n);
+    return op + n;
+}
+
+// dst phải có ít nhất lz_bound(n) byte. Trả về độ dài đã nén.
+// Như LZ4: 5 byte cuối luôn là literal, khớp không bắt đầu trong 12 byte cuối.
+static inline size_t lz_compress(const uint8_t* src, size_t n, uint8_t* dst) {
+    uint32_t table[1u << LZ_HASH_BITS]; // vị trí + 1 (0 = trống)
+    memset(table, 0, sizeof(table));
+    uint8_t* op = dst;
+    size_t ip = 0, anchor = 0;
+    if (n >= 13) {
+        size_t limit = n - 12, match_limit = n - 5;
+        unsigned miss = 0;
+        while (ip < limit) {
+            uint32_t seq = lz_read32(src + ip);
+            uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip + 1;
+            if (!ref || ip - (ref - 1) > 65535 || lz_read32(src + ref - 1) != seq) {
+                ip += 1 + (miss++ >> 5); // dữ liệu khó nén: bước dài dần
+                continue;
+            }
+            ref--;
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) { ip--; ref--; }
+            size_t ml = 4;
+            while (ip + ml < match_limit && src[ip + ml] == src[ref + ml]) ml++;
+
+            uint8_t* tok = op++;
+            op = lz_put_literals(op, tok, src + anchor, ip - anchor);
+            size_t off = ip - ref;
+            *op++ = (uint8_t)off;
+            *op++ = (uint8_t)(off >> 8);
+            size_t m = ml - 4;
+            *tok |= (uint8_t)(m >= 15 ? 15 : m);
+            if (m >= 15) op = lz_put_len(op, m - 15);
+            ip += ml;
+            anchor = ip;
+            miss = 0;
+        }
+    }
+    uint8_t* tok = op++;
+    op = lz_put_literals(op, tok, src + anchor, n - anchor);
+    return (size_t)(op - dst);
+}
+
+static inline int lz_get_len(const uint8_t* src, size_t n, size_t* ip, size_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= n) return -1;
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+// Giải nén có kiểm tra biên. Trả về độ dài kết quả, -1 nếu dữ liệu hỏng.
+static inline long lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        unsigned tok = src[ip++];
+        size_t lit = tok >> 4;
+        if (lit == 15 && lz_get_len(src, n, &ip, &lit) == -1) return -1;
+        if (lit > n - ip || lit > cap - op) return -1;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n) break; // chuỗi cuối chỉ có literal
+        if (n - ip < 2) return -1;
+        size_t off = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (off == 0 || off > op) return -1;
+        size_t ml = tok & 15u;
+        if (ml == 15 && lz_get_len(src, n, &ip, &ml) == -1) return -1;
+        ml += 4;
+        if (ml > cap - op) return -1;
+        const uint8_t* m = dst + op - off;
+        if (off >= ml) {
+            memcpy(dst + op, m, ml);
+        } else {
+            for (size_t k = 0; k < ml; ++k) dst[op + k] = m[k]; // chồng lấn: lặp mẫu
+        }
+        op += ml;
+    }
+    return (long)op;
+}
+
+// ---- Phía ghi: gom bản ghi thành frame ----
+
+typedef struct {
+    unsigned max_recs;
+    unsigned nrec;
+    size_t used;
+    uint8_t raw[LZF_RAW_MAX];
+    uint8_t wire[LZF_WIRE_MAX];
+    LzStats st;
+} FrameBuf;
+
+static inline void frame_buf_init(FrameBuf* fb, unsigned max_recs) {
+    memset(&fb->st, 0, sizeof(fb->st));
+    fb->max_recs = max_recs < 1 ? 1 : max_recs > LZF_MAX_RECS ? LZF_MAX_RECS : max_recs;
+    fb->nrec = 0;
+    fb->used = 0;
+}
+
+// Thêm một bản ghi. Trả về 1 nếu frame đã đầy và cần frame_build() ngay.
+static inline int frame_add(FrameBuf* fb, const RecMeta* meta, const char* msg) {
+    uint16_t len = (uint16_t)(meta->len < MSG_MAX ? meta->len : MSG_MAX - 1);
+    uint16_t flags = (uint16_t)(meta->flags & ~REC_F_CRC);
+    uint8_t* p = fb->raw + fb->used;
+    memcpy(p, &len, 2);
+    memcpy(p + 2, &flags, 2);
+    memcpy(p + 4, &meta->src, 4);
+    memcpy(p + LZF_REC_HDR, msg, len);
+    fb->used += LZF_REC_HDR + len;
+    fb->nrec++;
+    return fb->nrec >= fb->max_recs || fb->used + LZF_REC_HDR + MSG_MAX > LZF_RAW_MAX;
+}
+
+// Nén các bản ghi đã gom vào fb->wire, trả về độ dài frame (0 nếu không có gì).
+static inline size_t frame_build(FrameBuf* fb) {
+    if (fb->nrec == 0) return 0;
+    uint64_t t0 = lz_clock_ns();
+    LzfHeader h = { LZF_LZ, 0, (uint16_t)fb->nrec, (uint32_t)fb->used };
+    size_t body = lz_compress(fb->raw, fb->used, fb->wire + sizeof(h));
+    if (body >= fb->used) {
+        h.method = LZF_STORED;
+        memcpy(fb->wire + sizeof(h), fb->raw, fb->used);
+        body = fb->used;
+    }
+    memcpy(fb->wire, &h, sizeof(h));
+    fb->st.ns += lz_clock_ns() - t0;
+    fb->st.frames++;
+    fb->st.records += fb->nrec;
+    fb->st.raw_bytes += sizeof(h) + fb->used;
+    fb->st.wire_bytes += sizeof(h) + body;
+    fb->nrec = 0;
+    fb->used = 0;
+    return sizeof(h) + body;
+}
+
+#define LZF_LOCK_POLL_MS 100
+
+// Lấy FrameLock. Chờ theo từng LZF_LOCK_POLL_MS để lấy lại khóa của process đã
+// chết. Trả về 0 khi giữ khóa, 1 nếu nonblock và khóa đang bận, -1 nếu bị tín
+// hiệu ngắt (EINTR) hoặc *stop khác 0 (ECANCELED).
+static inline int frame_lock(FrameLock* fl, int nonblock, const volatile sig_atomic_t* stop) {
+    int me = getpid();
+    for (;;) {
+        int rc;
+        if (nonblock) {
+            rc = sem_trywait(&fl->sem);
+        } else {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += LZF_LOCK_POLL_MS * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+            rc = sem_timedwait(&fl->sem, &ts);
+        }
+        if (rc == 0) break;
+        if (errno != EAGAIN && errno != ETIMEDOUT) return -1;
+        // Chủ khóa chết khi đang giữ: token của nó mất theo, chuyển quyền sở hữu sang mình
+        int owner = __atomic_load_n(&fl->owner, __ATOMIC_ACQUIRE);
+        if (owner && owner != me && !stream_pid_alive(owner) &&
+            __atomic_compare_exchange_n(&fl->owner, &owner, me, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return 0;
+        if (nonblock) return 1;
+        if (stop && *stop) { errno = ECANCELED; return -1; }
+    }
+    __atomic_store_n(&fl->owner, me, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static inline void frame_unlock(FrameLock* fl) {
+    __atomic_store_n(&fl->owner, 0, __ATOMIC_RELEASE);
+    sem_post(&fl->sem);
+}
+
+// ---- Phía đọc: ráp mảnh, giải nén, trả từng bản ghi ----
+
+typedef struct {
+    int active;        // đang ráp một frame (đã thấy mảnh FIRST)
+    size_t wire_len;
+    unsigned left;     // số bản ghi chưa trả trong raw
+    size_t pos, raw_len;
+    uint8_t wire[LZF_WIRE_MAX];
+    uint8_t raw[LZF_RAW_MAX];
+    LzStats st;
+    SeqTrack* seq;     // không NULL: kiểm tra seq từng ô trước khi ráp (seqtrack.h)
+    int rx_locked;     // đang giữ shm->frame_rx (ring_pop_frames)
+} FrameAsm;
+
+static inline void frame_asm_init(FrameAsm* fa) {
+    fa->active = 0;
+    fa->wire_len = 0;
+    fa->left = 0;
+    memset(&fa->st, 0, sizeof(fa->st));
+    fa->seq = NULL;
+    fa->rx_locked = 0;
+}
+
+static inline void frame_asm_drop(FrameAsm* fa) {
+    if (fa->active) fa->st.dropped++;
+    fa->active = 0;
+    fa->wire_len = 0;
+}
+
+static inline int frame_decode(FrameAsm* fa) {
+    LzfHeader h;
+    if (fa->wire_len < sizeof(h)) return -1;
+    memcpy(&h, fa->wire, sizeof(h));
+    const uint8_t* body = fa->wire + sizeof(h);
+    size_t n = fa->wire_len - sizeof(h);
+    if (h.raw_len > LZF_RAW_MAX) return -1;
+    uint64_t t0 = lz_clock_ns();
+    if (h.method == LZF_STORED) {
+        if (n != h.raw_len) return -1;
+        memcpy(fa->raw, body, n);
+    } else if (h.method != LZF_LZ || lz_decompress(body, n, fa->raw, LZF_RAW_MAX) != (long)h.raw_len) {
+        return -1;
+    }
+    fa->st.ns += lz_clock_ns() - t0;
+    fa->st.frames++;
+    fa->st.records += h.nrec;
+    fa->st.raw_bytes += sizeof(h) + h.raw_len;
+    fa->st.wire_bytes += fa->wire_len;
+    fa->raw_len = h.raw_len;
+    fa->pos = 0;
+    fa->left = h.nrec;
+    return 0;
+}
+
+// Nhận một mảnh. Trả về 1 nếu vừa giải nén xong một frame, 0 nếu cần thêm mảnh.
+static inline int frame_feed(FrameAsm* fa, const RecMeta* meta, const char* data) {
+    if (meta->flags & REC_F_FRAME_FIRST) {
+        frame_asm_drop(fa); // frame trước thiếu mảnh cuối
+        fa->active = 1;
+    } else if (!fa->active) {
+        return 0; // bắt đầu đọc giữa frame (vd. phát lại từ offset lẻ): bỏ qua
+    }
+    if (meta->len > LZF_WIRE_MAX - fa->wire_len) { frame_asm_drop(fa); return 0; }
+    memcpy(fa->wire + fa->wire_len, data, meta->len);
+    fa->wire_len += meta->len;
+    if (!(meta->flags & REC_F_FRAME_LAST)) return 0;
+    int ok = frame_decode(fa) == 0;
+    if (!ok) fa->st.dropped++;
+    fa->active = 0;
+    fa->wire_len = 0;
+    return ok;
+}
+
+// Lấy bản ghi kế tiếp của frame đã giải nén vào meta/msg[MSG_MAX]. 0 nếu hết.
+static inline int frame_next(FrameAsm* fa, RecMeta* meta, char* msg) {
+    while (fa->left > 0) {
+        fa->left--;
+        uint16_t len, flags;
+        uint32_t src;
+        if (fa->raw_len - fa->pos < LZF_REC_HDR) break;
+        memcpy(&len, fa->raw + fa->pos, 2);
+        memcpy(&flags, fa->raw + fa->pos + 2, 2);
+        memcpy(&src, fa->raw + fa->pos + 4, 4);
+        fa->pos += LZF_REC_HDR;
+        if (len >= MSG_MAX || len > fa->raw_len - fa->pos) break;
+        memset(meta, 0, sizeof(*meta));
+        meta->len = len;
+        meta->flags = flags;
+        meta->src = src;
+        memcpy(msg, fa->raw + fa->pos, len);
+        msg[len] = '\0';
+        fa->pos += len;
+        return 1;
+    }
+    fa->left = 0;
+    return 0;
+}
+
+// Nhả shm->frame_rx nếu không còn frame đang ráp dở.
+static inline void frame_rx_settle(Shared* shm, FrameAsm* fa) {
+    if (fa->rx_locked && !fa->active) {
+        fa->rx_locked = 0;
+        frame_unlock(&shm->frame_rx);
+    }
+}
+
+// ring_pop() có giải frame: cùng giá trị trả về. fa == NULL: như ring_pop().
+// Seq được kiểm tra trên từng ô (writer đánh số ô, kể cả mảnh frame); ô lặp bị
+// bỏ ở đây khi fa->seq->dedup, nên frame gửi lại không bị ráp hai lần.
+// Mỗi lần lấy ô đều giữ shm->frame_rx; khóa được giữ qua các lần gọi khi frame
+// đang ráp dở. Reader khác đang giữ thì nonblock trả về 1 như vòng đệm rỗng.
+// stop: như ring_pop_stop, cho cả lúc chờ khóa lẫn lúc chờ bản ghi.
+static inline int ring_pop_frames_stop(Shared* shm, FrameAsm* fa, RecMeta* meta, char* msg, int nonblock,
+                                       const volatile sig_atomic_t* stop) {
+    if (!fa) return ring_pop_stop(shm, meta, msg, nonblock, stop);
+    if (frame_next(fa, meta, msg)) return 0;
+    for (;;) {
+        if (!fa->rx_locked) {
+            int lr = frame_lock(&shm->frame_rx, nonblock, stop);
+            if (lr != 0) return lr;
+            fa->rx_locked = 1;
+        }
+        int rc = ring_pop_stop(shm, meta, msg, nonblock, stop);
+        if (rc == RING_EOS) frame_asm_drop(fa); // luồng hết: mảnh còn lại sẽ không tới
+        if (rc != 0) {
+            frame_rx_settle(shm, fa);
+            return rc;
+        }
+        if (fa->seq && seq_check(fa->seq, shm, meta)) {
+            frame_rx_settle(shm, fa);
+            continue;
+        }
+        if (!(meta->flags & REC_F_FRAME)) {
+            frame_rx_settle(shm, fa);
+            return 0;
+        }
+        if ((meta->flags & REC_F_CRC) && crc32c(msg, meta->len) != meta->crc) {
+            frame_asm_drop(fa);
+            frame_rx_settle(shm, fa);
+            return 0; // caller kiểm tra lại CRC và cách ly mảnh này
+        }
+        int done = frame_feed(fa, meta, msg);
+        frame_rx_settle(shm, fa);
+        if (done && frame_next(fa, meta, msg)) return 0;
+    }
+}
+
+static inline int ring_pop_frames(Shared* shm, FrameAsm* fa, RecMeta* meta, char* msg, int nonblock) {
+    return ring_pop_frames_stop(shm, fa, meta, msg, nonblock, NULL);
+}
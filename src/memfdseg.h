@@ -0,0 +1,121 @@
+#pragma once
+// memfdseg.h — vòng đệm ẩn danh do shm_broker cấp (tên dạng "@tên").
+//
+// Broker tạo segment bằng memfd_create, khởi tạo Shared, niêm phong kích thước
+// (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) rồi gửi fd qua SCM_RIGHTS trên UNIX
+// socket trừu tượng "\0shm_broker:<broker>". Không có tên trong /dev/shm nên
+// không đụng tên giữa các tenant (broker còn tách theo uid của người gọi) và
+// không cần cleanup: client giữ kết nối tới broker suốt thời gian gắn, broker
+// nhả memfd khi kết nối cuối cùng đóng, kernel giải phóng khi mmap cuối cùng mất.
+// Consumer cũng không phải chờ vòng đệm xuất hiện: ai hỏi trước thì broker tạo.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "shared.h"
+
+#define MB_PREFIX "shm_broker:"
+#define MB_DEFAULT "default"   // tên broker khi không đặt biến môi trường SHM_BROKER
+#define MB_MAGIC 0x4d424b31u   // "MBK1"
+#define MB_NAME_MAX 64
+#define MB_SEALS (F_SEAL_SHRINK | F_SEAL_GROW)
+
+// Vai trò trong yêu cầu: producer/consumer giữ một tham chiếu tới vòng đệm,
+// observer (shmstat) chỉ xem vòng đệm đã có và không giữ nó sống.
+enum { MB_ROLE_PRODUCER = 0, MB_ROLE_CONSUMER = 1, MB_ROLE_OBSERVER = 2 };
+
+// Trả lời của broker: một byte, kèm fd nếu thành công
+enum { MB_REPLY_ATTACHED = 'A', MB_REPLY_CREATED = 'C', MB_REPLY_NOENT = 'N', MB_REPLY_FAIL = 'F' };
+
+typedef struct {
+    uint32_t magic;
+    uint32_t role;
+    uint64_t base_offset; // offset bản ghi đầu tiên nếu broker phải tạo vòng đệm mới
+    char name[MB_NAME_MAX];
+} MbRequest;
+
+static inline const char* mb_broker_name(void) {
+    const char* b = getenv("SHM_BROKER");
+    return b && *b ? b : MB_DEFAULT;
+}
+
+static inline socklen_t mb_addr(struct sockaddr_un* addr, const char* broker) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    int n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, MB_PREFIX "%s", broker);
+    if (n < 0) n = 0;
+    if ((size_t)n > sizeof(addr->sun_path) - 2) n = (int)sizeof(addr->sun_path) - 2;
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + (size_t)n);
+}
+
+// Nhận byte trả lời và fd đi kèm (nếu có). Trả về byte trả lời, -1 nếu lỗi.
+static inline int mb_recv_reply(int sock, int* fd) {
+    char code;
+    struct iovec iov = { &code, 1 };
+    union { char buf[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } u;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    *fd = -1;
+    ssize_t n;
+    do n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC); while (n < 0 && errno == EINTR);
+    if (n != 1) { if (n == 0) errno = ECONNRESET; return -1; }
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) memcpy(fd, CMSG_DATA(c), sizeof(int));
+    return (unsigned char)code;
+}
+
+// Xin broker vòng đệm name (không có '@'). Thành công: trả về memfd, *conn là
+// kết nối phải giữ mở suốt thời gian dùng vòng đệm (-1 với observer), *created = 1
+// nếu broker vừa tạo vòng đệm cho yêu cầu này. Lỗi: -1 (đã in thông báo).
+static inline int mb_request(const char* name, int role, uint64_t base_offset, int* conn, int* created) {
+    *conn = -1;
+    if (strlen(name) >= MB_NAME_MAX || !name[0]) {
+        fprintf(stderr, "Broker ring name must be 1..%d characters: '%s'\n", MB_NAME_MAX - 1, name);
+        return -1;
+    }
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0) { perror("socket"); return -1; }
+    struct sockaddr_un addr;
+    socklen_t alen = mb_addr(&addr, mb_broker_name());
+    if (connect(s, (struct sockaddr*)&addr, alen) == -1) {
+        fprintf(stderr, "Cannot reach shm_broker '%s': %s\n", mb_broker_name(), strerror(errno));
+        close(s);
+        return -1;
+    }
+    MbRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = MB_MAGIC;
+    req.role = (uint32_t)role;
+    req.base_offset = base_offset;
+    strcpy(req.name, name);
+    int fd = -1;
+    int code = send(s, &req, sizeof(req), MSG_NOSIGNAL) == (ssize_t)sizeof(req) ? mb_recv_reply(s, &fd) : -1;
+    if (code == -1) { perror("shm_broker request"); close(s); return -1; }
+    if (fd < 0) {
+        fprintf(stderr, code == MB_REPLY_NOENT ? "Broker has no ring '@%s'\n"
+                                               : "shm_broker refused ring '@%s'\n", name);
+        close(s);
+        return -1;
+    }
+    // Kích thước phải bị niêm phong, nếu không ai đó ftruncate nhỏ lại là mọi bên gắn bị SIGBUS
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals == -1 || (seals & MB_SEALS) != MB_SEALS) {
+        fprintf(stderr, "Ring '@%s' from broker is not sealed\n", name);
+        close(fd);
+        close(s);
+        return -1;
+    }
+    if (created) *created = code == MB_REPLY_CREATED;
+    if (role == MB_ROLE_OBSERVER) close(s);
+    else *conn = s;
+    return fd;
+}
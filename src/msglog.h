@@ -0,0 +1,314 @@
+#pragma once
+// msglog.h — log append-only chia segment cho các bản ghi đã đi qua vòng đệm.
+//
+// Thư mục log gồm các cặp file đặt tên theo offset đầu tiên của segment:
+//   00000000000000000000.log  bản ghi: LogRec + payload, căn 8 byte
+//   00000000000000000000.idx  chỉ mục thưa: LogIdx mỗi LOG_INDEX_EVERY byte
+// Offset của bản ghi trong log = offset của nó trong vòng đệm (Shared.in), nên
+// reader có thể phát lại lịch sử rồi chuyển sang vòng đệm mà không hở/trùng.
+//
+// Writer cấp phát trước cả segment (ftruncate) rồi memcpy qua mmap: không có
+// syscall cho mỗi bản ghi, và reader thấy bản ghi ngay qua page cache. Trường
+// ts_ns được ghi sau cùng (release), ts_ns == 0 nghĩa là hết dữ liệu.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#define LOG_SEG_BYTES_DEFAULT (64u << 20) // 64 MiB mỗi segment
+#define LOG_INDEX_EVERY 4096              // một mục chỉ mục mỗi 4 KiB dữ liệu
+#define LOG_LEN_MASK 0x00ffffffu          // 8 bit cao của LogRec.len: RecMeta.flags & 0xff
+#define LOG_FLAGS_SHIFT 24
+
+typedef struct {
+    uint64_t offset; // offset trong vòng đệm
+    uint64_t ts_ns;  // CLOCK_REALTIME lúc ghi, ghi sau cùng (0 = chưa có bản ghi)
+    uint32_t len;    // độ dài payload (LOG_LEN_MASK) | cờ bản ghi << LOG_FLAGS_SHIFT
+    uint32_t crc;    // CRC32C của payload (0 nếu writer không bật -c)
+} LogRec;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t ts_ns;
+    uint64_t pos;    // vị trí byte của bản ghi trong file .log
+} LogIdx;
+
+typedef struct {
+    char dir[512];
+    size_t seg_bytes;
+    int fd, idx_fd;
+    char* map;
+    size_t pos;          // vị trí ghi tiếp theo trong segment hiện tại
+    size_t next_idx_pos; // ghi mục chỉ mục kế tiếp khi pos vượt qua
+    uint64_t next;       // offset dự kiến của bản ghi kế tiếp
+} MsgLog;
+
+static inline uint64_t mlog_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline size_t mlog_rec_size(uint32_t len) {
+    return (sizeof(LogRec) + (len & LOG_LEN_MASK) + 7u) & ~(size_t)7u;
+}
+
+static inline void mlog_path(char* out, size_t n, const char* dir, uint64_t base, const char* ext) {
+    snprintf(out, n, "%s/%020llu.%s", dir, (unsigned long long)base, ext);
+}
+
+static inline int mlog_cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Liệt kê offset gốc của các segment, tăng dần. Trả về số segment (caller free *out).
+static inline int mlog_list(const char* dir, uint64_t** out) {
+    *out = NULL;
+    DIR* d = opendir(dir);
+    if (!d) return -1;
+    int n = 0, cap = 0;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        size_t l = strlen(e->d_name);
+        if (l != 24 || strcmp(e->d_name + 20, ".log") != 0) continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            uint64_t* p = (uint64_t*)realloc(*out, (size_t)cap * sizeof(uint64_t));
+            if (!p) { closedir(d); return -1; }
+            *out = p;
+        }
+        (*out)[n++] = strtoull(e->d_name, NULL, 10);
+    }
+    closedir(d);
+    if (n > 1) qsort(*out, (size_t)n, sizeof(uint64_t), mlog_cmp_u64);
+    return n;
+}
+
+static inline int mlog_add_index(MsgLog* lg, uint64_t offset, uint64_t ts) {
+    LogIdx ix = { offset, ts, lg->pos };
+    if (write(lg->idx_fd, &ix, sizeof(ix)) != (ssize_t)sizeof(ix)) { perror("write log index"); return -1; }
+    lg->next_idx_pos = lg->pos + LOG_INDEX_EVERY;
+    return 0;
+}
+
+// Đóng segment hiện tại, cắt phần cấp phát trước còn thừa.
+static inline void mlog_seal(MsgLog* lg) {
+    if (lg->map) munmap(lg->map, lg->seg_bytes);
+    if (lg->fd >= 0) {
+        if (ftruncate(lg->fd, (off_t)lg->pos) == -1) perror("ftruncate log");
+        close(lg->fd);
+    }
+    if (lg->idx_fd >= 0) close(lg->idx_fd);
+    lg->map = NULL;
+    lg->fd = lg->idx_fd = -1;
+}
+
+static inline int mlog_map_segment(MsgLog* lg, uint64_t base, int create) {
+    char path[600];
+    mlog_path(path, sizeof(path), lg->dir, base, "log");
+    lg->fd = open(path, O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (lg->fd < 0) { perror("open log segment"); return -1; }
+    if (ftruncate(lg->fd, (off_t)lg->seg_bytes) == -1) { perror("ftruncate log"); return -1; }
+    lg->map = (char*)mmap(NULL, lg->seg_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, lg->fd, 0);
+    if (lg->map == MAP_FAILED) { lg->map = NULL; perror("mmap log"); return -1; }
+    mlog_path(path, sizeof(path), lg->dir, base, "idx");
+    lg->idx_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (lg->idx_fd < 0) { perror("open log index"); return -1; }
+    return 0;
+}
+
+// Mở thư mục log để ghi. Nếu segment cuối còn đang mở (chưa bị cắt), ghi tiếp
+// sau bản ghi cuối cùng; ngược lại segment mới được tạo ở lần append đầu tiên.
+static inline int mlog_open_writer(MsgLog* lg, const char* dir, size_t seg_bytes) {
+    memset(lg, 0, sizeof(*lg));
+    lg->fd = lg->idx_fd = -1;
+    lg->seg_bytes = seg_bytes ? seg_bytes : LOG_SEG_BYTES_DEFAULT;
+    snprintf(lg->dir, sizeof(lg->dir), "%s", dir);
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) { perror("mkdir log dir"); return -1; }
+
+    uint64_t* bases;
+    int n = mlog_list(dir, &bases);
+    if (n < 0) { perror("opendir log dir"); return -1; }
+    if (n == 0) { free(bases); return 0; }
+
+    uint64_t last = bases[n - 1];
+    free(bases);
+    char path[600];
+    mlog_path(path, sizeof(path), dir, last, "log");
+    struct stat st;
+    if (stat(path, &st) == -1) { perror("stat log segment"); return -1; }
+
+    // Quét segment cuối để tìm offset kế tiếp (và vị trí ghi nếu còn mở).
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror("open log segment"); return -1; }
+    size_t size = (size_t)st.st_size, pos = 0;
+    lg->next = last;
+    if (size > 0) {
+        const char* m = (const char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED) { perror("mmap log"); close(fd); return -1; }
+        while (pos + sizeof(LogRec) <= size) {
+            const LogRec* r = (const LogRec*)(m + pos);
+            if (r->ts_ns == 0 || pos + mlog_rec_size(r->len) > size) break;
+            lg->next = r->offset + 1;
+            pos += mlog_rec_size(r->len);
+        }
+        munmap((void*)m, size);
+    }
+    close(fd);
+
+    if (size == lg->seg_bytes && pos < size) {
+        if (mlog_map_segment(lg, last, 0) == -1) return -1;
+        lg->pos = pos;
+        lg->next_idx_pos = pos; // ghi một mục chỉ mục ngay ở bản ghi kế tiếp
+    }
+    return 0;
+}
+
+// Thêm một bản ghi với offset cho trước (tăng dần, được phép nhảy cóc).
+// flags: RecMeta.flags, giữ lại để phát lại được mảnh frame nén (lzframe.h).
+static inline int mlog_append(MsgLog* lg, uint64_t offset, const char* data, uint32_t len, uint32_t crc, uint32_t flags) {
+    size_t need = mlog_rec_size(len);
+    if (need > lg->seg_bytes) { errno = EMSGSIZE; return -1; }
+    if (lg->map && lg->pos + need > lg->seg_bytes) mlog_seal(lg);
+    if (!lg->map) {
+        if (mlog_map_segment(lg, offset, 1) == -1) return -1;
+        lg->pos = 0;
+        lg->next_idx_pos = 0;
+    }
+
+    uint64_t ts = mlog_now_ns();
+    if (lg->pos >= lg->next_idx_pos && mlog_add_index(lg, offset, ts) == -1) return -1;
+
+    LogRec* r = (LogRec*)(lg->map + lg->pos);
+    r->offset = offset;
+    r->len = len | (flags & 0xffu) << LOG_FLAGS_SHIFT;
+    r->crc = crc;
+    memcpy(r + 1, data, len);
+    __atomic_store_n(&r->ts_ns, ts, __ATOMIC_RELEASE);
+    lg->pos += need;
+    lg->next = offset + 1;
+    return 0;
+}
+
+static inline void mlog_close(MsgLog* lg) {
+    // Segment đang mở giữ nguyên kích thước cấp phát trước để lần sau ghi tiếp.
+    if (lg->map) munmap(lg->map, lg->seg_bytes);
+    if (lg->fd >= 0) close(lg->fd);
+    if (lg->idx_fd >= 0) close(lg->idx_fd);
+    lg->map = NULL;
+    lg->fd = lg->idx_fd = -1;
+}
+
+// ---- Phát lại ----
+
+typedef int (*mlog_cb)(void* ctx, uint64_t offset, uint64_t ts_ns, const char* data, uint32_t len, uint32_t flags);
+
+// Đọc chỉ mục của segment; trả về số mục (caller free *out).
+static inline long mlog_load_index(const char* dir, uint64_t base, LogIdx** out) {
+    *out = NULL;
+    char path[600];
+    mlog_path(path, sizeof(path), dir, base, "idx");
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) == -1) { close(fd); return 0; }
+    long n = (long)(st.st_size / (off_t)sizeof(LogIdx));
+    if (n > 0) {
+        *out = (LogIdx*)malloc((size_t)n * sizeof(LogIdx));
+        if (!*out || pread(fd, *out, (size_t)n * sizeof(LogIdx), 0) != (ssize_t)((size_t)n * sizeof(LogIdx))) {
+            free(*out); *out = NULL; n = 0;
+        }
+    }
+    close(fd);
+    return n;
+}
+
+// Vị trí bắt đầu quét trong segment: mục chỉ mục cuối cùng còn <= điểm cần tìm.
+static inline uint64_t mlog_seek(const LogIdx* ix, long n, uint64_t from_off, uint64_t from_ts, int by_time) {
+    long lo = 0, hi = n - 1, best = -1;
+    while (lo <= hi) {
+        long mid = (lo + hi) / 2;
+        int le = by_time ? ix[mid].ts_ns <= from_ts : ix[mid].offset <= from_off;
+        if (le) { best = mid; lo = mid + 1; } else hi = mid - 1;
+    }
+    return best < 0 ? 0 : ix[best].pos;
+}
+
+// Phát lại các bản ghi có offset trong [from, end_off) (by_time: ts >= from_ts).
+// Segment được mmap với MADV_SEQUENTIAL|MADV_WILLNEED để đọc trước ở tốc độ đĩa.
+// Trả về số bản ghi đã phát lại, -1 nếu lỗi, hoặc giá trị âm khác do cb trả về.
+static inline long mlog_replay(const char* dir, uint64_t from_off, uint64_t from_ts, int by_time,
+                               uint64_t end_off, mlog_cb cb, void* ctx) {
+    uint64_t* bases;
+    int n = mlog_list(dir, &bases);
+    if (n < 0) { perror("opendir log dir"); return -1; }
+
+    // Segment đầu tiên cần đọc
+    int first = 0;
+    for (int i = 0; i < n; ++i) {
+        if (by_time) {
+            LogIdx* ix;
+            long m = mlog_load_index(dir, bases[i], &ix);
+            int before = m > 0 && ix[0].ts_ns <= from_ts;
+            free(ix);
+            if (before) first = i; else break;
+        } else if (bases[i] <= from_off) {
+            first = i;
+        } else {
+            break;
+        }
+    }
+
+    long count = 0;
+    for (int i = first; i < n; ++i) {
+        if (bases[i] >= end_off) break;
+        char path[600];
+        mlog_path(path, sizeof(path), dir, bases[i], "log");
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) { perror("open log segment"); free(bases); return -1; }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size == 0) { close(fd); continue; }
+        size_t size = (size_t)st.st_size;
+        const char* m = (const char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (m == MAP_FAILED) { perror("mmap log"); free(bases); return -1; }
+        madvise((void*)m, size, MADV_SEQUENTIAL);
+        madvise((void*)m, size, MADV_WILLNEED);
+
+        size_t pos = 0;
+        if (i == first) {
+            LogIdx* ix;
+            long k = mlog_load_index(dir, bases[i], &ix);
+            pos = (size_t)mlog_seek(ix, k, from_off, from_ts, by_time);
+            free(ix);
+        }
+
+        int done = 0;
+        while (pos + sizeof(LogRec) <= size) {
+            const LogRec* r = (const LogRec*)(m + pos);
+            uint64_t ts = __atomic_load_n(&r->ts_ns, __ATOMIC_ACQUIRE);
+            uint32_t len = r->len & LOG_LEN_MASK;
+            if (ts == 0 || pos + mlog_rec_size(len) > size) break;
+            if (r->offset >= end_off) { done = 1; break; }
+            int take = by_time ? ts >= from_ts : r->offset >= from_off;
+            if (take) {
+                int rc = cb(ctx, r->offset, ts, (const char*)(r + 1), len, r->len >> LOG_FLAGS_SHIFT);
+                if (rc < 0) { munmap((void*)m, size); free(bases); return rc; }
+                ++count;
+            }
+            pos += mlog_rec_size(len);
+        }
+        munmap((void*)m, size);
+        if (done) break;
+    }
+    free(bases);
+    return count;
+}
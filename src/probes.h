@@ -0,0 +1,66 @@
+#pragma once
+// probes.h — điểm USDT trên đường nóng của vòng đệm (provider "shmring"):
+//   publish(offset, len, lane)  bản ghi vừa vào vòng đệm (lane 0: làn thường)
+//   consume(offset, len, lane)  bản ghi vừa được lấy ra
+//   block(sem, shm)             sắp ngủ trong sem_wait (sem: SHM_SEM_*)
+//   wake(sem, shm)              vừa thức dậy từ sem_wait đó
+// Mặc định biên dịch thành rỗng, kể cả sem_trywait để phân biệt block: đường nóng
+// giống hệt bản không có probe. make USDT=1 (-DSHM_USDT) để bật; khi bật, mỗi probe
+// là một lệnh nop cho tới khi perf/bpftrace gắn vào. Xem ringwait.bt.
+#include <semaphore.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+enum { SHM_SEM_EMPTY = 0, SHM_SEM_FULL = 1, SHM_SEM_MUTEX = 2, SHM_SEM_LANE = 3 };
+
+#ifdef SHM_USDT
+#if defined(__has_include) && !__has_include(<sys/sdt.h>)
+#error "SHM_USDT needs <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel)"
+#endif
+#include <sys/sdt.h>
+#define SHM_PROBE(name, ...) STAP_PROBEV(shmring, name, __VA_ARGS__)
+#else
+#define SHM_PROBE(name, ...) ((void)0)
+#endif
+
+// sem_wait có probe block/wake khi phải ngủ; không bật USDT thì chỉ là sem_wait.
+static inline int shm_sem_wait(sem_t* s, int which, const void* shm) {
+#ifdef SHM_USDT
+    if (sem_trywait(s) == 0) return 0;
+    if (errno != EAGAIN) return -1;
+    SHM_PROBE(block, which, shm);
+    int rc = sem_wait(s);
+    SHM_PROBE(wake, which, shm);
+    return rc;
+#else
+    (void)which;
+    (void)shm;
+    return sem_wait(s);
+#endif
+}
+
+#define SHM_STOP_POLL_MS 100
+
+// Như shm_sem_wait, nhưng khi phải chờ thì cứ SHM_STOP_POLL_MS lại xem *stop:
+// khác 0 thì bỏ cuộc, trả về -1 với errno = ECANCELED. Còn token thì vẫn lấy
+// được dù đang dừng (dữ liệu còn chỗ thì không bị bỏ). stop == NULL: shm_sem_wait.
+static inline int shm_sem_wait_stop(sem_t* s, int which, const void* shm, const volatile sig_atomic_t* stop) {
+    if (!stop) return shm_sem_wait(s, which, shm);
+    (void)which;
+    (void)shm;
+    if (sem_trywait(s) == 0) return 0;
+    if (errno != EAGAIN) return -1;
+    SHM_PROBE(block, which, shm);
+    for (;;) {
+        if (*stop) { errno = ECANCELED; return -1; }
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += SHM_STOP_POLL_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+        if (sem_timedwait(s, &ts) == 0) break;
+        if (errno != ETIMEDOUT && errno != EINTR) return -1;
+    }
+    SHM_PROBE(wake, which, shm);
+    return 0;
+}
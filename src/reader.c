@@ -9,81 +9,773 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
-#include "shared.h"
+#include <getopt.h>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include "segment.h"
+#include "msglog.h"
+#include "crc32c.h"
+#include "doorbell.h"
+#include "transform.h"
+#include "workpool.h"
+#include "filter.h"
+#include "lzframe.h"
+#include "uringsink.h"
+#include "splicesink.h"
+#include <sys/epoll.h>
+#include <pthread.h>
+
+// Durable: output phải nằm trên đĩa trước khi offset được commit.
+static int commit_output(Segment* seg, FILE* fout){
+    if (!seg->durable) return 0;
+    fflush(fout);
+    if (fdatasync(fileno(fout)) == -1) { perror("fdatasync output"); return -1; }
+    return ring_commit(seg);
+}
+
+// SIGINT/SIGTERM: không chờ thêm producer, lấy nốt những gì đang có trong vòng đệm
+// (tối đa --drain ms) rồi thoát như khi hết luồng. Không SA_RESTART: sem_wait đang
+// chờ bản ghi trả về EINTR; tín hiệu tới ngay trước lúc chờ thì ring_pop_stop thấy
+// g_term sau tối đa SHM_STOP_POLL_MS.
+static volatile sig_atomic_t g_term = 0;
+static void on_term(int sig){ (void)sig; g_term = 1; }
+
+#define DRAIN_MS 5000 // mặc định --drain
+
+static int g_drain_ms = DRAIN_MS;
+static uint64_t g_drain_deadline = 0; // 0: chưa nhận tín hiệu
+
+static uint64_t mono_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// ring_pop_frames có xét tín hiệu dừng: đang drain thì không chặn, vòng đệm cạn
+// hoặc hết hạn drain thì trả RING_EOS.
+static int reader_pop(Shared* shm, FrameAsm* fa, RecMeta* meta, char* msg, int nonblock){
+    for (;;) {
+        if (g_term && !g_drain_deadline) {
+            g_drain_deadline = mono_ns() + (uint64_t)g_drain_ms * 1000000ull;
+            fprintf(stderr, "[reader] signal, draining for at most %d ms\n", g_drain_ms);
+        }
+        if (g_drain_deadline && mono_ns() >= g_drain_deadline) {
+            fprintf(stderr, "[reader] drain timed out, records may remain in the ring\n");
+            return RING_EOS;
+        }
+        int r = ring_pop_frames_stop(shm, fa, meta, msg, nonblock || g_drain_deadline, &g_term);
+        if (r == 1 && g_drain_deadline) return RING_EOS;
+        if (r == -1 && (errno == EINTR || errno == ECANCELED)) continue;
+        return r;
+    }
+}
+
+// Segment còn lại từ luồng trước (đã kết thúc và đã cạn): chờ writer mới.
+static int reader_wait_stream(Shared* shm, const char* name){
+    if (!(__atomic_load_n(&shm->ctl, __ATOMIC_ACQUIRE) & SHM_CTL_DRAIN) || !shm_drained(shm)) return 0;
+    fprintf(stderr, "[reader] previous stream on '%s' has ended, waiting for a writer...\n", name);
+    if (stream_wait_open(shm) == 0) return 0;
+    fprintf(stderr, "[reader] interrupted while waiting for a writer\n");
+    return -1;
+}
+
+// Output: stdio, hoặc io_uring (--uring/--direct) để thread đọc vòng đệm không
+// phải chờ đĩa. Kernel không cho dùng io_uring thì quay về stdio.
+static FILE* open_output(const char* path, const char* mode, int uring, int direct){
+    if (!uring) return fopen(path, mode);
+    FILE* f = uring_fopen(path, mode, direct, "reader");
+    if (f || (errno != ENOSYS && errno != EPERM)) return f;
+    perror("io_uring_setup");
+    fprintf(stderr, "[reader] io_uring unavailable, using stdio\n");
+    return fopen(path, mode);
+}
+
+// Bản ghi sai checksum: không ghi ra output, chép sang file cách ly để điều tra.
+static void quarantine(FILE** fq, const char* path, const RecMeta* meta, const char* msg, uint32_t got){
+    if (!*fq) {
+        *fq = fopen(path, "a");
+        if (!*fq) { perror("open quarantine"); return; }
+    }
+    fprintf(*fq, "crc=%08x expected=%08x len=%u: %s\n", got, meta->crc, meta->len, msg);
+    fflush(*fq);
+}
+
+// Trạng thái dùng chung khi xử lý bản ghi
+typedef struct {
+    FILE* fout;
+    FILE* fq;
+    const char* quarantine_path;
+    int verbose; // in "[reader] wrote: ..." ra stdout
+    const Transform* tx; // -x, NULL: ghi nguyên bản
+    long tx_arg;
+    Filter* filter;      // --match/--exclude/--regex, NULL: giữ mọi dòng
+    FrameAsm* fa;        // ráp frame nén (writer -z) khi phát lại log rồi đọc tiếp vòng đệm
+    const unsigned* lane_weights; // --lanes, NULL: làn ưu tiên cao luôn được lấy trước
+} Sink;
+
+// Lọc rồi biến đổi một dòng; trả về dòng cần ghi hoặc NULL nếu bị lọc bỏ.
+static const char* sink_prepare(const Sink* sk, const char* msg, size_t len, char txbuf[TX_OUT_MAX]){
+    if (sk->filter && !filter_pass(sk->filter, msg, len)) return NULL;
+    if (!sk->tx) return msg;
+    sk->tx->fn(msg, len, txbuf, TX_OUT_MAX, sk->tx_arg);
+    return txbuf;
+}
+
+static void filter_report(const Filter* f){
+    if (!f) return;
+    fprintf(stderr, "[reader] filter: kept %llu of %llu line(s)\n",
+            (unsigned long long)f->kept, (unsigned long long)f->seen);
+}
+
+static void replay_line(Sink* sk, const char* line, size_t len){
+    char txbuf[TX_OUT_MAX];
+    const char* out = sink_prepare(sk, line, len, txbuf);
+    if (out) fprintf(sk->fout, "%s\n", out);
+}
+
+// Phát lại lịch sử từ log: lọc/biến đổi và ghi ra giống hệt bản ghi lấy từ vòng đệm.
+// Mảnh frame nén được ráp trong sk->fa; frame dở ở cuối log được ráp tiếp từ vòng đệm.
+static int replay_cb(void* ctx, uint64_t offset, uint64_t ts_ns, const char* data, uint32_t len, uint32_t flags){
+    (void)offset; (void)ts_ns;
+    Sink* sk = (Sink*)ctx;
+    char line[MSG_MAX];
+    if (len >= MSG_MAX) len = MSG_MAX - 1;
+    if (flags & REC_F_FRAME) {
+        RecMeta meta = { .len = len, .flags = flags };
+        if (frame_feed(sk->fa, &meta, data))
+            while (frame_next(sk->fa, &meta, line)) replay_line(sk, line, meta.len);
+        return 0;
+    }
+    memcpy(line, data, len);
+    line[len] = '\0';
+    replay_line(sk, line, len);
+    return 0;
+}
+
+// Xử lý một bản ghi vừa lấy ra.
+// prefix != NULL: ghi "prefix\t" trước mỗi dòng (nhiều vòng đệm chung một output).
+static void handle_record(Sink* sk, Shared* shm, const RecMeta* meta, const char* msg, const char* prefix){
+    if (meta->flags & REC_F_CRC) {
+        uint32_t got = crc32c(msg, meta->len);
+        if (got != meta->crc) {
+            shm_stat_add(&shm->stats.crc_errors, 1);
+            quarantine(&sk->fq, sk->quarantine_path, meta, msg, got);
+            fprintf(stderr, "[reader] CRC mismatch, record quarantined to %s\n", sk->quarantine_path);
+            return;
+        }
+    }
+
+    char txbuf[TX_OUT_MAX];
+    msg = sink_prepare(sk, msg, meta->len, txbuf);
+    if (!msg) return;
+    if (prefix) fprintf(sk->fout, "%s\t%s\n", prefix, msg);
+    else fprintf(sk->fout, "%s\n", msg);
+    if (sk->verbose) {
+        fflush(sk->fout);
+        printf("[reader] wrote: %s\n", msg);
+    }
+}
+
+// ---- Chế độ epoll: một thread phục vụ nhiều vòng đệm ----
+
+typedef struct {
+    const char* name;
+    Segment seg;
+    int efd;       // eventfd chuông báo của vòng đệm này
+    int lfd;       // socket phát eventfd cho writer
+    int done;      // luồng đã kết thúc và đã lấy hết
+    FrameAsm fa;   // ráp frame nén riêng cho từng vòng đệm
+    SeqTrack seq;  // seq theo producer của vòng đệm này
+} MuxRing;
+
+#define MUX_BATCH 64           // số bản ghi tối đa lấy liên tiếp từ một vòng đệm
+#define MUX_SAFETY_MS 1000     // phòng writer chưa nhận được eventfd
+#define MUX_LISTEN_BIT 0x80000000u
+
+// Lấy tối đa MUX_BATCH bản ghi. Trả về 1 nếu vòng đệm còn dữ liệu, 0 nếu đã
+// arm chuông và rỗng (chờ epoll), -1 nếu lỗi.
+static int mux_drain(Sink* sk, MuxRing* r, const char* prefix){
+    Shared* shm = r->seg.shm;
+    char msg[MSG_MAX];
+    RecMeta meta;
+    for (int n = 0; n < MUX_BATCH; ++n) {
+        int rc = reader_pop(shm, &r->fa, &meta, msg, 1);
+        if (rc == 1) {
+            // Rỗng: arm rồi kiểm tra lại một lần để không lỡ bản ghi vừa tới
+            db_arm(shm);
+            rc = reader_pop(shm, &r->fa, &meta, msg, 1);
+            if (rc == 1) return 0;
+            db_disarm(shm);
+        }
+        if (rc == -1) { perror("ring_pop"); return -1; }
+        if (rc == RING_EOS) {
+            fprintf(stderr, "[reader] %s: end of stream.\n", r->name);
+            r->done = 1;
+            return 0;
+        }
+        handle_record(sk, shm, &meta, msg, prefix);
+    }
+    return 1;
+}
+
+static int run_mux(Sink* sk, const char** names, int n, int wait_secs, int dedup){
+    MuxRing* rings = calloc((size_t)n, sizeof(MuxRing));
+    int* ready = calloc((size_t)n, sizeof(int));
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (!rings || !ready || ep < 0) { perror("epoll setup"); return 1; }
+
+    for (int i = 0; i < n; ++i) {
+        MuxRing* r = &rings[i];
+        r->name = names[i];
+        frame_asm_init(&r->fa);
+        r->seq.dedup = dedup;
+        r->fa.seq = &r->seq;
+        SegConfig cfg = { .name = names[i], .role = SEG_CONSUMER, .wait_secs = wait_secs, .tag = "reader" };
+        if (seg_open(&r->seg, &cfg) == -1) return 1;
+        if (reader_wait_stream(r->seg.shm, names[i]) == -1) return 1;
+        ring_set_lane_weights(r->seg.shm, sk->lane_weights);
+        r->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        r->lfd = db_listen(names[i]);
+        if (r->efd < 0 || r->lfd < 0) {
+            fprintf(stderr, "[reader] cannot set up doorbell for '%s' (another epoll reader?)\n", names[i]);
+            return 1;
+        }
+        struct epoll_event ev = { .events = EPOLLIN };
+        ev.data.u32 = (uint32_t)i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, r->efd, &ev);
+        ev.data.u32 = (uint32_t)i | MUX_LISTEN_BIT;
+        epoll_ctl(ep, EPOLL_CTL_ADD, r->lfd, &ev);
+        db_publish_gen(r->seg.shm);
+        ready[i] = 1;
+    }
+    fprintf(stderr, "[reader] epoll over %d ring(s)\n", n);
+
+    int remaining = n, rc = 0;
+    struct epoll_event evs[64];
+    while (remaining > 0) {
+        // Lấy lần lượt theo lô từ mọi vòng đệm còn dữ liệu (công bằng giữa các kênh)
+        int any = 1;
+        while (any) {
+            any = 0;
+            for (int i = 0; i < n; ++i) {
+                if (!ready[i] || rings[i].done) continue;
+                int d = mux_drain(sk, &rings[i], n > 1 ? rings[i].name : NULL);
+                if (d == -1) { rc = 1; goto out; }
+                if (rings[i].done) --remaining;
+                ready[i] = d;
+                any |= d;
+            }
+        }
+        if (remaining == 0) break;
+        fflush(sk->fout);
+
+        int k = epoll_wait(ep, evs, 64, MUX_SAFETY_MS);
+        if (k < 0 && errno != EINTR) { perror("epoll_wait"); rc = 1; break; }
+        if (k <= 0 || g_term) { // hết chờ an toàn hoặc có tín hiệu: xét lại mọi vòng đệm
+            for (int i = 0; i < n; ++i) ready[i] = 1;
+            continue;
+        }
+        for (int j = 0; j < k; ++j) {
+            uint32_t id = evs[j].data.u32;
+            MuxRing* r = &rings[id & ~MUX_LISTEN_BIT];
+            if (id & MUX_LISTEN_BIT) {
+                db_serve(r->lfd, r->efd);
+            } else {
+                db_ack(r->efd);
+                ready[id] = 1;
+            }
+        }
+    }
+
+out:;
+    LzStats lz = { 0 };
+    for (int i = 0; i < n; ++i) {
+        const LzStats* st = &rings[i].fa.st;
+        lz.frames += st->frames;
+        lz.records += st->records;
+        lz.raw_bytes += st->raw_bytes;
+        lz.wire_bytes += st->wire_bytes;
+        lz.ns += st->ns;
+        lz.dropped += st->dropped;
+        seq_report(&rings[i].seq, rings[i].name);
+        if (rings[i].seg.shm) db_disarm(rings[i].seg.shm);
+        if (rings[i].efd >= 0) close(rings[i].efd);
+        if (rings[i].lfd >= 0) close(rings[i].lfd);
+        seg_close(&rings[i].seg);
+    }
+    close(ep);
+    free(rings);
+    free(ready);
+    lz_report("reader", "decompress", &lz);
+    return rc;
+}
+
+// ---- Chế độ song song: dispatcher -> pool worker -> ghi theo thứ tự ----
+// Thread chính lấy bản ghi theo lô và đánh số lô tăng dần; worker (work-stealing)
+// kiểm tra CRC và chạy biến đổi -x; thread ghi output lấy lô theo đúng số thứ tự.
+// Lô nằm trong cửa sổ vòng PAR_WINDOW(j) ô, ô = số lô % cửa sổ, nên cửa sổ vừa là
+// bộ nhớ lô vừa là reorder buffer; dispatcher chờ khi cửa sổ đầy (back-pressure).
+
+#define PAR_BATCH 64
+
+typedef struct {
+    int n;
+    int done;
+    RecMeta meta[PAR_BATCH];
+    char in[PAR_BATCH][MSG_MAX];
+    uint32_t got_crc[PAR_BATCH];
+    unsigned char bad[PAR_BATCH];
+    unsigned char skip[PAR_BATCH]; // bị bộ lọc bỏ
+    uint32_t out_len[PAR_BATCH];
+    char out[PAR_BATCH][TX_OUT_MAX];
+} ParBatch;
+
+typedef struct {
+    Sink* sk;
+    Shared* shm;
+    ParBatch* win;
+    unsigned window;
+    pthread_mutex_t mu;
+    pthread_cond_t cv_done; // một lô vừa xong
+    pthread_cond_t cv_free; // thread ghi vừa trả một ô
+    uint64_t next_write;    // số lô kế tiếp cần ghi
+    uint64_t dispatched;    // số lô đã giao
+    int finished;           // dispatcher đã gặp hết luồng
+} ParCtx;
+
+static void par_work(void* ctx, uint32_t item, int worker){
+    (void)worker;
+    ParCtx* pc = (ParCtx*)ctx;
+    ParBatch* b = &pc->win[item];
+    const Sink* sk = pc->sk;
+    for (int i = 0; i < b->n; ++i) {
+        const RecMeta* m = &b->meta[i];
+        b->bad[i] = 0;
+        b->skip[i] = 0;
+        if (m->flags & REC_F_CRC) {
+            b->got_crc[i] = crc32c(b->in[i], m->len);
+            if (b->got_crc[i] != m->crc) { b->bad[i] = 1; continue; }
+        }
+        if (sk->filter && !filter_pass(sk->filter, b->in[i], m->len)) { b->skip[i] = 1; continue; }
+        if (sk->tx) {
+            b->out_len[i] = (uint32_t)sk->tx->fn(b->in[i], m->len, b->out[i], TX_OUT_MAX, sk->tx_arg);
+        } else {
+            memcpy(b->out[i], b->in[i], m->len + 1);
+            b->out_len[i] = m->len;
+        }
+    }
+    pthread_mutex_lock(&pc->mu);
+    b->done = 1;
+    pthread_cond_broadcast(&pc->cv_done);
+    pthread_mutex_unlock(&pc->mu);
+}
+
+static void* par_writer(void* arg){
+    ParCtx* pc = (ParCtx*)arg;
+    Sink* sk = pc->sk;
+    for (;;) {
+        pthread_mutex_lock(&pc->mu);
+        ParBatch* b = &pc->win[pc->next_write % pc->window];
+        while (!(pc->next_write < pc->dispatched && b->done) &&
+               !(pc->finished && pc->next_write == pc->dispatched))
+            pthread_cond_wait(&pc->cv_done, &pc->mu);
+        if (pc->next_write == pc->dispatched) { pthread_mutex_unlock(&pc->mu); break; }
+        pthread_mutex_unlock(&pc->mu);
+
+        for (int i = 0; i < b->n; ++i) {
+            if (b->bad[i]) {
+                shm_stat_add(&pc->shm->stats.crc_errors, 1);
+                quarantine(&sk->fq, sk->quarantine_path, &b->meta[i], b->in[i], b->got_crc[i]);
+                fprintf(stderr, "[reader] CRC mismatch, record quarantined to %s\n", sk->quarantine_path);
+                continue;
+            }
+            if (b->skip[i]) continue;
+            fwrite(b->out[i], 1, b->out_len[i], sk->fout);
+            fputc('\n', sk->fout);
+        }
+
+        pthread_mutex_lock(&pc->mu);
+        b->done = 0;
+        pc->next_write++;
+        pthread_cond_signal(&pc->cv_free);
+        pthread_mutex_unlock(&pc->mu);
+    }
+    fflush(sk->fout);
+    return NULL;
+}
+
+static int run_parallel(Sink* sk, Shared* shm, int workers){
+    ParCtx pc;
+    memset(&pc, 0, sizeof(pc));
+    pc.sk = sk;
+    pc.shm = shm;
+    pc.window = (unsigned)workers * 4;
+    pc.win = calloc(pc.window, sizeof(ParBatch));
+    if (!pc.win) { perror("calloc"); return 1; }
+    pthread_mutex_init(&pc.mu, NULL);
+    pthread_cond_init(&pc.cv_done, NULL);
+    pthread_cond_init(&pc.cv_free, NULL);
+
+    WorkPool wp;
+    pthread_t wth;
+    if (wp_start(&wp, workers, pc.window, par_work, &pc) == -1 ||
+        pthread_create(&wth, NULL, par_writer, &pc) != 0) {
+        fprintf(stderr, "[reader] cannot start worker threads\n");
+        return 1;
+    }
+    fprintf(stderr, "[reader] parallel: %d worker(s), batch %d, window %u batches%s%s\n",
+            workers, PAR_BATCH, pc.window, sk->tx ? ", transform " : "", sk->tx ? sk->tx->name : "");
+
+    int rc = 0, end = 0;
+    while (!end) {
+        uint64_t seqno = pc.dispatched;
+        pthread_mutex_lock(&pc.mu);
+        while (seqno - pc.next_write >= pc.window) pthread_cond_wait(&pc.cv_free, &pc.mu);
+        pthread_mutex_unlock(&pc.mu);
+
+        // Chờ bản ghi đầu tiên, rồi lấy thêm những bản ghi đã sẵn có
+        ParBatch* b = &pc.win[seqno % pc.window];
+        b->n = 0;
+        while (b->n < PAR_BATCH) {
+            int r = reader_pop(shm, sk->fa, &b->meta[b->n], b->in[b->n], b->n > 0);
+            if (r == 1) break;
+            if (r == -1) { perror("ring_pop"); rc = 1; end = 1; break; }
+            if (r == RING_EOS) { end = 1; break; }
+            b->n++;
+        }
+        if (b->n == 0) continue;
+
+        pthread_mutex_lock(&pc.mu);
+        pc.dispatched++;
+        pthread_mutex_unlock(&pc.mu);
+        wp_submit(&wp, (uint32_t)(seqno % pc.window));
+    }
+    fprintf(stderr, "[reader] end of stream, exit.\n");
+
+    wp_stop(&wp);
+    pthread_mutex_lock(&pc.mu);
+    pc.finished = 1;
+    pthread_cond_broadcast(&pc.cv_done);
+    pthread_mutex_unlock(&pc.mu);
+    pthread_join(wth, NULL);
+
+    for (int i = 0; i < workers; ++i)
+        fprintf(stderr, "[reader] worker %d: %llu batch(es), %llu stolen\n", i,
+                (unsigned long long)wp.w[i].executed, (unsigned long long)wp.w[i].stolen);
+    wp_free(&wp);
+    pthread_mutex_destroy(&pc.mu);
+    pthread_cond_destroy(&pc.cv_done);
+    pthread_cond_destroy(&pc.cv_free);
+    free(pc.win);
+    return rc;
+}
+
+// --lanes: "strict" hoặc "W0,W1,..." (thiếu thì trọng số 1).
+static int parse_lanes(const char* spec, unsigned weights[PRIO_LANES + 1], const unsigned** out){
+    if (strcmp(spec, "strict") == 0) { *out = NULL; return 0; }
+    const char* s = spec;
+    for (unsigned k = 0; k <= PRIO_LANES; ++k) {
+        char* end = (char*)s;
+        weights[k] = *s ? (unsigned)strtoul(s, &end, 10) : 1;
+        if (end == s && *s) { fprintf(stderr, "--lanes: bad weight list '%s'\n", spec); return -1; }
+        s = *end == ',' ? end + 1 : end;
+    }
+    if (*s) { fprintf(stderr, "--lanes: at most %d weights\n", PRIO_LANES + 1); return -1; }
+    *out = weights;
+    return 0;
+}
+
+// --splice: chỉ chuyển byte (không lọc/biến đổi). ring_pop chép thẳng vào chunk
+// căn trang của SpliceSink, chunk đầy hoặc vòng đệm rỗng thì vmsplice ra output.
+#define SPLICE_SPINS 64
+
+static int run_splice(Sink* sk, Shared* shm, const char* out_path){
+    SpliceSink ss;
+    if (splice_sink_open(&ss, out_path, "w") == -1) {
+        perror("open output");
+        splice_sink_close(&ss);
+        return 1;
+    }
+    int rc = 0;
+    for (;;) {
+        char* dst = splice_sink_reserve(&ss, MSG_MAX + 1); // dòng + '\n'
+        if (!dst) { perror("vmsplice"); rc = 1; break; }
+        RecMeta meta;
+        int r = reader_pop(shm, sk->fa, &meta, dst, 1);
+        // Vòng đệm nhỏ nên thường rỗng trong chốc lát dù writer còn đang ghi:
+        // nhường CPU vài lần trước khi coi là rảnh, kẻo mỗi chunk chỉ có vài dòng
+        for (int spin = 0; r == 1 && spin < SPLICE_SPINS; ++spin) {
+            sched_yield();
+            r = reader_pop(shm, sk->fa, &meta, dst, 1);
+        }
+        if (r == 1) {
+            // Vòng đệm rỗng: đẩy phần đã gom ra trước khi ngủ
+            if (splice_sink_flush(&ss) == -1 || !(dst = splice_sink_reserve(&ss, MSG_MAX + 1))) {
+                perror("vmsplice");
+                rc = 1;
+                break;
+            }
+            r = reader_pop(shm, sk->fa, &meta, dst, 0);
+        }
+        if (r == -1) { perror("ring_pop"); rc = 1; break; }
+        if (r == RING_EOS) break;
+        if (meta.flags & REC_F_CRC) {
+            uint32_t got = crc32c(dst, meta.len);
+            if (got != meta.crc) {
+                shm_stat_add(&shm->stats.crc_errors, 1);
+                quarantine(&sk->fq, sk->quarantine_path, &meta, dst, got);
+                fprintf(stderr, "[reader] CRC mismatch, record quarantined to %s\n", sk->quarantine_path);
+                continue;
+            }
+        }
+        dst[meta.len] = '\n';
+        splice_sink_commit(&ss, meta.len + 1);
+    }
+    if (splice_sink_close(&ss) == -1 && rc == 0) { perror("splice output"); rc = 1; }
+    fprintf(stderr, "[reader] %s: %llu chunk(s), %.1f MiB\n",
+            ss.use_write ? "write (splice unsupported)" : ss.to_pipe ? "vmsplice to pipe" : "vmsplice+splice to file",
+            (unsigned long long)ss.chunks, (double)ss.bytes / (1 << 20));
+    return rc;
+}
 
 static void usage(const char* prog){
     fprintf(stderr,
-        "Usage: %s [-o output.txt] [-n /shm_name] [-w seconds]\n"
+        "Usage: %s [-o output.txt] [-n /shm_name] [-w seconds] [-f ring.dat [-k N]] [-q corrupt.txt] [-l logdir --from N|@T] [-E -n name...] [-j workers] [-x transform] [--match S]... [--exclude S]... [--regex RE] [--lanes strict|W0,W1,...] [--uring [--direct]] [--splice] [--dedup] [--drain MS]\n"
         "  -o  đường dẫn file output (mặc định: output.txt)\n"
-        "  -n  tên POSIX shm (mặc định: %s)\n"
-        "  -w  thời gian tối đa chờ writer tạo SHM (mặc định: 5 giây)\n",
-        prog, SHM_NAME);
+        "  -n  tên POSIX shm, arena:kênh hoặc @tên (vòng đệm memfd của shm_broker) (mặc định: %s)\n"
+        "  -w  thời gian tối đa chờ writer tạo SHM (mặc định: 5 giây)\n"
+        "  -f  vòng đệm durable trong file (thay cho -n), đọc tiếp từ offset đã commit\n"
+        "  -k  commit offset (msync) sau mỗi N bản ghi (mặc định: %d)\n"
+        "  -q  file cách ly bản ghi sai CRC (mặc định: <output>.corrupt)\n"
+        "  -l  thư mục log append-only của writer\n"
+        "  --from N|@T|@-S  phát lại từ log bắt đầu ở offset N, thời điểm unix T,\n"
+        "                   hoặc S giây trước, rồi chuyển sang vòng đệm không hở\n"
+        "  -E  chế độ epoll: một thread đọc mọi vòng đệm cho bằng -n (lặp lại -n),\n"
+        "      writer được đánh thức qua eventfd; dòng output có tiền tố \"tên\\t\"\n"
+        "  -j  số worker: thread chính lấy bản ghi theo lô, worker kiểm tra CRC và\n"
+        "      biến đổi song song, output vẫn giữ đúng thứ tự input\n"
+        "  -x  biến đổi mỗi dòng trước khi ghi: none, upper, rot13, hash[:N]\n"
+        "  --match S    chỉ giữ dòng chứa S (lặp lại: chứa ít nhất một mẫu)\n"
+        "  --exclude S  bỏ dòng chứa S (lặp lại được)\n"
+        "  --regex RE   chỉ giữ dòng khớp regex POSIX mở rộng\n"
+        "  --lanes P    cách lấy từ các làn ưu tiên (writer -p/-P): strict (mặc định, làn\n"
+        "               cao luôn trước) hoặc trọng số round-robin W0,W1,..,W%d cho làn 0..%d\n"
+        "  --uring      ghi output qua io_uring (%d buffer %d KiB đã đăng ký): thread đọc\n"
+        "               vòng đệm không bị chặn khi đĩa chậm (không dùng chung với -f)\n"
+        "  --direct     như --uring và mở output với O_DIRECT (bỏ qua page cache)\n"
+        "  --splice     chuyển byte bằng vmsplice/splice, không qua stdio; -o - là stdout\n"
+        "               (nếu stdout là pipe thì vmsplice thẳng vào đó)\n"
+        "  --dedup      bỏ bản ghi lặp lại seq đã giao của cùng producer (writer --producer\n"
+        "               chạy lại từ đầu input); mất/lặp luôn được đếm và in khi thoát\n"
+        "  --drain MS   khi nhận SIGINT/SIGTERM: lấy nốt bản ghi đang có trong vòng đệm,\n"
+        "               tối đa MS mili giây, rồi thoát (mặc định: %d)\n"
+        "Reader thoát khi mọi writer đã kết thúc luồng và vòng đệm đã cạn.\n",
+        prog, SHM_NAME, CKPT_EVERY, PRIO_LANES, PRIO_LANES, URING_DEPTH, URING_BUF / 1024, DRAIN_MS);
 }
 
 int main(int argc, char** argv){
     const char* out_path = "output.txt";
     const char* shm_name = SHM_NAME;
     int wait_secs = 30;
+    const char* ring_path = NULL;
+    unsigned long ckpt_every = CKPT_EVERY;
+    const char* log_dir = NULL;
+    const char* from = NULL;
+    const char* quarantine_path = NULL;
+    int mux = 0;
+    int workers = 0;
+    const char* tx_spec = NULL;
+    unsigned weights[PRIO_LANES + 1];
+    const unsigned* lane_weights = NULL;
+    int uring = 0, direct = 0, use_splice = 0, dedup = 0;
+    Filter filter;
+    memset(&filter, 0, sizeof(filter));
+    const char** names = calloc((size_t)argc, sizeof(char*));
+    int n_names = 0;
 
+    static const struct option long_opts[] = {
+        { "from", required_argument, NULL, 'F' },
+        { "match", required_argument, NULL, 'M' },
+        { "exclude", required_argument, NULL, 'X' },
+        { "regex", required_argument, NULL, 'R' },
+        { "lanes", required_argument, NULL, 'W' },
+        { "uring", no_argument, NULL, 'U' },
+        { "direct", no_argument, NULL, 'D' },
+        { "splice", no_argument, NULL, 'S' },
+        { "dedup", no_argument, NULL, 'I' },
+        { "drain", required_argument, NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+    };
     int opt;
-    while ((opt = getopt(argc, argv, "o:n:w:h")) != -1){
+    while ((opt = getopt_long(argc, argv, "o:n:w:f:k:q:l:Ej:x:h", long_opts, NULL)) != -1){
         if (opt == 'o') out_path = optarg;
-        else if (opt == 'n') shm_name = optarg;
+        else if (opt == 'n') shm_name = names[n_names++] = optarg;
+        else if (opt == 'f') ring_path = optarg;
+        else if (opt == 'k') ckpt_every = strtoul(optarg, NULL, 10);
+        else if (opt == 'q') quarantine_path = optarg;
+        else if (opt == 'l') log_dir = optarg;
+        else if (opt == 'F') from = optarg;
+        else if (opt == 'E') mux = 1;
+        else if (opt == 'j') workers = atoi(optarg);
+        else if (opt == 'x') tx_spec = optarg;
+        else if (opt == 'M') { if (filter_add_match(&filter, optarg) == -1) { perror("--match"); return 1; } }
+        else if (opt == 'X') { if (filter_add_exclude(&filter, optarg) == -1) { perror("--exclude"); return 1; } }
+        else if (opt == 'R') { if (filter_set_regex(&filter, optarg) == -1) return 1; }
+        else if (opt == 'U') uring = 1;
+        else if (opt == 'S') use_splice = 1;
+        else if (opt == 'I') dedup = 1;
+        else if (opt == 'T') g_drain_ms = atoi(optarg);
+        else if (opt == 'D') uring = direct = 1;
+        else if (opt == 'W') { if (parse_lanes(optarg, weights, &lane_weights) == -1) return 1; }
         else if (opt == 'w') wait_secs = atoi(optarg);
         else { usage(argv[0]); return 1; }
     }
-
-    // 1) Chờ SHM xuất hiện (nếu chưa có)
-    int shmfd = -1;
-    for (int i = 0; i <= wait_secs * 10; ++i) { // mỗi 100ms
-        shmfd = shm_open(shm_name, O_RDWR, 0666);
-        if (shmfd >= 0) break;
-        if (errno != ENOENT) { perror("shm_open"); return 1; }
-        usleep(100 * 1000);
+    if (from && !log_dir) { fprintf(stderr, "--from cần -l logdir\n"); return 1; }
+    char default_quarantine[512];
+    if (!quarantine_path) {
+        snprintf(default_quarantine, sizeof(default_quarantine), "%s.corrupt", out_path);
+        quarantine_path = default_quarantine;
     }
-    if (shmfd < 0) {
-        fprintf(stderr, "Timed out waiting for SHM '%s'\n", shm_name);
+    if (mux && (ring_path || from)) { fprintf(stderr, "-E không dùng chung với -f/--from\n"); return 1; }
+    if (uring && ring_path) { fprintf(stderr, "--uring không dùng chung với -f (commit cần fdatasync đồng bộ)\n"); return 1; }
+    if (use_splice && (ring_path || mux || workers > 0 || from || uring || tx_spec || filter_active(&filter))) {
+        fprintf(stderr, "--splice chỉ chuyển byte thuần: không dùng chung với -f/-E/-j/--from/--uring/-x/lọc\n");
         return 1;
     }
+    if (workers > 0 && (ring_path || mux)) { fprintf(stderr, "-j không dùng chung với -f/-E\n"); return 1; }
+    const Transform* tx = NULL;
+    long tx_arg = 0;
+    if (tx_spec && !(tx = tx_find(tx_spec, &tx_arg))) { fprintf(stderr, "unknown transform '%s'\n", tx_spec); return 1; }
+    if (filter_compile(&filter) == -1) return 1;
+    Filter* flt = filter_active(&filter) ? &filter : NULL;
 
-    struct stat st;
-    if (fstat(shmfd, &st) == -1) { perror("fstat"); return 1; }
-    if ((size_t)st.st_size < sizeof(Shared)) {
-        fprintf(stderr, "SHM size too small.\n");
-        return 1;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_term;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (mux) {
+        if (n_names == 0) names[n_names++] = SHM_NAME;
+        FILE* fout = open_output(out_path, "w", uring, direct);
+        if (!fout) { perror("open output"); return 1; }
+        Sink sk = { .fout = fout, .quarantine_path = quarantine_path, .verbose = 0, .tx = tx, .tx_arg = tx_arg, .filter = flt,
+                    .lane_weights = lane_weights };
+        int rc = run_mux(&sk, names, n_names, wait_secs, dedup);
+        filter_report(flt);
+        if (fclose(fout) == EOF) { perror("close output"); rc = 1; } // vd. io_uring báo ENOSPC/EIO
+        if (sk.fq) fclose(sk.fq);
+        free(names);
+        return rc;
     }
+    free(names);
+
+    // 1) Chờ segment xuất hiện (nếu chưa có)
+    SegConfig cfg = {
+        .name = ring_path ? ring_path : shm_name,
+        .durable = ring_path != NULL,
+        .role = SEG_CONSUMER,
+        .wait_secs = wait_secs,
+        .tag = "reader",
+    };
+    Segment seg;
+    if (seg_open(&seg, &cfg) == -1) return 1;
+    Shared* shm = seg.shm;
+    if (reader_wait_stream(shm, cfg.name) == -1) { seg_close(&seg); return 1; }
+    ring_set_lane_weights(shm, lane_weights);
+    static SeqTrack seq;
+    seq.dedup = dedup;
 
-    Shared* shm = mmap(NULL, sizeof(Shared), PROT_READ|PROT_WRITE, MAP_SHARED, shmfd, 0);
-    if (shm == MAP_FAILED) { perror("mmap"); return 1; }
+    if (use_splice) {
+        static FrameAsm sfa;
+        frame_asm_init(&sfa);
+        sfa.seq = &seq;
+        Sink ssk = { .quarantine_path = quarantine_path, .fa = &sfa };
+        int rc = run_splice(&ssk, shm, out_path);
+        lz_report("reader", "decompress", &sfa.st);
+        seq_report(&seq, "reader");
+        if (ssk.fq) fclose(ssk.fq);
+        seg_close(&seg);
+        return rc;
+    }
 
-    FILE* fout = fopen(out_path, "w");
+    // Durable: nối tiếp output cũ, các bản ghi chưa commit sẽ được giao lại
+    FILE* fout = open_output(out_path, seg.durable ? "a" : "w", uring, direct);
     if (!fout) { perror("open output"); return 1; }
 
-    // 2) Vòng lặp tiêu thụ
-    for (;;) {
-        if (sem_wait(&shm->full) == -1) { perror("sem_wait full"); break; }
-        if (sem_wait(&shm->mutex) == -1) { perror("sem_wait mutex"); break; }
-
-        char msg[MSG_MAX];
-        strncpy(msg, shm->buf[shm->out], MSG_MAX);
-        msg[MSG_MAX-1] = '\0';
-        shm->out = (shm->out + 1) % CAP;
+    static FrameAsm fa;
+    frame_asm_init(&fa);
+    fa.seq = &seq;
+    Sink sk = { .fout = fout, .quarantine_path = quarantine_path, .verbose = 1, .tx = tx, .tx_arg = tx_arg, .filter = flt, .fa = &fa };
 
+    // Phát lại lịch sử [from, live_start) từ log, rồi tiêu thụ vòng đệm từ
+    // live_start: writer ghi log trước khi publish nên không có khoảng hở.
+    if (from) {
+        sem_wait(&shm->mutex);
+        uint64_t live_start = shm->out;
         sem_post(&shm->mutex);
-        sem_post(&shm->empty);
 
-        if (strncmp(msg, END_TOKEN, MSG_MAX) == 0) {
-            fprintf(stderr, "[reader] got END, exit.\n");
+        int by_time = from[0] == '@';
+        uint64_t from_off = 0, from_ts = 0;
+        if (by_time) {
+            long long t = atoll(from + 1);
+            if (t < 0) t += (long long)time(NULL);
+            from_ts = (uint64_t)t * 1000000000ull;
+        } else {
+            from_off = strtoull(from, NULL, 10);
+        }
+        long n = mlog_replay(log_dir, from_off, from_ts, by_time, live_start, replay_cb, &sk);
+        if (n < 0) return 1;
+        fflush(fout);
+        fprintf(stderr, "[reader] replayed %ld record(s) from log, live from offset %llu\n",
+                n, (unsigned long long)live_start);
+    }
+
+    // 2) Vòng lặp tiêu thụ
+    if (workers > 0) {
+        sk.verbose = 0;
+        int rc = run_parallel(&sk, shm, workers);
+        filter_report(flt);
+        lz_report("reader", "decompress", &fa.st);
+        seq_report(&seq, "reader");
+        if (fclose(fout) == EOF) { perror("close output"); rc = 1; }
+        if (sk.fq) fclose(sk.fq);
+        seg_close(&seg);
+        return rc;
+    }
+    unsigned long since_ckpt = 0;
+    for (;;) {
+        char msg[MSG_MAX];
+        RecMeta meta;
+        int r = reader_pop(shm, &fa, &meta, msg, seg.durable);
+        if (r == 1) {
+            // Vòng đệm rỗng: commit trước khi ngủ để writer có ô trống
+            if (commit_output(&seg, fout) == -1) break;
+            since_ckpt = 0;
+            r = reader_pop(shm, &fa, &meta, msg, 0);
+        }
+        if (r == -1) { perror("ring_pop"); break; }
+        if (r == RING_EOS) {
+            fprintf(stderr, "[reader] end of stream, exit.\n");
             break;
         }
 
-        fprintf(fout, "%s\n", msg);
-        fflush(fout);
-        printf("[reader] wrote: %s\n", msg);
+        handle_record(&sk, shm, &meta, msg, NULL);
+
+        if (seg.durable && ++since_ckpt >= ckpt_every) {
+            if (commit_output(&seg, fout) == -1) break;
+            since_ckpt = 0;
+        }
     }
 
-    fclose(fout);
-    munmap(shm, sizeof(*shm));
-    close(shmfd);
-    return 0;
+    commit_output(&seg, fout);
+    filter_report(flt);
+    lz_report("reader", "decompress", &fa.st);
+    seq_report(&seq, "reader");
+    int rc = 0;
+    if (fclose(fout) == EOF) { perror("close output"); rc = 1; }
+    if (sk.fq) fclose(sk.fq);
+    seg_close(&seg);
+    return rc;
 }
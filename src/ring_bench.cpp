@@ -0,0 +1,131 @@
+// ring_bench.cpp — so sánh consumer thread-per-ring (ring_pop chặn) với
+// consumer coroutine (shm_coro.hpp) trên vài thread reactor.
+// g++ -std=c++20 -O2 ring_bench.cpp -o ring_bench -pthread
+//
+// Mỗi vòng đệm có một thread producer đẩy -m bản ghi rồi kết thúc luồng. Kết quả in ra:
+// mode, số vòng đệm, số thread consumer, thời gian, bản ghi/giây.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shm_coro.hpp"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void produce(const char* name, long msgs) {
+    auto ring = shm_ring<shm_text, CAP>::open(name, SEG_PRODUCER, 5, nullptr);
+    if (!ring) return;
+    Doorbell db;
+    db_producer_init(&db, ring->get(), name);
+    auto tx = ring->producer();
+    char line[64];
+    for (long i = 0; i < msgs; ++i) {
+        int n = snprintf(line, sizeof(line), "msg %ld", i);
+        tx.push(std::string_view(line, (size_t)n));
+        db_ring(&db, ring->get());
+    }
+    tx.close();
+    db_ring(&db, ring->get());
+    db_producer_close(&db);
+}
+
+static std::atomic<long> g_received{0};
+
+static shm_task consume(shm_reactor& r, const char* name, size_t batch) {
+    shm_async_ring ring(r, name);
+    long n = 0;
+    for (;;) {
+        auto recs = co_await ring.next_batch(batch);
+        if (recs.empty()) break;
+        n += (long)recs.size();
+    }
+    g_received += n;
+}
+
+static void consume_blocking(const char* name) {
+    auto ring = shm_ring<shm_text, CAP>::open(name, SEG_CONSUMER, 5, nullptr);
+    if (!ring) return;
+    auto rx = ring->consumer();
+    char msg[MSG_MAX];
+    long n = 0;
+    while (rx.pop(msg) == 0) ++n;
+    g_received += n;
+}
+
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s [-r rings] [-m msgs_per_ring] [-t reactor_threads] [-b batch] [-M threads|coro|both]\n",
+        prog);
+}
+
+int main(int argc, char** argv){
+    int rings = 64, threads = 2;
+    long msgs = 20000;
+    size_t batch = 64;
+    const char* mode = "both";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:m:t:b:M:h")) != -1){
+        if (opt == 'r') rings = atoi(optarg);
+        else if (opt == 'm') msgs = atol(optarg);
+        else if (opt == 't') threads = atoi(optarg);
+        else if (opt == 'b') batch = strtoul(optarg, NULL, 10);
+        else if (opt == 'M') mode = optarg;
+        else { usage(argv[0]); return 1; }
+    }
+    if (rings < 1 || threads < 1) { usage(argv[0]); return 1; }
+
+    std::vector<std::string> names;
+    for (int i = 0; i < rings; ++i) names.push_back("/ring_bench." + std::to_string(getpid()) + "." + std::to_string(i));
+
+    printf("mode     rings  consumer_threads  seconds  msgs/s\n");
+    for (int pass = 0; pass < 2; ++pass) {
+        bool coro = pass == 1;
+        if (strcmp(mode, "both") != 0 && strcmp(mode, coro ? "coro" : "threads") != 0) continue;
+        g_received = 0;
+
+        // Tạo segment trước để consumer gắn vào ngay và producer kết nối được chuông
+        std::vector<std::optional<shm_ring<shm_text, CAP>>> segs;
+        for (auto& n : names) segs.push_back(shm_ring<shm_text, CAP>::open(n.c_str(), SEG_PRODUCER, 5, nullptr));
+
+        std::vector<std::unique_ptr<shm_reactor>> reactors;
+        std::vector<std::thread> consumers;
+        if (coro) {
+            for (int i = 0; i < threads; ++i) reactors.push_back(std::make_unique<shm_reactor>());
+            for (int i = 0; i < rings; ++i) consume(*reactors[i % threads], names[i].c_str(), batch);
+        }
+
+        double t0 = now_sec();
+        if (coro) {
+            for (auto& r : reactors) consumers.emplace_back([&r] { r->run(); });
+        } else {
+            for (auto& n : names) consumers.emplace_back(consume_blocking, n.c_str());
+        }
+        std::vector<std::thread> producers;
+        for (auto& n : names) producers.emplace_back(produce, n.c_str(), msgs);
+        for (auto& t : producers) t.join();
+        for (auto& t : consumers) t.join();
+        double dt = now_sec() - t0;
+
+        long total = (long)rings * msgs;
+        printf("%-8s %5d  %16zu  %7.3f  %.0f%s\n", coro ? "coro" : "threads", rings,
+               consumers.size(), dt, total / dt, g_received == total ? "" : "  (MISSING RECORDS)");
+        fflush(stdout);
+
+        reactors.clear();
+        segs.clear();
+        for (auto& n : names) seg_unlink(n.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,516 @@
+#pragma once
+// segment.h — mở/khởi tạo/đóng đoạn nhớ dùng chung cho writer và reader.
+//  - POSIX shm (mặc định): /dev/shm/<name> (điều khiển) + <name>.data, mất khi reboot.
+//  - Durable (-f file): vòng đệm nằm trong file được mmap, offset được checkpoint
+//    bằng msync; khởi động lại thì reader đọc tiếp từ offset đã commit và writer
+//    đọc tiếp input từ vị trí tương ứng (at-least-once).
+//  - Kênh trong arena (-n arena:kênh): một khối Shared trong segment chung, xem arena.h.
+//  - Vòng đệm ẩn danh (-n @tên): memfd do shm_broker cấp qua SCM_RIGHTS, xem memfdseg.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <grp.h>
+#include "shared.h"
+#include "stream.h"
+#include "arena.h"
+#include "memfdseg.h"
+
+enum { SEG_PRODUCER = 0, SEG_CONSUMER = 1 };
+
+// POSIX shm được tách thành hai object: "/tên" (vùng điều khiển) và "/tên.data".
+// Mặc định: chủ sở hữu và nhóm ghi được vùng điều khiển, còn lại chỉ đọc; vùng dữ
+// liệu chỉ writer (chủ sở hữu) ghi được. Nhiều writer khác uid: --data-mode 0664.
+#define SEG_DATA_SUFFIX ".data"
+#define SEG_MODE 0664
+#define SEG_DATA_MODE 0644
+
+// Tham số mở segment
+typedef struct {
+    const char* name;     // tên POSIX shm, hoặc đường dẫn file nếu durable
+    int durable;          // 1: vòng đệm nằm trong file trên đĩa
+    int role;             // SEG_PRODUCER / SEG_CONSUMER
+    int wait_secs;        // thời gian tối đa chờ segment xuất hiện
+    uint64_t base_offset; // offset của bản ghi đầu tiên khi tạo vòng đệm mới
+    const char* tag;      // tiền tố thông báo, vd. "writer"; NULL: chỉ in lỗi
+    unsigned mode;        // quyền vùng điều khiển khi tạo POSIX shm mới (0: SEG_MODE)
+    unsigned data_mode;   // quyền vùng dữ liệu (0: SEG_DATA_MODE)
+    const char* group;    // nhóm sở hữu segment mới, NULL: nhóm của process
+} SegConfig;
+
+typedef struct {
+    Shared* shm;
+    int fd;
+    int role;      // SEG_PRODUCER / SEG_CONSUMER
+    int durable;   // 1 nếu là file trên đĩa
+    int creator;   // 1 nếu process này vừa khởi tạo segment
+    int recovered; // 1 nếu vừa phục hồi segment durable cũ (không ai đang gắn)
+    ArenaMap* arena; // khác NULL nếu là kênh trong arena (shm trỏ vào khối của nó)
+    int broker;      // kết nối tới shm_broker giữ vòng đệm "@tên" sống, -1 nếu không dùng
+} Segment;
+
+// out vừa lùi về committed: mốc seq trở lại đúng lúc commit (ring_commit), để
+// bản ghi giao lại không bị báo lặp còn bản đã commit mà producer gửi lại thì có.
+static inline void seq_marks_restore(Shared* shm) {
+    unsigned n = shm->seq_nmarks_committed;
+    shm->seq_nmarks = n <= SEQ_MARKS ? n : 0;
+    memcpy(shm->seq_marks, shm->seq_marks_committed, sizeof(shm->seq_marks));
+}
+
+// Khởi tạo nội dung segment mới. Vòng đệm durable được phục hồi từ offset đã
+// commit: các bản ghi [committed, in) còn nằm trong file sẽ được giao lại.
+static inline int seg_init_sems(Shared* shm, int fresh, unsigned flags, uint64_t base) {
+    if (fresh) {
+        memset(shm, 0, sizeof(*shm));
+        shm->in = shm->out = shm->released = shm->committed = base;
+    } else {
+        // Crash giữa msync và lúc trả ô: committed đã bền, released chưa kịp theo
+        if (shm->committed < shm->released) shm->committed = shm->released;
+        shm->out = shm->released = shm->committed;
+        shm->seq = (shm->seq + 1) & ~1u;
+        seq_marks_restore(shm);
+    }
+    shm->flags = flags;
+    // Làn ưu tiên không durable: bản ghi còn sót lại từ lần chạy trước bị bỏ
+    for (unsigned k = 0; k < PRIO_LANES; ++k) {
+        shm->lanes[k].in = shm->lanes[k].out = 0;
+        if (sem_init(&shm->lanes[k].empty, 1, LANE_CAP) == -1) { perror("sem_init lane"); return -1; }
+    }
+    shm->lane_pending = 0;
+    // Không ai đang gắn: các producer cũ đã chết (pid có thể đã thuộc process khác)
+    for (unsigned k = 0; k < MAX_PRODUCERS; ++k) {
+        shm->producers[k].pid = 0;
+        shm->producers[k].gen++;
+        shm->producers[k].inflight = 0;
+    }
+    shm->nproducers = 0;
+    // Luồng của lần chạy trước cũng vậy: ô luồng và DRAIN cũ không còn nghĩa
+    memset(shm->streams, 0, sizeof(shm->streams));
+    shm->stream_excl = 0;
+    shm->stream_reap_ns = 0;
+    shm->ctl = 0;
+    unsigned used = (unsigned)(shm->in - shm->released);
+    if (sem_init(&shm->empty, 1, CAP - used) == -1) { perror("sem_init empty"); return -1; }
+    if (sem_init(&shm->full,  1, used     ) == -1) { perror("sem_init full");  return -1; }
+    if (sem_init(&shm->mutex, 1, 1        ) == -1) { perror("sem_init mutex"); return -1; }
+    shm->frame_tx.owner = shm->frame_rx.owner = 0;
+    if (sem_init(&shm->frame_tx.sem, 1, 1) == -1 || sem_init(&shm->frame_rx.sem, 1, 1) == -1) {
+        perror("sem_init frame");
+        return -1;
+    }
+    __atomic_store_n(&shm->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Chờ creator khởi tạo xong (magic được ghi sau cùng).
+static inline int seg_wait_ready(const Shared* shm, int wait_secs) {
+    for (int i = 0; i <= wait_secs * 100; ++i) {
+        if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) == SHM_MAGIC) return 0;
+        usleep(10 * 1000);
+    }
+    fprintf(stderr, "SHM not initialized (bad magic).\n");
+    return -1;
+}
+
+// Đặt lại số token semaphore sau khi process cùng vai trò trước đó chết giữa
+// chừng (vd. giữa lúc đã commit nhưng chưa post empty, hoặc đã tăng in nhưng
+// chưa post full). Rút hết token rồi post đúng số cần; token thừa do post đang
+// bay được ring_push/ring_pop bỏ qua. Reader mới còn lùi out về offset đã commit.
+static inline void seg_resync(Segment* seg) {
+    Shared* shm = seg->shm;
+    sem_wait(&shm->mutex);
+    if (seg->role == SEG_CONSUMER) {
+        shm_seq_write_begin(shm);
+        if (shm->committed > shm->released) shm->released = shm->committed; // reader cũ chết sau msync
+        if (shm->out != shm->released) {
+            shm->out = shm->released;
+            seq_marks_restore(shm); // bản ghi chưa commit sẽ được lấy lại, không phải bản lặp
+        }
+        shm_seq_write_end(shm);
+    }
+    while (sem_trywait(&shm->full) == 0) {}
+    for (uint64_t i = shm->out; i < shm->in + shm->lane_pending; ++i) sem_post(&shm->full);
+    for (unsigned k = 0; k < PRIO_LANES; ++k) {
+        Lane* l = &shm->lanes[k];
+        while (sem_trywait(&l->empty) == 0) {}
+        for (uint64_t i = l->in - l->out; i < LANE_CAP; ++i) sem_post(&l->empty);
+    }
+    while (sem_trywait(&shm->empty) == 0) {}
+    for (uint64_t i = shm->in - shm->released; i < CAP; ++i) sem_post(&shm->empty);
+    sem_post(&shm->mutex);
+}
+
+// Khóa byte [start, start+len) của file bằng OFD lock (gắn với fd, tự nhả khi process chết).
+static inline int seg_lock(int fd, short type, off_t start, off_t len, int wait) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len;
+    return fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &fl);
+}
+
+static inline int seg_open_durable(Segment* seg, const SegConfig* cfg) {
+    const char* path = cfg->name;
+    const char* tag = cfg->tag;
+    int wait_secs = cfg->wait_secs;
+    int fd = -1;
+    for (int i = 0; i <= wait_secs * 10; ++i) { // mỗi 100ms
+        fd = open(path, seg->role == SEG_PRODUCER ? O_RDWR | O_CREAT : O_RDWR, 0666);
+        if (fd >= 0) break;
+        if (errno != ENOENT) { perror("open ring file"); return -1; }
+        usleep(100 * 1000);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Timed out waiting for ring file '%s'\n", path);
+        return -1;
+    }
+    seg->fd = fd;
+
+    // Byte 0 = producer, byte 1 = consumer. Giữ được cả hai nghĩa là không ai
+    // khác đang gắn vào file: khởi tạo mới hoặc phục hồi sau crash/reboot.
+    if (seg_lock(fd, F_WRLCK, 0, 2, 0) == 0) {
+        struct stat st;
+        if (fstat(fd, &st) == -1) { perror("fstat"); return -1; }
+        int fresh = (size_t)st.st_size < sizeof(Shared);
+        if (fresh && ftruncate(fd, sizeof(Shared)) == -1) { perror("ftruncate"); return -1; }
+        seg->shm = (Shared*)mmap(NULL, sizeof(Shared), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (seg->shm == MAP_FAILED) { perror("mmap"); return -1; }
+        if (!fresh && seg->shm->magic != SHM_MAGIC) fresh = 1;
+        if (seg_init_sems(seg->shm, fresh, SHM_F_DURABLE, cfg->base_offset) == -1) return -1;
+        if (msync(seg->shm, sizeof(Shared), MS_SYNC) == -1) perror("msync");
+        seg->creator = fresh;
+        seg->recovered = !fresh;
+        seg_lock(fd, F_UNLCK, seg->role == SEG_PRODUCER ? 1 : 0, 1, 0);
+        if (tag && fresh) fprintf(stderr, "[%s] created durable ring '%s'\n", tag, path);
+        else if (tag) fprintf(stderr, "[%s] recovered durable ring '%s' at offset %llu (in=%llu)\n", tag, path,
+                     (unsigned long long)seg->shm->committed, (unsigned long long)seg->shm->in);
+        return 0;
+    }
+
+    // Phía bên kia đang chạy: chỉ giữ byte của mình (mỗi vai trò tối đa một process).
+    if (seg_lock(fd, F_WRLCK, seg->role, 1, 0) == -1) {
+        fprintf(stderr, "[%s] ring '%s' already has a %s attached\n", tag ? tag : "segment", path,
+                seg->role == SEG_PRODUCER ? "writer" : "reader");
+        return -1;
+    }
+    struct stat st;
+    for (int i = 0; i <= wait_secs * 100; ++i) {
+        if (fstat(fd, &st) == -1) { perror("fstat"); return -1; }
+        if ((size_t)st.st_size >= sizeof(Shared)) break;
+        usleep(10 * 1000);
+    }
+    if ((size_t)st.st_size < sizeof(Shared)) {
+        fprintf(stderr, "Ring file size too small.\n");
+        return -1;
+    }
+    seg->shm = (Shared*)mmap(NULL, sizeof(Shared), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg->shm == MAP_FAILED) { perror("mmap"); return -1; }
+    if (seg_wait_ready(seg->shm, wait_secs) == -1) return -1;
+    seg_resync(seg);
+    if (tag) fprintf(stderr, "[%s] attached to durable ring '%s' at offset %llu\n", tag, path,
+            (unsigned long long)(seg->role == SEG_PRODUCER ? seg->shm->in : seg->shm->out));
+    return 0;
+}
+
+// Đặt nhóm sở hữu rồi đúng quyền (không phụ thuộc umask) cho object vừa tạo.
+// fchown trước: đổi nhóm có thể xóa bit setgid của mode đã đặt.
+static inline int seg_set_perm(int fd, unsigned mode, const char* group) {
+    if (group) {
+        struct group* gr = getgrnam(group);
+        if (!gr) { fprintf(stderr, "Unknown group '%s'\n", group); return -1; }
+        if (fchown(fd, (uid_t)-1, gr->gr_gid) == -1) { perror("fchown"); return -1; }
+    }
+    if (fchmod(fd, mode) == -1) { perror("fchmod"); return -1; }
+    return 0;
+}
+
+// Chờ creator ftruncate xong, tránh mmap vùng chưa có (SIGBUS).
+static inline int seg_wait_size(int fd, size_t size, int wait_secs) {
+    for (int i = 0; i <= wait_secs * 100; ++i) {
+        struct stat st;
+        if (fstat(fd, &st) == -1) { perror("fstat"); return -1; }
+        if ((size_t)st.st_size == size) return 0;
+        if ((size_t)st.st_size > size) break;
+        usleep(10 * 1000);
+    }
+    fprintf(stderr, "SHM size mismatch (segment from another build? run ./cleanup).\n");
+    return -1;
+}
+
+static inline int seg_data_name(char* out, size_t n, const char* name) {
+    if ((size_t)snprintf(out, n, "%s" SEG_DATA_SUFFIX, name) < n) return 0;
+    fprintf(stderr, "SHM name too long: %s\n", name);
+    return -1;
+}
+
+// Xóa tên cả hai object (vùng dữ liệu có thể không có, vd. tên arena). Kernel giải
+// phóng khi không còn process nào giữ mmap/FD.
+static inline int seg_unlink(const char* name) {
+    char data_name[256];
+    if (seg_data_name(data_name, sizeof(data_name), name) == -1) return -1;
+    int rc = shm_unlink(name);
+    int e = errno;
+    if (shm_unlink(data_name) == -1 && errno != ENOENT && rc == 0) return -1;
+    errno = e;
+    return rc;
+}
+
+// Giữ chỗ sizeof(Shared) byte địa chỉ liên tục rồi map vùng điều khiển và vùng dữ
+// liệu nối tiếp nhau vào đó, nên mọi code dùng Shared* không cần biết có hai object.
+static inline Shared* seg_map_split(int ctl_fd, int ctl_prot, int data_fd, int data_prot) {
+    char* base = (char*)mmap(NULL, sizeof(Shared), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) return (Shared*)MAP_FAILED;
+    if (mmap(base, SHM_DATA_OFF, ctl_prot, MAP_SHARED | MAP_FIXED, ctl_fd, 0) == MAP_FAILED
+        || mmap(base + SHM_DATA_OFF, SHM_DATA_SIZE, data_prot, MAP_SHARED | MAP_FIXED, data_fd, 0) == MAP_FAILED) {
+        int e = errno;
+        munmap(base, sizeof(Shared));
+        errno = e;
+        return (Shared*)MAP_FAILED;
+    }
+    return (Shared*)base;
+}
+
+// Observer (shmstat, GUI): map cả hai vùng PROT_READ, chỉ cần quyền đọc.
+// Trả về NULL nếu lỗi (errno giữ nguyên, what = tên thao tác lỗi).
+static inline const Shared* seg_map_observer(const char* name, const char** what) {
+    char data_name[256];
+    *what = "shm_open";
+    if (seg_data_name(data_name, sizeof(data_name), name) == -1) { errno = ENAMETOOLONG; return NULL; }
+    int cfd = shm_open(name, O_RDONLY, 0);
+    if (cfd < 0) return NULL;
+    int dfd = shm_open(data_name, O_RDONLY, 0);
+    if (dfd < 0) { int e = errno; close(cfd); errno = e; return NULL; }
+    struct stat cst, dst;
+    Shared* shm = NULL;
+    *what = "segment size";
+    if (fstat(cfd, &cst) == 0 && fstat(dfd, &dst) == 0
+        && (size_t)cst.st_size == SHM_DATA_OFF && (size_t)dst.st_size == SHM_DATA_SIZE) {
+        *what = "mmap";
+        shm = seg_map_split(cfd, PROT_READ, dfd, PROT_READ);
+        if (shm == (Shared*)MAP_FAILED) shm = NULL;
+    } else {
+        errno = EINVAL;
+    }
+    int e = errno;
+    close(cfd);
+    close(dfd);
+    errno = e;
+    return shm;
+}
+
+// POSIX shm: vùng điều khiển "/tên" và vùng dữ liệu "/tên.data". Producer cần
+// quyền ghi cả hai; consumer ghi vùng điều khiển, chỉ đọc vùng dữ liệu.
+static inline int seg_open_shm(Segment* seg, const SegConfig* cfg) {
+    const char* name = cfg->name;
+    const char* tag = cfg->tag;
+    int wait_secs = cfg->wait_secs;
+    int shmfd = -1, datafd = -1;
+    char data_name[256];
+    if (seg_data_name(data_name, sizeof(data_name), name) == -1) return -1;
+    if (seg->role == SEG_PRODUCER) {
+        // Mở/khởi tạo shared memory (tạo mới nếu chưa có)
+        shmfd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (shmfd >= 0) {
+            seg->creator = 1;
+        } else if (errno == EEXIST) {
+            shmfd = shm_open(name, O_RDWR, 0);
+            if (shmfd < 0) { perror("shm_open existing"); return -1; }
+        } else {
+            perror("shm_open");
+            return -1;
+        }
+    } else {
+        // Chờ SHM xuất hiện (nếu chưa có)
+        for (int i = 0; i <= wait_secs * 10; ++i) { // mỗi 100ms
+            shmfd = shm_open(name, O_RDWR, 0);
+            if (shmfd >= 0) break;
+            if (errno != ENOENT && errno != EACCES) { perror("shm_open"); return -1; } // EACCES: như vùng dữ liệu
+            usleep(100 * 1000);
+        }
+        if (shmfd < 0) {
+            if (errno == EACCES) perror("shm_open");
+            else fprintf(stderr, "Timed out waiting for SHM '%s'\n", name);
+            return -1;
+        }
+    }
+    seg->fd = shmfd;
+
+    int data_flags = seg->role == SEG_PRODUCER ? O_RDWR : O_RDONLY;
+    if (seg->creator) {
+        // Thứ tự: tạo cả hai object với O_EXCL và 0600 (chỉ chủ mở được), đặt nhóm
+        // và quyền cuối cùng, rồi mới ftruncate. Object không bao giờ có quyền
+        // rộng hơn lúc đã xong, và không ai giữ được FD mở từ lúc quyền chưa đúng.
+        // Consumer chờ kích thước (seg_wait_size) nên không map object chưa xong.
+        datafd = shm_open(data_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (datafd < 0 && errno == EEXIST) {
+            // Vùng dữ liệu cũ (creator trước chết giữa chừng): bỏ tên, tạo inode mới
+            // thay vì dùng lại object mà process khác có thể đang giữ FD
+            if (shm_unlink(data_name) == -1 && errno != ENOENT) { perror("shm_unlink data"); return -1; }
+            datafd = shm_open(data_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (datafd < 0) { perror("shm_open data"); return -1; }
+        if (seg_set_perm(shmfd, cfg->mode ? cfg->mode : SEG_MODE, cfg->group) == -1
+            || seg_set_perm(datafd, cfg->data_mode ? cfg->data_mode : SEG_DATA_MODE, cfg->group) == -1) {
+            close(datafd);
+            return -1;
+        }
+        if (ftruncate(datafd, SHM_DATA_SIZE) == -1 || ftruncate(shmfd, SHM_DATA_OFF) == -1) {
+            perror("ftruncate");
+            close(datafd);
+            return -1;
+        }
+    } else {
+        // Creator tạo vùng dữ liệu ngay sau vùng điều khiển. EACCES: creator chưa
+        // kịp đặt quyền cuối cùng (object vừa tạo là 0600), thử lại trong lúc chờ.
+        for (int i = 0; i <= (wait_secs > 0 ? wait_secs : 1) * 100; ++i) {
+            datafd = shm_open(data_name, data_flags, 0);
+            if (datafd >= 0 || (errno != ENOENT && errno != EACCES)) break;
+            usleep(10 * 1000);
+        }
+        if (datafd < 0) { perror("shm_open data"); return -1; }
+        int ws = wait_secs > 0 ? wait_secs : 1;
+        if (seg_wait_size(shmfd, SHM_DATA_OFF, ws) == -1 || seg_wait_size(datafd, SHM_DATA_SIZE, ws) == -1) {
+            close(datafd);
+            return -1;
+        }
+    }
+
+    seg->shm = seg_map_split(shmfd, PROT_READ|PROT_WRITE, datafd,
+                             seg->role == SEG_PRODUCER ? PROT_READ|PROT_WRITE : PROT_READ);
+    close(datafd);
+    if (seg->shm == MAP_FAILED) { perror("mmap"); return -1; }
+
+    if (seg->creator) {
+        if (seg_init_sems(seg->shm, 1, 0, cfg->base_offset) == -1) return -1;
+        if (tag) fprintf(stderr, "[%s] created and initialized SHM '%s'\n", tag, name);
+    } else {
+        if (seg_wait_ready(seg->shm, wait_secs > 0 ? wait_secs : 1) == -1) return -1;
+        if (tag && seg->role == SEG_PRODUCER) fprintf(stderr, "[%s] attached to existing SHM '%s'\n", tag, name);
+    }
+    return 0;
+}
+
+// Producer tạo kênh nếu chưa có (và tạo cả arena nếu cần); consumer chờ kênh xuất hiện.
+static inline int seg_open_arena(Segment* seg, const SegConfig* cfg) {
+    char arena[256], chan[ARENA_NAME_MAX];
+    const char* tag = cfg->tag;
+    if (!arena_split(cfg->name, arena, sizeof(arena), chan, sizeof(chan))) return -1;
+    if (strlen(strchr(cfg->name, ':') + 1) >= ARENA_NAME_MAX) {
+        fprintf(stderr, "Channel name too long (max %d): %s\n", ARENA_NAME_MAX - 1, cfg->name);
+        return -1;
+    }
+    seg->arena = arena_attach(arena, seg->role == SEG_PRODUCER, cfg->wait_secs, tag);
+    if (!seg->arena) return -1;
+    ArenaHeader* h = seg->arena->h;
+
+    ArenaDirEntry* e = NULL;
+    if (seg->role == SEG_PRODUCER) {
+        e = arena_create(h, chan, &seg->creator);
+        if (!e) { fprintf(stderr, "arena '%s' full (max %u channels)\n", arena, h->nblocks); return -1; }
+    } else {
+        for (int i = 0; i <= cfg->wait_secs * 10 && !(e = arena_lookup(h, chan)); ++i) // mỗi 100ms
+            usleep(100 * 1000);
+        if (!e) {
+            fprintf(stderr, "Timed out waiting for channel '%s'\n", cfg->name);
+            return -1;
+        }
+    }
+    seg->shm = arena_block(h, e->block);
+
+    if (seg->creator) {
+        if (seg_init_sems(seg->shm, 1, 0, cfg->base_offset) == -1) return -1;
+        if (tag) fprintf(stderr, "[%s] created channel '%s' (%u/%u in arena)\n", tag, cfg->name,
+                         __atomic_load_n(&h->channels, __ATOMIC_RELAXED), h->nblocks);
+    } else {
+        if (seg_wait_ready(seg->shm, cfg->wait_secs > 0 ? cfg->wait_secs : 1) == -1) return -1;
+        if (tag && seg->role == SEG_PRODUCER) fprintf(stderr, "[%s] attached to existing channel '%s'\n", tag, cfg->name);
+    }
+    return 0;
+}
+
+// Broker đã tạo và khởi tạo vòng đệm: chỉ cần nhận fd và mmap, không phải chờ.
+static inline int seg_open_memfd(Segment* seg, const SegConfig* cfg) {
+    int role = seg->role == SEG_PRODUCER ? MB_ROLE_PRODUCER : MB_ROLE_CONSUMER;
+    seg->fd = mb_request(cfg->name + 1, role, cfg->base_offset, &seg->broker, &seg->creator);
+    if (seg->fd < 0) return -1;
+    struct stat st;
+    if (fstat(seg->fd, &st) == -1) { perror("fstat"); return -1; }
+    if ((size_t)st.st_size < sizeof(Shared)) {
+        fprintf(stderr, "SHM size too small.\n");
+        return -1;
+    }
+    seg->shm = (Shared*)mmap(NULL, sizeof(Shared), PROT_READ|PROT_WRITE, MAP_SHARED, seg->fd, 0);
+    if (seg->shm == MAP_FAILED) { perror("mmap"); return -1; }
+    if (seg_wait_ready(seg->shm, 1) == -1) return -1;
+    if (cfg->tag) fprintf(stderr, "[%s] %s broker ring '%s'\n", cfg->tag,
+                          seg->creator ? "created" : "attached to", cfg->name);
+    return 0;
+}
+
+// Trả về 0 nếu thành công, -1 nếu lỗi (đã in thông báo).
+static inline int seg_open(Segment* seg, const SegConfig* cfg) {
+    memset(seg, 0, sizeof(*seg));
+    seg->fd = -1;
+    seg->broker = -1;
+    seg->role = cfg->role;
+    seg->durable = cfg->durable;
+    int rc = cfg->durable ? seg_open_durable(seg, cfg)
+           : cfg->name[0] == '@' ? seg_open_memfd(seg, cfg)
+           : strchr(cfg->name, ':') ? seg_open_arena(seg, cfg)
+           : seg_open_shm(seg, cfg);
+    if (rc == -1 && seg->shm == MAP_FAILED) seg->shm = NULL;
+    return rc;
+}
+
+// Ghi xuống đĩa trạng thái hiện tại (chỉ có ý nghĩa với durable).
+static inline int seg_checkpoint(Segment* seg) {
+    if (!seg->durable) return 0;
+    if (msync(seg->shm, sizeof(Shared), MS_SYNC) == -1) { perror("msync"); return -1; }
+    return 0;
+}
+
+// Reader: commit các bản ghi đã xử lý (output phải được flush trước khi gọi).
+// Thứ tự: ghi committed, msync, rồi mới công bố released và post empty. released
+// là thứ writer (kể cả writer vừa gắn lại, seg_resync) dùng để biết ô nào được
+// ghi đè, nên không ô nào bị trả trước khi offset commit đã nằm trên đĩa; sau
+// crash các bản ghi chưa commit vẫn còn nguyên trong file để giao lại.
+static inline int ring_commit(Segment* seg) {
+    Shared* shm = seg->shm;
+    if (!seg->durable) return 0;
+    if (sem_wait(&shm->mutex) == -1) return -1;
+    uint64_t upto = shm->out;
+    uint64_t n = upto - shm->released;
+    if (n) {
+        shm->committed = upto;
+        // Mốc seq đi cùng offset commit: reader lùi về đây thì nhận ra bản lặp như trước
+        memcpy(shm->seq_marks_committed, shm->seq_marks, sizeof(shm->seq_marks));
+        shm->seq_nmarks_committed = shm->seq_nmarks;
+    }
+    sem_post(&shm->mutex);
+    if (n == 0) return 0;
+    if (seg_checkpoint(seg) == -1) return -1;
+    if (sem_wait(&shm->mutex) == -1) return -1;
+    shm_seq_write_begin(shm);
+    shm->released = upto;
+    shm_seq_write_end(shm);
+    sem_post(&shm->mutex);
+    for (uint64_t i = 0; i < n; ++i) sem_post(&shm->empty);
+    return 0;
+}
+
+static inline void seg_close(Segment* seg) {
+    if (seg->arena) arena_detach(seg->arena);
+    else if (seg->shm) munmap(seg->shm, sizeof(Shared));
+    seg->arena = NULL;
+    if (seg->fd >= 0) close(seg->fd);
+    if (seg->broker >= 0) close(seg->broker); // broker nhả vòng đệm khi kết nối cuối đóng
+    seg->shm = NULL;
+    seg->fd = -1;
+    seg->broker = -1;
+}
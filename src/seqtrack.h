@@ -0,0 +1,115 @@
+#pragma once
+// seqtrack.h — phát hiện mất/lặp bản ghi theo từng producer ở phía reader.
+//
+// Writer đóng dấu mọi bản ghi vòng đệm chính (REC_F_SEQ): producer (--producer,
+// 0 = không đặt), epoch (tăng mỗi lần một writer khởi động trên segment) và seq
+// 64 bit = thứ tự bản ghi trong input, bắt đầu từ 1. Writer có --producer khởi
+// động lại và đọc lại input từ đầu sẽ gửi lại đúng các seq cũ: reader thấy seq
+// nhỏ hơn seq mong đợi là bản lặp (--dedup thì bỏ), seq lớn hơn là có lỗ.
+// Writer không có --producer được theo dõi riêng theo từng epoch.
+// Việc so seq làm trong ring_pop với mốc chung của vòng đệm (seq_mark, shared.h)
+// nên nhiều reader tranh nhau lấy không thấy lỗ giả; ở đây reader chỉ đọc kết quả
+// (meta->seq_note), đếm riêng phần mình thấy và in báo cáo. Bộ đếm tổng nằm trong
+// shm->stats (ring_pop cộng một lần mỗi bản ghi) để shmstat xem được.
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "shared.h"
+
+#define SEQ_TRACK_MAX 64 // số producer theo dõi cùng lúc, đầy thì bỏ producer lâu không gặp nhất
+#define SEQ_GAP_LOG_BURST 8 // số lỗ in từng dòng; sau đó tối đa một dòng tổng hợp mỗi giây
+
+typedef struct {
+    uint32_t producer;
+    uint32_t epoch;    // epoch mới nhất đã thấy
+    uint64_t next;     // seq mong đợi kế tiếp
+    uint64_t records;  // bản ghi nhận đúng thứ tự
+    uint64_t missing;  // số seq bị nhảy qua
+    uint64_t dups;     // số bản ghi lặp (seq < next)
+    uint32_t restarts; // số lần epoch tăng (producer có --producer)
+    uint64_t last_use;
+} SeqProducer;
+
+typedef struct {
+    int dedup;      // 1: bản ghi lặp không được giao cho caller
+    unsigned gap_lines;          // số dòng báo lỗ đã in riêng
+    uint64_t held_gaps, held_missing; // lỗ chưa in (đang gom cho dòng tổng hợp)
+    int64_t held_sec;            // giây (CLOCK_MONOTONIC) của dòng tổng hợp gần nhất
+    uint64_t tick;
+    unsigned n;
+    SeqProducer p[SEQ_TRACK_MAX];
+} SeqTrack;
+
+static inline SeqProducer* seq_slot(SeqTrack* t, const RecMeta* meta) {
+    SeqProducer* lru = NULL;
+    for (unsigned i = 0; i < t->n; ++i) {
+        SeqProducer* sp = &t->p[i];
+        if (sp->producer == meta->producer && (meta->producer != 0 || sp->epoch == meta->epoch)) return sp;
+        if (!lru || sp->last_use < lru->last_use) lru = sp;
+    }
+    SeqProducer* sp = t->n < SEQ_TRACK_MAX ? &t->p[t->n++] : lru;
+    memset(sp, 0, sizeof(*sp));
+    sp->producer = meta->producer;
+    sp->epoch = meta->epoch;
+    sp->next = meta->seq; // gặp lần đầu (reader đến sau writer): nhận làm mốc
+    return sp;
+}
+
+static inline void seq_log_gap(SeqTrack* t, const SeqProducer* sp, const RecMeta* meta, uint64_t gap) {
+    if (t->gap_lines < SEQ_GAP_LOG_BURST) {
+        fprintf(stderr, "[reader] producer %u epoch %u: gap, expected seq %llu, got %llu (%llu missing)%s\n",
+                sp->producer, meta->epoch, (unsigned long long)(meta->seq - gap), (unsigned long long)meta->seq,
+                (unsigned long long)gap, ++t->gap_lines == SEQ_GAP_LOG_BURST ? "; further gaps summarized per second" : "");
+        return;
+    }
+    t->held_gaps++;
+    t->held_missing += gap;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    if ((int64_t)ts.tv_sec == t->held_sec) return;
+    fprintf(stderr, "[reader] %llu more gap(s), %llu seq missing\n", (unsigned long long)t->held_gaps,
+            (unsigned long long)t->held_missing);
+    t->held_sec = (int64_t)ts.tv_sec;
+    t->held_gaps = t->held_missing = 0;
+}
+
+// Kiểm tra một bản ghi vừa lấy khỏi vòng đệm (meta->seq_note do ring_pop điền).
+// Trả về 1 nếu caller phải bỏ nó (bản lặp và t->dedup), 0 nếu giao bình thường.
+static inline int seq_check(SeqTrack* t, Shared* shm, const RecMeta* meta) {
+    if (!(meta->flags & REC_F_SEQ)) return 0;
+    SeqProducer* sp = seq_slot(t, meta);
+    sp->last_use = ++t->tick;
+    if (meta->seq_note & SEQ_NOTE_RESTART) {
+        fprintf(stderr, "[reader] producer %u restarted (epoch %u), seq %llu\n",
+                sp->producer, meta->epoch, (unsigned long long)meta->seq);
+        sp->restarts++;
+    }
+    if (meta->epoch > sp->epoch) sp->epoch = meta->epoch;
+    if (meta->seq_note & SEQ_NOTE_DUP) {
+        sp->dups++;
+        if (!t->dedup) return 0;
+        shm_stat_add(&shm->stats.seq_skipped, 1);
+        return 1;
+    }
+    uint64_t gap = meta->seq_note & SEQ_NOTE_GAP;
+    if (gap) {
+        seq_log_gap(t, sp, meta, gap);
+        sp->missing += gap;
+    }
+    if (meta->seq >= sp->next) sp->next = meta->seq + 1;
+    sp->records++;
+    return 0;
+}
+
+static inline void seq_report(const SeqTrack* t, const char* who) {
+    if (t->held_gaps)
+        fprintf(stderr, "[%s] %llu more gap(s), %llu seq missing\n", who, (unsigned long long)t->held_gaps,
+                (unsigned long long)t->held_missing);
+    for (unsigned i = 0; i < t->n; ++i) {
+        const SeqProducer* sp = &t->p[i];
+        fprintf(stderr, "[%s] producer %u epoch %u: %llu record(s), last seq %llu, %llu missing, %llu duplicate(s)%s, %u restart(s)\n",
+                who, sp->producer, sp->epoch, (unsigned long long)sp->records, (unsigned long long)(sp->next - 1),
+                (unsigned long long)sp->missing, (unsigned long long)sp->dups, t->dedup && sp->dups ? " skipped" : "",
+                sp->restarts);
+    }
+}
@@ -1,16 +1,541 @@
-#pragma once 
+#pragma once
 #include <semaphore.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "probes.h"
 
 #define SHM_NAME "/shm_file_demo"
 #define CAP 4
 #define MSG_MAX 128
-#define END_TOKEN "END"
+
+#define SHM_MAGIC 0x53484d31u // "SHM1", ghi sau cùng khi khởi tạo xong
+#define SHM_F_DURABLE 0x1u    // vòng đệm nằm trong file, ô chỉ trả lại khi reader checkpoint
+#define CKPT_EVERY 64          // mặc định: checkpoint durable sau mỗi 64 bản ghi
+
+// Từ điều khiển Shared.ctl, ngoài luồng dữ liệu (stream.h)
+#define SHM_CTL_DRAIN 0x1u    // mọi producer đã kết thúc: consumer lấy nốt rồi nhận RING_EOS
+#define RING_EOS 2            // ring_pop: vòng đệm đã cạn và luồng đã kết thúc
+
+#define REC_F_CRC 0x1u // meta.crc là CRC32C của payload
+#define REC_F_TAGGED 0x2u // payload là "tên_nguồn\tdòng", meta.src là số hiệu nguồn (writer -t)
+#define REC_F_FRAME 0x4u        // payload là một mảnh của frame nén nhiều bản ghi (lzframe.h)
+#define REC_F_FRAME_FIRST 0x8u  // mảnh đầu của frame
+#define REC_F_FRAME_LAST 0x10u  // mảnh cuối của frame
+#define REC_F_REF 0x20u         // payload là DictRef tới bảng intern (writer -d); ring_pop đã
+                                // thay bằng nội dung thật, còn cờ này nghĩa là không tra được
+#define REC_F_SEQ 0x40u         // meta.producer/epoch/seq hợp lệ (seqtrack.h)
+
+// Làn ưu tiên: ngoài vòng đệm chính (làn 0, dữ liệu hàng loạt) còn PRIO_LANES làn
+// nhỏ cho bản ghi khẩn, số làn lớn hơn được ưu tiên hơn. Làn ưu tiên không có
+// offset log/durable: chỉ dành cho thông điệp điều khiển ngắn (writer -p/-P).
+#define PRIO_LANES 3
+#define LANE_CAP 4
+
+// Tín dụng producer: mỗi writer chiếm một ô và chỉ được có tối đa
+// ceil(CAP / số writer) bản ghi chưa được reader lấy, nên một writer ồn ào
+// không chiếm hết vòng đệm của các writer khác (flowctl.h).
+#define MAX_PRODUCERS 16
+
+typedef struct {
+    int pid;           // 0 = ô trống
+    uint32_t gen;      // tăng mỗi lần ô được chiếm lại; bản ghi của chủ cũ không trả nhầm tín dụng
+    uint64_t inflight; // số bản ghi đã đẩy mà reader chưa lấy
+    uint64_t sent;     // tổng số bản ghi đã đẩy
+    uint64_t waits;    // số lần phải chờ vì hết tín dụng
+} ProducerSlot;
+
+// Bảng intern: dòng lặp lại được writer ghi một lần vào đây, sau đó chỉ gửi DictRef.
+#define DICT_SLOTS 256  // lũy thừa của 2
+#define DICT_PROBE 8    // số ô dò tuyến tính tối đa
+
+// Metadata của từng ô, song song với buf
+typedef struct {
+    uint32_t len;   // độ dài payload (không tính '\0')
+    uint32_t crc;   // CRC32C của payload nếu REC_F_CRC
+    uint32_t flags; // REC_F_*
+    uint32_t src;   // số hiệu nguồn nếu REC_F_TAGGED (0: một nguồn)
+    uint32_t prod;  // tín dụng của producer: (gen << 8) | (ô + 1), 0 nếu không dùng (flowctl.h)
+    uint32_t producer; // REC_F_SEQ: số hiệu writer --producer (0: không đặt)
+    uint32_t epoch;    // REC_F_SEQ: lần khởi động của writer (Shared.producer_epoch)
+    uint32_t seq_note; // REC_F_SEQ, chỉ trong bản sao ring_pop trả về: SEQ_NOTE_* (writer để 0)
+    uint64_t seq;      // REC_F_SEQ: thứ tự bản ghi của producer, từ 1
+} RecMeta;
+
+// RecMeta.seq_note: kết quả so seq với mốc chung của vòng đệm (Shared.seq_marks)
+#define SEQ_NOTE_DUP     0x80000000u // seq đã được consumer nào đó lấy
+#define SEQ_NOTE_RESTART 0x40000000u // producer --producer vừa khởi động lại (epoch tăng)
+#define SEQ_NOTE_GAP     0x3fffffffu // số seq bị nhảy qua ngay trước bản ghi này (bão hòa)
+
+// Mốc seq đã lấy của một producer (theo producer, hoặc theo epoch nếu producer = 0).
+// Cập nhật trong mutex của ring_pop nên mọi consumer cùng thấy một thứ tự: reader
+// tranh nhau lấy không thấy lỗ giả ở phần do reader khác lấy.
+#define SEQ_MARKS 32
+
+typedef struct {
+    uint32_t producer, epoch;
+    uint64_t next;     // seq kế tiếp mong đợi
+    uint64_t last_use;
+} SeqMark;
+
+typedef struct {
+    uint32_t idx, gen;
+} DictRef;
+
+// Chỉ writer ghi (seqlock từng ô), reader đọc không khóa. Writer chỉ ghi đè ô khi
+// mọi bản ghi tham chiếu tới nó đã được trả (last_ref <= released), nên ô không
+// đổi trong lúc còn tham chiếu nằm trong vòng đệm; gen/seq chỉ để phát hiện lỗi.
+typedef struct {
+    unsigned seq;      // lẻ = đang ghi
+    uint32_t gen;      // tăng mỗi lần ghi đè (0 = ô trống)
+    uint32_t hash;     // CRC32C của data
+    uint32_t len;
+    uint64_t last_ref; // offset + 1 của bản ghi tham chiếu gần nhất (chỉ writer dùng)
+    char data[MSG_MAX];
+} DictEntry;
+
+// Bộ đếm dùng chung, cập nhật bằng atomic để observer đọc được bất cứ lúc nào
+typedef struct {
+    uint64_t crc_errors; // số bản ghi sai checksum (reader đã cách ly)
+    uint64_t lz_raw_bytes, lz_wire_bytes; // writer -z: byte frame trước/sau nén
+    uint64_t dict_refs;       // writer -d: số bản ghi gửi dạng tham chiếu
+    uint64_t dict_saved;      // byte payload không phải chép qua vòng đệm
+    uint64_t dict_misses;     // reader không tra được tham chiếu (không được xảy ra)
+    uint64_t lane_pops[PRIO_LANES]; // số bản ghi reader đã lấy từ làn ưu tiên 1..PRIO_LANES
+    uint64_t seq_missing;  // reader: số seq bị nhảy qua (seqtrack.h)
+    uint64_t seq_dups;     // reader: số bản ghi lặp lại seq đã giao
+    uint64_t seq_skipped;  // reader --dedup: số bản ghi lặp đã bỏ
+    uint64_t seq_restarts; // reader: số lần một producer khởi động lại (epoch tăng)
+} ShmStats;
+
+// Một làn ưu tiên: vòng đệm nhỏ riêng, dùng chung mutex và semaphore full với
+// vòng đệm chính (full đếm bản ghi của mọi làn), có semaphore ô trống riêng.
+// Phần điều khiển nằm trong Lane, ô dữ liệu nằm trong LaneSlots (vùng dữ liệu).
+typedef struct {
+    sem_t empty;
+    uint64_t in, out;
+} Lane;
 
 typedef struct {
-    sem_t empty; // số ô trống 
+    RecMeta meta[LANE_CAP];
+    char buf[LANE_CAP][MSG_MAX];
+} LaneSlots;
+
+// Khóa giữa các process cho các mảnh của frame nén (lzframe.h). owner: pid đang
+// giữ, để lấy lại khóa khi process đó chết giữa chừng.
+typedef struct {
+    sem_t sem;
+    int owner;
+} FrameLock;
+
+// Segment gồm vùng điều khiển (semaphore, bộ đếm, thống kê) và vùng dữ liệu (ô bản
+// ghi, bảng intern) bắt đầu ở ranh giới trang SHM_DATA_OFF. Với POSIX shm hai vùng là
+// hai object riêng (segment.h) để đặt quyền riêng: reader và observer chỉ cần quyền
+// đọc vùng dữ liệu và map nó PROT_READ.
+#define SHM_PAGE 4096
+
+typedef struct {
+    unsigned magic; // SHM_MAGIC khi đã khởi tạo xong
+    unsigned flags; // SHM_F_*
+    sem_t empty; // số ô trống
     sem_t full;  // số ô đã có dữ liệu
     sem_t mutex; // khóa vùng tới hạn
-    size_t in, out; // chỉ số vòng đệm
+    unsigned seq; // seqlock cho observer: lẻ = đang ghi, chẵn = ổn định
+    uint64_t in, out; // bộ đếm tăng dần, ô = chỉ số % CAP
+    uint64_t released; // các bản ghi < released đã trả ô cho writer
+    uint64_t committed; // durable: offset đã commit và đã msync (released chỉ đuổi theo sau đó)
+    uint64_t in_pos;   // vị trí byte trong file input ngay sau bản ghi in-1
+    uint64_t in_seq;   // seq của bản ghi REC_F_SEQ gần nhất (writer durable đánh số tiếp)
+    uint32_t producer_epoch; // tăng mỗi lần một writer khởi động (RecMeta.epoch)
+    unsigned db_armed; // consumer epoll sắp ngủ, writer cần gõ chuông (doorbell.h)
+    unsigned db_gen;   // tăng mỗi khi có consumer doorbell mới
+    ShmStats stats;
+    uint64_t lane_pending; // tổng số bản ghi đang nằm trong các làn ưu tiên
+    unsigned lane_weight[PRIO_LANES + 1]; // trọng số round-robin do reader đặt; toàn 0: ưu tiên tuyệt đối
+    unsigned lane_cur, lane_credit;       // trạng thái round-robin (trong mutex)
+    unsigned nproducers; // số ô producer đang được chiếm
+    ProducerSlot producers[MAX_PRODUCERS];
+    unsigned ctl;               // SHM_CTL_*, đổi trong mutex; futex khi bỏ DRAIN
+    int streams[MAX_PRODUCERS]; // pid của producer đang mở luồng (0 = ô trống)
+    int stream_excl;            // pid của producer cần là producer duy nhất (writer -l), 0 = không có
+    uint64_t stream_reap_ns;    // CLOCK_MONOTONIC: consumer nonblock quét producer chết lần tới (stream_reap)
+    FrameLock frame_tx;         // writer -z giữ khi đẩy các mảnh của một frame
+    FrameLock frame_rx;         // reader giữ từ mảnh FIRST tới mảnh LAST của một frame
+    SeqMark seq_marks[SEQ_MARKS]; // trong mutex
+    unsigned seq_nmarks;
+    uint64_t seq_tick;
+    SeqMark seq_marks_committed[SEQ_MARKS]; // durable: seq_marks lúc out == committed (ring_commit)
+    unsigned seq_nmarks_committed;          // reader mới lùi out về committed thì lấy lại từ đây
+    Lane lanes[PRIO_LANES];     // lanes[k-1] là làn k
+    // ---- Vùng dữ liệu: chỉ writer ghi ----
+    RecMeta meta[CAP] __attribute__((aligned(SHM_PAGE))); // metadata từng ô
     char buf[CAP][MSG_MAX]; // vòng đệm
-} Shared;
\ No newline at end of file
+    LaneSlots lane_slots[PRIO_LANES]; // ô của làn k là lane_slots[k-1]
+    DictEntry dict[DICT_SLOTS]; // bảng intern (writer -d)
+} Shared;
+
+#define SHM_DATA_OFF offsetof(Shared, meta)
+#define SHM_DATA_SIZE (sizeof(Shared) - SHM_DATA_OFF)
+
+// ---- Seqlock ----
+// writer/reader gọi begin/end quanh mọi thay đổi in/out/buf (đã nằm trong mutex,
+// nên chỉ có một bên ghi seq tại một thời điểm). Observer (GUI, shmstat, debugger)
+// chỉ đọc: không ghi vào segment, không chờ semaphore nên không làm chậm ai.
+
+static inline void shm_seq_write_begin(Shared* shm) {
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void shm_seq_write_end(Shared* shm) {
+    __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Bản chụp nhất quán của vòng đệm
+typedef struct {
+    unsigned seq;
+    uint64_t in, out;
+    char buf[CAP][MSG_MAX];
+} ShmSnapshot;
+
+// Thử tối đa max_tries lần; trả về 1 nếu chụp được bản nhất quán, 0 nếu writer
+// liên tục ghi đè (khi đó out giữ bản cuối cùng, có thể bị rách).
+static inline int shm_snapshot(const Shared* shm, ShmSnapshot* out, int max_tries) {
+    for (int i = 0; i < max_tries; ++i) {
+        unsigned s1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        out->in = shm->in;
+        out->out = shm->out;
+        memcpy(out->buf, (const void*)shm->buf, sizeof(out->buf));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        unsigned s2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+        out->seq = s1;
+        if (!(s1 & 1u) && s1 == s2) return 1;
+    }
+    return 0;
+}
+
+// ---- Thao tác vòng đệm ----
+// Giá trị semaphore chỉ là gợi ý đánh thức: sau khi một bên chết giữa chừng và
+// được đồng bộ lại (xem segment.h), có thể có token thừa. Điều kiện thật được
+// kiểm tra lại trong mutex bằng in/out/released, token thừa thì bỏ qua.
+
+static inline void shm_stat_add(uint64_t* counter, uint64_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+// Đẩy một message; meta->len là độ dài msg (cắt còn MSG_MAX-1), crc/flags do
+// caller tính trước, ngoài vùng tới hạn. in_pos: vị trí input ngay sau message.
+// Trả về 0 nếu thành công, -1 nếu sem_wait lỗi (errno giữ nguyên).
+// stop: như shm_sem_wait_stop, để writer dừng được khi vòng đệm đầy mà không còn reader.
+static inline int ring_push_stop(Shared* shm, const RecMeta* meta, const char* msg, uint64_t in_pos,
+                                 const volatile sig_atomic_t* stop) {
+    uint32_t len = meta->len < MSG_MAX ? meta->len : MSG_MAX-1;
+    for (;;) {
+        if (shm_sem_wait_stop(&shm->empty, SHM_SEM_EMPTY, shm, stop) == -1) return -1;
+        if (shm_sem_wait(&shm->mutex, SHM_SEM_MUTEX, shm) == -1) return -1;
+        if (shm->in - shm->released >= CAP) { sem_post(&shm->mutex); continue; }
+
+        shm_seq_write_begin(shm);
+        uint64_t off = shm->in;
+        size_t i = off % CAP;
+        memcpy(shm->buf[i], msg, len);
+        shm->buf[i][len] = '\0';
+        shm->meta[i] = *meta;
+        shm->meta[i].len = len;
+        shm->in_pos = in_pos;
+        if (meta->flags & REC_F_SEQ) shm->in_seq = meta->seq;
+        shm->in++;
+        shm_seq_write_end(shm);
+
+        sem_post(&shm->mutex);
+        sem_post(&shm->full);
+        SHM_PROBE(publish, off, len, 0);
+        return 0;
+    }
+}
+
+static inline int ring_push(Shared* shm, const RecMeta* meta, const char* msg, uint64_t in_pos) {
+    return ring_push_stop(shm, meta, msg, in_pos, NULL);
+}
+
+// Đẩy một message vào làn ưu tiên lane (1..PRIO_LANES). Không đổi in/in_pos nên
+// không chiếm offset của vòng đệm chính (log, durable).
+static inline int ring_push_lane_stop(Shared* shm, unsigned lane, const RecMeta* meta, const char* msg,
+                                      const volatile sig_atomic_t* stop) {
+    Lane* l = &shm->lanes[lane - 1];
+    LaneSlots* ls = &shm->lane_slots[lane - 1];
+    uint32_t len = meta->len < MSG_MAX ? meta->len : MSG_MAX-1;
+    for (;;) {
+        if (shm_sem_wait_stop(&l->empty, SHM_SEM_LANE, shm, stop) == -1) return -1;
+        if (shm_sem_wait(&shm->mutex, SHM_SEM_MUTEX, shm) == -1) return -1;
+        if (l->in - l->out >= LANE_CAP) { sem_post(&shm->mutex); continue; }
+
+        uint64_t off = l->in;
+        size_t i = off % LANE_CAP;
+        memcpy(ls->buf[i], msg, len);
+        ls->buf[i][len] = '\0';
+        ls->meta[i] = *meta;
+        ls->meta[i].len = len;
+        l->in++;
+        shm->lane_pending++;
+
+        sem_post(&shm->mutex);
+        sem_post(&shm->full);
+        SHM_PROBE(publish, off, len, lane);
+        return 0;
+    }
+}
+
+static inline int ring_push_lane(Shared* shm, unsigned lane, const RecMeta* meta, const char* msg) {
+    return ring_push_lane_stop(shm, lane, meta, msg, NULL);
+}
+
+// Không còn bản ghi nào ở vòng đệm chính lẫn các làn ưu tiên.
+static inline int shm_drained(const Shared* shm) {
+    return __atomic_load_n(&shm->out, __ATOMIC_ACQUIRE) == __atomic_load_n(&shm->in, __ATOMIC_ACQUIRE)
+        && __atomic_load_n(&shm->lane_pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+static inline int lane_ready(const Shared* shm, unsigned lane) {
+    return lane == 0 ? shm->out != shm->in : shm->lanes[lane - 1].in != shm->lanes[lane - 1].out;
+}
+
+// Chọn làn để lấy bản ghi kế tiếp (gọi trong mutex); -1 nếu mọi làn rỗng.
+// Mặc định ưu tiên tuyệt đối. Có trọng số thì round-robin từ làn cao xuống làn 0,
+// mỗi lượt một làn lấy tối đa lane_weight[làn] bản ghi rồi nhường làn sau.
+static inline int lane_pick(Shared* shm) {
+    if (shm->lane_pending == 0) return shm->out != shm->in ? 0 : -1;
+    if (shm->lane_weight[0] != 0) {
+        for (unsigned n = 0; n <= 2 * (PRIO_LANES + 1); ++n) {
+            unsigned k = shm->lane_cur;
+            if (shm->lane_credit > 0 && lane_ready(shm, k)) {
+                shm->lane_credit--;
+                return (int)k;
+            }
+            shm->lane_cur = k == 0 ? PRIO_LANES : k - 1;
+            shm->lane_credit = shm->lane_weight[shm->lane_cur];
+        }
+    }
+    for (int k = PRIO_LANES; k >= 0; --k)
+        if (lane_ready(shm, (unsigned)k)) return k;
+    return -1;
+}
+
+// Reader đặt chính sách lấy giữa các làn: weights = NULL là ưu tiên tuyệt đối,
+// ngược lại là trọng số round-robin của làn 0..PRIO_LANES (0 được đổi thành 1).
+static inline void ring_set_lane_weights(Shared* shm, const unsigned* weights) {
+    sem_wait(&shm->mutex);
+    for (unsigned k = 0; k <= PRIO_LANES; ++k)
+        shm->lane_weight[k] = weights ? (weights[k] ? weights[k] : 1) : 0;
+    shm->lane_cur = PRIO_LANES;
+    shm->lane_credit = shm->lane_weight[PRIO_LANES];
+    sem_post(&shm->mutex);
+}
+
+// Trả tín dụng của bản ghi vừa lấy cho producer đã đẩy nó.
+static inline void credit_return(Shared* shm, uint32_t prod) {
+    unsigned slot = (prod & 0xffu) - 1;
+    if (slot >= MAX_PRODUCERS) return;
+    ProducerSlot* ps = &shm->producers[slot];
+    if ((__atomic_load_n(&ps->gen, __ATOMIC_RELAXED) & 0xffffffu) == prod >> 8) __atomic_fetch_sub(&ps->inflight, 1, __ATOMIC_RELEASE);
+}
+
+// Thay DictRef trong msg bằng dòng trong bảng intern. Gọi trong mutex, trước khi
+// trả ô (nên writer chưa thể ghi đè ô được tham chiếu).
+static inline void dict_resolve(Shared* shm, RecMeta* meta, char* msg) {
+    DictRef ref;
+    if (meta->len == sizeof(ref)) {
+        memcpy(&ref, msg, sizeof(ref));
+        const DictEntry* e = &shm->dict[ref.idx & (DICT_SLOTS - 1)];
+        unsigned s1 = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+        uint32_t gen = e->gen, len = e->len;
+        if (len < MSG_MAX) memcpy(msg, e->data, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        unsigned s2 = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+        if (!(s1 & 1u) && s1 == s2 && gen == ref.gen && len < MSG_MAX) {
+            meta->len = len;
+            meta->flags &= ~REC_F_REF;
+            msg[len] = '\0';
+            return;
+        }
+    }
+    shm_stat_add(&shm->stats.dict_misses, 1);
+    meta->len = 0;
+    msg[0] = '\0';
+}
+
+// So seq của bản ghi vừa lấy với mốc chung, ghi kết quả vào meta->seq_note và
+// cộng thống kê (một lần cho mỗi bản ghi dù có bao nhiêu consumer). Gọi trong mutex.
+static inline void seq_mark(Shared* shm, RecMeta* meta) {
+    SeqMark* m = NULL;
+    SeqMark* lru = NULL;
+    meta->seq_note = 0;
+    for (unsigned i = 0; i < shm->seq_nmarks && i < SEQ_MARKS; ++i) {
+        SeqMark* c = &shm->seq_marks[i];
+        if (c->producer == meta->producer && (meta->producer != 0 || c->epoch == meta->epoch)) { m = c; break; }
+        if (!lru || c->last_use < lru->last_use) lru = c;
+    }
+    if (!m) {
+        // Gặp lần đầu (consumer đến sau writer, hoặc mốc cũ đã bị thay): nhận làm mốc
+        m = shm->seq_nmarks < SEQ_MARKS ? &shm->seq_marks[shm->seq_nmarks++] : lru;
+        m->producer = meta->producer;
+        m->epoch = meta->epoch;
+        m->next = meta->seq;
+    }
+    m->last_use = ++shm->seq_tick;
+    if (meta->epoch > m->epoch) {
+        m->epoch = meta->epoch;
+        meta->seq_note |= SEQ_NOTE_RESTART;
+        shm_stat_add(&shm->stats.seq_restarts, 1);
+    }
+    if (meta->seq < m->next) {
+        meta->seq_note |= SEQ_NOTE_DUP;
+        shm_stat_add(&shm->stats.seq_dups, 1);
+        return;
+    }
+    uint64_t gap = meta->seq - m->next;
+    if (gap) {
+        meta->seq_note |= gap < SEQ_NOTE_GAP ? (uint32_t)gap : SEQ_NOTE_GAP;
+        shm_stat_add(&shm->stats.seq_missing, gap);
+    }
+    m->next = meta->seq + 1;
+}
+
+static inline int stream_pid_alive(int pid) {
+    return pid != 0 && !(kill(pid, 0) == -1 && errno == ESRCH);
+}
+
+#define STREAM_REAP_MS 500
+
+// Producer bị SIGKILL hay crash thì không kịp stream_end: ô của nó trong
+// Shared.streams còn đó và consumer chờ mãi. Consumer gọi hàm này khi chờ quá
+// STREAM_REAP_MS: xóa ô của process đã chết, và nếu nhờ thế không còn producer nào
+// đang mở thì kết thúc luồng thay nó (như stream_end). Chưa từng có producer nào
+// (consumer chờ writer đầu tiên) thì không có gì để xóa, luồng vẫn mở.
+static inline void stream_reap(Shared* shm) {
+    if (sem_wait(&shm->mutex) == -1) return;
+    int dead = 0, open = 0;
+    for (int k = 0; k < MAX_PRODUCERS; ++k) {
+        if (!shm->streams[k]) continue;
+        if (stream_pid_alive(shm->streams[k])) open = 1;
+        else { shm->streams[k] = 0; dead = 1; }
+    }
+    if (shm->stream_excl && !stream_pid_alive(shm->stream_excl)) shm->stream_excl = 0;
+    int first = dead && !open && !(shm->ctl & SHM_CTL_DRAIN);
+    if (first) __atomic_store_n(&shm->ctl, shm->ctl | SHM_CTL_DRAIN, __ATOMIC_RELEASE);
+    sem_post(&shm->mutex);
+    if (first) sem_post(&shm->full);
+}
+
+// Như stream_reap nhưng nhiều nhất một lần mỗi STREAM_REAP_MS cho cả segment:
+// consumer nonblock (epoll, coroutine) gọi mỗi lần thấy vòng đệm rỗng.
+static inline void stream_reap_due(Shared* shm) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    uint64_t due = __atomic_load_n(&shm->stream_reap_ns, __ATOMIC_RELAXED);
+    if (now < due) return;
+    if (!__atomic_compare_exchange_n(&shm->stream_reap_ns, &due, now + STREAM_REAP_MS * 1000000ull, 0,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return;
+    stream_reap(shm);
+}
+
+// Chờ token full; cứ STREAM_REAP_MS không có gì thì xét producer đã chết.
+// stop: như shm_sem_wait_stop (xét mỗi SHM_STOP_POLL_MS), để tín hiệu tới ngay
+// trước sem_wait không làm consumer ngủ tiếp.
+static inline int ring_wait_full(Shared* shm, const volatile sig_atomic_t* stop) {
+    if (sem_trywait(&shm->full) == 0) return 0;
+    if (errno != EAGAIN) return -1;
+    SHM_PROBE(block, SHM_SEM_FULL, shm);
+    unsigned step = stop ? SHM_STOP_POLL_MS : STREAM_REAP_MS, waited = 0;
+    for (;;) {
+        if (stop && *stop) { errno = ECANCELED; return -1; }
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += step * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+        if (sem_timedwait(&shm->full, &ts) == 0) break;
+        if (errno == EINTR && stop) continue;
+        if (errno != ETIMEDOUT) return -1;
+        if ((waited += step) >= STREAM_REAP_MS) {
+            waited = 0;
+            stream_reap(shm);
+        }
+    }
+    SHM_PROBE(wake, SHM_SEM_FULL, shm);
+    return 0;
+}
+
+// Lấy một message vào msg[MSG_MAX] và metadata của nó vào meta.
+// nonblock != 0: trả về 1 ngay nếu vòng đệm rỗng.
+// RING_EOS: mọi producer đã kết thúc (SHM_CTL_DRAIN) và không còn bản ghi nào;
+// token full dùng để đánh thức được trả lại cho consumer kế tiếp (stream.h).
+// Làn ưu tiên có bản ghi thì được chọn theo lane_pick (vòng đệm chính là làn 0).
+// Ở chế độ durable ô chưa được trả cho writer; reader phải gọi ring_commit().
+// stop: như ring_push_stop, -1 với errno = ECANCELED khi *stop khác 0 lúc đang chờ.
+static inline int ring_pop_stop(Shared* shm, RecMeta* meta, char* msg, int nonblock,
+                                const volatile sig_atomic_t* stop) {
+    for (;;) {
+        if (nonblock) {
+            if (sem_trywait(&shm->full) == -1) {
+                if (errno != EAGAIN) return -1;
+                stream_reap_due(shm);
+                // Consumer khác đang giữ token đánh thức: không cần chờ nó trả
+                return (__atomic_load_n(&shm->ctl, __ATOMIC_ACQUIRE) & SHM_CTL_DRAIN) && shm_drained(shm) ? RING_EOS : 1;
+            }
+        } else if (ring_wait_full(shm, stop) == -1) {
+            return -1;
+        }
+        if (shm_sem_wait(&shm->mutex, SHM_SEM_MUTEX, shm) == -1) return -1;
+        int lane = lane_pick(shm);
+        if (lane < 0) {
+            int eos = (shm->ctl & SHM_CTL_DRAIN) != 0;
+            sem_post(&shm->mutex);
+            if (!eos) continue;
+            sem_post(&shm->full);
+            return RING_EOS;
+        }
+        if (lane > 0) {
+            Lane* l = &shm->lanes[lane - 1];
+            const LaneSlots* ls = &shm->lane_slots[lane - 1];
+            uint64_t off = l->out;
+            size_t i = off % LANE_CAP;
+            *meta = ls->meta[i];
+            if (meta->len >= MSG_MAX) meta->len = MSG_MAX-1;
+            memcpy(msg, ls->buf[i], meta->len);
+            msg[meta->len] = '\0';
+            l->out++;
+            shm->lane_pending--;
+            shm_stat_add(&shm->stats.lane_pops[lane - 1], 1);
+            sem_post(&shm->mutex);
+            sem_post(&l->empty);
+            SHM_PROBE(consume, off, meta->len, lane);
+            return 0;
+        }
+
+        uint64_t off = shm->out;
+        size_t i = off % CAP;
+        *meta = shm->meta[i];
+        if (meta->len >= MSG_MAX) meta->len = MSG_MAX-1; // ô hỏng: không đọc tràn
+        memcpy(msg, shm->buf[i], meta->len);
+        msg[meta->len] = '\0';
+        if (meta->flags & REC_F_REF) dict_resolve(shm, meta, msg);
+        if (meta->prod) credit_return(shm, meta->prod);
+        if (meta->flags & REC_F_SEQ) seq_mark(shm, meta);
+        int durable = (shm->flags & SHM_F_DURABLE) != 0;
+        shm_seq_write_begin(shm);
+        shm->out++;
+        if (!durable) shm->released = shm->out;
+        shm_seq_write_end(shm);
+
+        sem_post(&shm->mutex);
+        if (!durable) sem_post(&shm->empty);
+        SHM_PROBE(consume, off, meta->len, 0);
+        return 0;
+    }
+}
+
+static inline int ring_pop(Shared* shm, RecMeta* meta, char* msg, int nonblock) {
+    return ring_pop_stop(shm, meta, msg, nonblock, NULL);
+}
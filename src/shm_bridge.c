@@ -0,0 +1,574 @@
+// shm_bridge.c — nối vòng đệm giữa hai máy qua TCP.
+// gcc shm_bridge.c -o shm_bridge -pthread
+//
+//  - send: là consumer của vòng đệm cục bộ, gom tối đa -b bản ghi mỗi lô (lấy tiếp
+//    không chặn khi vòng đệm còn dữ liệu) rồi gửi cả lô bằng một lần send.
+//  - recv: nhận lô, đẩy lại từng bản ghi vào vòng đệm ở máy đích (giữ nguyên
+//    len/crc/flags/src nên frame nén và CRC đi qua nguyên vẹn), sau mỗi lô trả ack
+//    gồm số bản ghi đã đẩy và offset của reader bên đích (Shared.out).
+//  - bench: cả hai đầu trong một process qua 127.0.0.1, so thông lượng và độ trễ
+//    với vòng đệm cục bộ.
+// Mặc định TCP_NODELAY (lô nhỏ đi ngay); -C giữ TCP_CORK khi vòng đệm còn dữ liệu
+// để các lô gộp thành segment đầy, chỉ mở cork khi vòng đệm rỗng.
+// Frame trên dây dùng thứ tự byte của máy gửi: hai đầu phải cùng kiến trúc.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "segment.h"
+#include "doorbell.h"
+
+#define BRIDGE_MAGIC 0x42524732u     // "BRG2": đầu lô
+#define BRIDGE_ACK_MAGIC 0x41434b31u // "ACK1"
+#define BRIDGE_BATCH 64              // mặc định: số bản ghi tối đa mỗi lô
+#define BRIDGE_BATCH_MAX 1024
+#define BRIDGE_WINDOW 256            // mặc định: số bản ghi đã gửi mà chưa được ack
+#define BRIDGE_F_END 0x80000000u     // trong BridgeBatch.nrec: lô cuối, luồng nguồn đã kết thúc
+
+typedef struct {
+    uint32_t magic;
+    uint32_t nrec;
+    uint64_t seq; // số thứ tự (từ 0) của bản ghi đầu lô trên kết nối này
+} BridgeBatch;
+
+// Mỗi bản ghi: BridgeRec rồi len byte payload. producer/epoch/seq đi nguyên vẹn
+// để reader bên đích vẫn phát hiện được mất/lặp của writer gốc (seqtrack.h).
+typedef struct {
+    uint32_t len, crc, flags, src;
+    uint32_t producer, epoch;
+    uint64_t seq;
+} BridgeRec;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t end;        // 1: đã kết thúc luồng ở vòng đệm đích, bên nhận sắp đóng kết nối
+    uint64_t acked;      // tổng số bản ghi đã đẩy vào vòng đệm đích
+    uint64_t reader_out; // offset reader bên đích đã đọc tới
+} BridgeAck;
+
+typedef struct {
+    const char* name; // vòng đệm cục bộ (send) hoặc đích (recv)
+    unsigned batch;
+    uint64_t window;
+    int cork;
+    int wait_secs;
+    const char* tag;
+} BridgeOpts;
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int send_all(int fd, const void* buf, size_t n){
+    const char* p = buf;
+    while (n > 0) {
+        ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+// 0: đủ n byte, 1: bên kia đóng kết nối trước khi gửi byte nào, -1: lỗi
+static int recv_all(int fd, void* buf, size_t n, int flags){
+    char* p = buf;
+    size_t got = 0;
+    while (got < n) {
+        ssize_t k = recv(fd, p + got, n - got, got ? 0 : flags);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (k == 0) {
+            if (got == 0) return 1;
+            errno = ECONNRESET;
+            return -1;
+        }
+        got += (size_t)k;
+    }
+    return 0;
+}
+
+// Bộ đệm đọc của bên nhận: mỗi lô chỉ tốn vài lần recv thay vì hai lần mỗi bản ghi
+#define BRIDGE_RBUF (64 * 1024)
+typedef struct {
+    int fd;
+    size_t lo, hi;
+    char data[BRIDGE_RBUF];
+} RecvBuf;
+
+// Như recv_all nhưng lấy từ bộ đệm trước
+static int rbuf_read(RecvBuf* rb, void* dst, size_t n){
+    char* p = dst;
+    size_t got = 0;
+    while (got < n) {
+        if (rb->lo == rb->hi) {
+            ssize_t k = recv(rb->fd, rb->data, sizeof(rb->data), 0);
+            if (k < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            if (k == 0) {
+                if (got == 0) return 1;
+                errno = ECONNRESET;
+                return -1;
+            }
+            rb->lo = 0;
+            rb->hi = (size_t)k;
+        }
+        size_t take = rb->hi - rb->lo < n - got ? rb->hi - rb->lo : n - got;
+        memcpy(p + got, rb->data + rb->lo, take);
+        rb->lo += take;
+        got += take;
+    }
+    return 0;
+}
+
+static void set_sockopt(int fd, int opt, int on){
+    if (setsockopt(fd, IPPROTO_TCP, opt, &on, sizeof(on)) == -1) perror("setsockopt");
+}
+
+// "host:port" -> socket đã kết nối
+static int tcp_connect(const char* spec){
+    char host[256];
+    const char* colon = strrchr(spec, ':');
+    if (!colon || (size_t)(colon - spec) >= sizeof(host)) {
+        fprintf(stderr, "-c: expected HOST:PORT, got '%s'\n", spec);
+        return -1;
+    }
+    memcpy(host, spec, (size_t)(colon - spec));
+    host[colon - spec] = '\0';
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res;
+    int rc = getaddrinfo(host, colon + 1, &hints, &res);
+    if (rc != 0) {
+        fprintf(stderr, "getaddrinfo %s: %s\n", spec, gai_strerror(rc));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) perror("connect");
+    return fd;
+}
+
+// Lắng nghe trên addr:port (port 0: kernel chọn, đọc lại bằng getsockname)
+static int tcp_listen(const char* addr, unsigned port){
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { perror("socket"); return -1; }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+        fprintf(stderr, "-a: invalid IPv4 address '%s'\n", addr);
+        close(fd);
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) == -1 || listen(fd, 1) == -1) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// ---- Phía gửi ----
+
+typedef struct {
+    uint64_t sent, batches, bytes, acked, reader_out;
+    uint64_t window_waits;
+    int end_acked;
+} SendState;
+
+static int read_ack(int sock, SendState* st, int nonblock){
+    BridgeAck ack;
+    int rc = recv_all(sock, &ack, sizeof(ack), nonblock ? MSG_DONTWAIT : 0);
+    if (rc == -1 && nonblock && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+    if (rc != 0) {
+        if (rc == 1) errno = ECONNRESET;
+        return -1;
+    }
+    if (ack.magic != BRIDGE_ACK_MAGIC) {
+        fprintf(stderr, "bad ack magic %08x\n", ack.magic);
+        errno = EPROTO;
+        return -1;
+    }
+    st->acked = ack.acked;
+    st->reader_out = ack.reader_out;
+    if (ack.end) st->end_acked = 1;
+    return 0;
+}
+
+static int bridge_send(const BridgeOpts* o, int sock){
+    SegConfig cfg = { .name = o->name, .role = SEG_CONSUMER, .wait_secs = o->wait_secs, .tag = o->tag };
+    Segment seg;
+    if (seg_open(&seg, &cfg) == -1) return -1;
+    Shared* shm = seg.shm;
+    if (seg.durable) {
+        fprintf(stderr, "[%s] durable rings are not supported\n", o->tag);
+        seg_close(&seg);
+        return -1;
+    }
+
+    set_sockopt(sock, TCP_NODELAY, 1);
+    size_t cap = sizeof(BridgeBatch) + (size_t)o->batch * (sizeof(BridgeRec) + MSG_MAX);
+    char* buf = malloc(cap);
+    if (!buf) { perror("malloc"); seg_close(&seg); return -1; }
+
+    SendState st = {0};
+    int corked = 0, end = 0, rc = 0;
+    char msg[MSG_MAX];
+    RecMeta meta;
+    double t0 = now_sec();
+    while (!end) {
+        // Bản ghi đầu lô chặn chờ dữ liệu, các bản ghi sau lấy không chặn. Đang cork
+        // mà vòng đệm rỗng thì mở cork trước khi ngủ để các lô đã gom được đi ngay.
+        size_t off = sizeof(BridgeBatch);
+        uint32_t n = 0;
+        int drained = 0;
+        while (n < o->batch && !end) {
+            int r = ring_pop(shm, &meta, msg, n > 0 || corked);
+            if (r == 1 && n == 0) { set_sockopt(sock, TCP_CORK, 0); corked = 0; continue; }
+            if (r == 1) { drained = 1; break; }
+            if (r == -1) { perror("ring_pop"); rc = -1; goto out; }
+            if (r == RING_EOS) { end = 1; break; }
+            BridgeRec rec = { meta.len, meta.crc, meta.flags, meta.src, meta.producer, meta.epoch, meta.seq };
+            memcpy(buf + off, &rec, sizeof(rec));
+            memcpy(buf + off + sizeof(rec), msg, meta.len);
+            off += sizeof(rec) + meta.len;
+            n++;
+        }
+
+        BridgeBatch hdr = { BRIDGE_MAGIC, n | (end ? BRIDGE_F_END : 0), st.sent };
+        memcpy(buf, &hdr, sizeof(hdr));
+        if (o->cork && !corked) { set_sockopt(sock, TCP_CORK, 1); corked = 1; }
+        if (send_all(sock, buf, off) == -1) { perror("send"); rc = -1; goto out; }
+        if (corked && (drained || end)) { set_sockopt(sock, TCP_CORK, 0); corked = 0; }
+        st.sent += n;
+        st.batches++;
+        st.bytes += off;
+
+        // Ack đến sau mỗi lô; đọc hết những gì đã có, chặn khi cửa sổ đầy
+        while (read_ack(sock, &st, 1) == 0) {}
+        while (st.sent - st.acked > o->window) {
+            st.window_waits++;
+            if (corked) { set_sockopt(sock, TCP_CORK, 0); corked = 0; }
+            if (read_ack(sock, &st, 0) == -1) { perror("recv ack"); rc = -1; goto out; }
+        }
+    }
+    // Lô cuối đã gửi: chờ bên nhận xác nhận đã đẩy hết và kết thúc luồng bên đó
+    while (!st.end_acked) {
+        if (read_ack(sock, &st, 0) == -1) { perror("recv ack"); rc = -1; goto out; }
+    }
+
+out:;
+    double dt = now_sec() - t0;
+    fprintf(stderr, "[%s] sent %llu record(s) in %llu batch(es), %.1f rec/batch, %llu byte(s), %.0f rec/s\n",
+            o->tag, (unsigned long long)st.sent, (unsigned long long)st.batches,
+            st.batches ? (double)st.sent / st.batches : 0.0, (unsigned long long)st.bytes,
+            dt > 0 ? st.sent / dt : 0.0);
+    fprintf(stderr, "[%s] acked %llu, remote reader at offset %llu, window waits %llu\n",
+            o->tag, (unsigned long long)st.acked, (unsigned long long)st.reader_out,
+            (unsigned long long)st.window_waits);
+    free(buf);
+    seg_close(&seg);
+    return rc;
+}
+
+// ---- Phía nhận ----
+
+static int bridge_recv(const BridgeOpts* o, int sock){
+    SegConfig cfg = { .name = o->name, .role = SEG_PRODUCER, .tag = o->tag };
+    Segment seg;
+    if (seg_open(&seg, &cfg) == -1) return -1;
+    Shared* shm = seg.shm;
+    Doorbell db;
+    db_producer_init(&db, shm, cfg.name);
+    int holder = 0;
+    int stream = stream_open_excl(shm, 0, &holder);
+    if (stream == STREAM_BUSY) {
+        fprintf(stderr, "[%s] ring '%s' has a -l writer (pid %d) that must be its only writer\n", o->tag, o->name, holder);
+        seg_close(&seg);
+        return -1;
+    }
+    set_sockopt(sock, TCP_NODELAY, 1);
+    RecvBuf* rb = malloc(sizeof(RecvBuf));
+    if (!rb) {
+        perror("malloc");
+        stream_end(shm, stream);
+        db_producer_close(&db);
+        seg_close(&seg);
+        return -1;
+    }
+    rb->fd = sock;
+    rb->lo = rb->hi = 0;
+
+    uint64_t pushed = 0, batches = 0;
+    int end = 0, ended = 0, rc = 0;
+    char msg[MSG_MAX];
+    while (!end) {
+        BridgeBatch hdr;
+        int r = rbuf_read(rb, &hdr, sizeof(hdr));
+        if (r == 1) {
+            fprintf(stderr, "[%s] sender closed the connection before end of stream\n", o->tag);
+            break;
+        }
+        if (r == -1) { perror("recv"); rc = -1; break; }
+        end = (hdr.nrec & BRIDGE_F_END) != 0;
+        hdr.nrec &= ~BRIDGE_F_END;
+        if (hdr.magic != BRIDGE_MAGIC || hdr.nrec > BRIDGE_BATCH_MAX || hdr.seq != pushed) {
+            fprintf(stderr, "[%s] bad batch header (magic %08x, nrec %u, seq %llu, expected %llu)\n",
+                    o->tag, hdr.magic, hdr.nrec, (unsigned long long)hdr.seq, (unsigned long long)pushed);
+            rc = -1;
+            break;
+        }
+        for (uint32_t k = 0; k < hdr.nrec; k++) {
+            BridgeRec rec;
+            if (rbuf_read(rb, &rec, sizeof(rec)) != 0 || rec.len >= MSG_MAX
+                || rbuf_read(rb, msg, rec.len) != 0) {
+                fprintf(stderr, "[%s] truncated or oversized record\n", o->tag);
+                rc = -1;
+                goto out;
+            }
+            msg[rec.len] = '\0';
+            // Tín dụng producer (prod) chỉ có nghĩa trong segment nguồn
+            RecMeta meta = { .len = rec.len, .crc = rec.crc, .flags = rec.flags, .src = rec.src,
+                             .producer = rec.producer, .epoch = rec.epoch, .seq = rec.seq };
+            if (ring_push(shm, &meta, msg, pushed + 1) == -1) { perror("ring_push"); rc = -1; goto out; }
+            db_ring(&db, shm);
+            pushed++;
+        }
+        batches++;
+        if (end) {
+            // Luồng nguồn kết thúc: kết thúc phần của bridge ở vòng đệm đích
+            stream_end(shm, stream);
+            ended = 1;
+            db_ring(&db, shm);
+        }
+        BridgeAck ack = { BRIDGE_ACK_MAGIC, (uint32_t)end, pushed, __atomic_load_n(&shm->out, __ATOMIC_ACQUIRE) };
+        if (send_all(sock, &ack, sizeof(ack)) == -1) { perror("send ack"); rc = -1; break; }
+    }
+
+out:
+    if (!ended) {
+        // Kết nối đứt hoặc lỗi: vẫn kết thúc phần của bridge, nếu không reader đích chờ mãi
+        stream_end(shm, stream);
+        db_ring(&db, shm);
+    }
+    fprintf(stderr, "[%s] republished %llu record(s) from %llu batch(es)\n",
+            o->tag, (unsigned long long)pushed, (unsigned long long)batches);
+    free(rb);
+    db_producer_close(&db);
+    seg_close(&seg);
+    return rc;
+}
+
+// ---- bench: 127.0.0.1 ----
+
+typedef struct {
+    const char* name;
+    long msgs;
+} BenchProducer;
+
+// Payload là thời điểm gửi (ns, CLOCK_MONOTONIC) để consumer tính độ trễ
+static void* bench_produce(void* arg){
+    BenchProducer* bp = arg;
+    SegConfig cfg = { .name = bp->name, .role = SEG_PRODUCER, .tag = "bench" };
+    Segment seg;
+    if (seg_open(&seg, &cfg) == -1) return NULL;
+    int stream = stream_open(seg.shm);
+    char line[32];
+    for (long i = 0; i < bp->msgs; i++) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        RecMeta meta = { .len = (uint32_t)snprintf(line, sizeof(line), "%llu",
+                                   (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec) };
+        if (ring_push(seg.shm, &meta, line, (uint64_t)i + 1) == -1) { perror("ring_push"); break; }
+    }
+    stream_end(seg.shm, stream);
+    seg_close(&seg);
+    return NULL;
+}
+
+typedef struct {
+    BridgeOpts o;
+    int sock;
+    const char* connect_to;
+} BenchEnd;
+
+static void* bench_sender(void* arg){
+    BenchEnd* e = arg;
+    int fd = tcp_connect(e->connect_to);
+    if (fd >= 0) { bridge_send(&e->o, fd); close(fd); }
+    return NULL;
+}
+
+static void* bench_receiver(void* arg){
+    BenchEnd* e = arg;
+    int fd = accept4(e->sock, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) { perror("accept"); return NULL; }
+    bridge_recv(&e->o, fd);
+    close(fd);
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// bridge = 0: producer -> vòng đệm A -> consumer; 1: A -> TCP -> vòng đệm B -> consumer
+static int bench_run(int bridge, long msgs, const BridgeOpts* base){
+    char a[64], b[64], addr[64];
+    snprintf(a, sizeof(a), "/bridge_bench_a_%d", (int)getpid());
+    snprintf(b, sizeof(b), "/bridge_bench_b_%d", (int)getpid());
+    uint64_t* lat = malloc((size_t)msgs * sizeof(uint64_t));
+    if (!lat) { perror("malloc"); return -1; }
+
+    BenchEnd tx = { *base, -1, addr }, rx = { *base, -1, NULL };
+    tx.o.name = a; tx.o.tag = "bench send";
+    rx.o.name = b; rx.o.tag = "bench recv";
+    pthread_t tp, ts, tr;
+    if (bridge) {
+        rx.sock = tcp_listen("127.0.0.1", 0);
+        if (rx.sock < 0) { free(lat); return -1; }
+        struct sockaddr_in sa;
+        socklen_t sl = sizeof(sa);
+        getsockname(rx.sock, (struct sockaddr*)&sa, &sl);
+        snprintf(addr, sizeof(addr), "127.0.0.1:%u", ntohs(sa.sin_port));
+        pthread_create(&tr, NULL, bench_receiver, &rx);
+        pthread_create(&ts, NULL, bench_sender, &tx);
+    }
+    BenchProducer bp = { a, msgs };
+    double t0 = now_sec();
+    pthread_create(&tp, NULL, bench_produce, &bp);
+
+    SegConfig cfg = { .name = bridge ? b : a, .role = SEG_CONSUMER, .wait_secs = 5, .tag = "bench" };
+    Segment seg;
+    long got = 0;
+    if (seg_open(&seg, &cfg) == 0) {
+        RecMeta meta;
+        char msg[MSG_MAX];
+        while (ring_pop(seg.shm, &meta, msg, 0) == 0) {
+            struct timespec ts2;
+            clock_gettime(CLOCK_MONOTONIC, &ts2);
+            uint64_t now = (uint64_t)ts2.tv_sec * 1000000000ull + (uint64_t)ts2.tv_nsec;
+            if (got < msgs) lat[got++] = now - strtoull(msg, NULL, 10);
+        }
+        seg_close(&seg);
+    }
+    double dt = now_sec() - t0;
+    pthread_join(tp, NULL);
+    if (bridge) {
+        pthread_join(ts, NULL);
+        pthread_join(tr, NULL);
+        close(rx.sock);
+    }
+    seg_unlink(a);
+    seg_unlink(b);
+
+    qsort(lat, (size_t)got, sizeof(uint64_t), cmp_u64);
+    printf("%-6s %8ld msgs  %7.3f s  %10.0f msg/s  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+           bridge ? "tcp" : "local", got, dt, dt > 0 ? got / dt : 0.0,
+           got ? lat[got / 2] / 1e3 : 0.0, got ? lat[got * 99 / 100] / 1e3 : 0.0,
+           got ? lat[got - 1] / 1e3 : 0.0);
+    free(lat);
+    return got == msgs ? 0 : -1;
+}
+
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s send [-n /shm_name] -c HOST:PORT [-b N] [-w N] [-C] [-W secs]\n"
+        "       %s recv [-n /shm_name] -p PORT [-a ADDR]\n"
+        "       %s bench [-m N] [-b N] [-w N] [-C]\n"
+        "  send   đọc vòng đệm cục bộ -n, gửi theo lô tới HOST:PORT\n"
+        "  recv   nhận một kết nối trên ADDR:PORT (mặc định 0.0.0.0), đẩy lại vào vòng đệm -n\n"
+        "  bench  so sánh vòng đệm cục bộ với cầu TCP qua 127.0.0.1 (thông lượng, độ trễ)\n"
+        "  -n  tên POSIX shm, arena:kênh hoặc @tên (mặc định: %s)\n"
+        "  -b  số bản ghi tối đa mỗi lô (mặc định: %d, tối đa %d)\n"
+        "  -w  số bản ghi tối đa đã gửi mà chưa được ack (mặc định: %d)\n"
+        "  -C  TCP_CORK khi vòng đệm còn dữ liệu (thông lượng), mặc định TCP_NODELAY (độ trễ)\n"
+        "  -W  thời gian chờ vòng đệm cục bộ xuất hiện, giây (mặc định: 5)\n"
+        "  -m  số bản ghi cho bench (mặc định: 200000)\n",
+        prog, prog, prog, SHM_NAME, BRIDGE_BATCH, BRIDGE_BATCH_MAX, BRIDGE_WINDOW);
+}
+
+int main(int argc, char** argv){
+    if (argc < 2) { usage(argv[0]); return 1; }
+    const char* mode = argv[1];
+    BridgeOpts o = { .name = SHM_NAME, .batch = BRIDGE_BATCH, .window = BRIDGE_WINDOW, .wait_secs = 5 };
+    const char* connect_to = NULL;
+    const char* listen_addr = "0.0.0.0";
+    unsigned port = 0;
+    long msgs = 200000;
+
+    optind = 2;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:p:a:b:w:CW:m:h")) != -1){
+        if (opt == 'n') o.name = optarg;
+        else if (opt == 'c') connect_to = optarg;
+        else if (opt == 'p') port = (unsigned)strtoul(optarg, NULL, 10);
+        else if (opt == 'a') listen_addr = optarg;
+        else if (opt == 'b') o.batch = (unsigned)strtoul(optarg, NULL, 10);
+        else if (opt == 'w') o.window = strtoull(optarg, NULL, 10);
+        else if (opt == 'C') o.cork = 1;
+        else if (opt == 'W') o.wait_secs = atoi(optarg);
+        else if (opt == 'm') msgs = atol(optarg);
+        else { usage(argv[0]); return 1; }
+    }
+    if (o.batch < 1 || o.batch > BRIDGE_BATCH_MAX) {
+        fprintf(stderr, "-b: expected 1..%d\n", BRIDGE_BATCH_MAX);
+        return 1;
+    }
+    if (o.window < o.batch) o.window = o.batch;
+
+    if (strcmp(mode, "send") == 0) {
+        if (!connect_to) { usage(argv[0]); return 1; }
+        o.tag = "bridge send";
+        int fd = tcp_connect(connect_to);
+        if (fd < 0) return 1;
+        int rc = bridge_send(&o, fd);
+        close(fd);
+        return rc == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "recv") == 0) {
+        if (!port) { usage(argv[0]); return 1; }
+        o.tag = "bridge recv";
+        int lfd = tcp_listen(listen_addr, port);
+        if (lfd < 0) return 1;
+        int fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        close(lfd);
+        if (fd < 0) { perror("accept"); return 1; }
+        int rc = bridge_recv(&o, fd);
+        close(fd);
+        return rc == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "bench") == 0) {
+        if (msgs < 1) msgs = 1;
+        int rc = bench_run(0, msgs, &o);
+        if (bench_run(1, msgs, &o) == -1) rc = -1;
+        return rc == 0 ? 0 : 1;
+    }
+    usage(argv[0]);
+    return 1;
+}
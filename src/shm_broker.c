@@ -0,0 +1,226 @@
+// shm_broker.c — cấp vòng đệm ẩn danh (memfd) cho writer/reader dùng tên "@tên".
+// gcc shm_broker.c -o shm_broker -pthread
+//
+// Mỗi vòng đệm được tạo bằng memfd_create ở yêu cầu đầu tiên, khởi tạo sẵn rồi
+// niêm phong kích thước, fd được gửi qua SCM_RIGHTS (xem memfdseg.h). Vòng đệm
+// được tách theo uid của client (SO_PEERCRED): hai tenant cùng dùng "@orders"
+// nhận hai segment khác nhau.
+// Client giữ kết nối suốt thời gian gắn; khi kết nối cuối cùng đóng (kể cả process
+// chết) broker nhả memfd. Vòng đệm còn bản ghi chưa đọc được giữ thêm -l giây để
+// reader đến sau vẫn lấy được (writer ngắn hơn CAP dòng thoát trước khi reader gắn).
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include "segment.h"
+
+#define MB_MAX_RINGS 1024
+#define MB_LINGER 60 // mặc định: giây giữ vòng đệm còn dữ liệu sau khi client cuối rời đi
+
+typedef struct {
+    int used;
+    uid_t uid;
+    char name[MB_NAME_MAX];
+    int memfd;
+    Shared* shm;      // broker giữ mapping để biết vòng đệm còn dữ liệu hay không
+    unsigned refs;    // số kết nối producer/consumer đang giữ
+    time_t idle_since; // refs về 0 lúc nào (0: đang có client)
+} BrokerRing;
+
+typedef struct {
+    int fd;
+    int ring; // chỉ số trong bảng, -1 nếu chưa gửi yêu cầu
+} BrokerClient;
+
+static BrokerRing g_rings[MB_MAX_RINGS];
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int sig){ (void)sig; g_stop = 1; }
+
+static int ring_find(uid_t uid, const char* name){
+    for (int i = 0; i < MB_MAX_RINGS; ++i)
+        if (g_rings[i].used && g_rings[i].uid == uid && strcmp(g_rings[i].name, name) == 0) return i;
+    return -1;
+}
+
+// memfd mới, đúng kích thước Shared, đã khởi tạo và niêm phong
+static int ring_create(uid_t uid, const char* name, uint64_t base){
+    int i = 0;
+    while (i < MB_MAX_RINGS && g_rings[i].used) ++i;
+    if (i == MB_MAX_RINGS) { fprintf(stderr, "[broker] ring table full (max %d)\n", MB_MAX_RINGS); return -1; }
+    char label[MB_NAME_MAX + 8];
+    snprintf(label, sizeof(label), "shm:%s", name);
+    int fd = memfd_create(label, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) { perror("memfd_create"); return -1; }
+    if (ftruncate(fd, sizeof(Shared)) == -1) { perror("ftruncate"); close(fd); return -1; }
+    Shared* shm = mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) { perror("mmap"); close(fd); return -1; }
+    if (seg_init_sems(shm, 1, 0, base) == -1
+        || fcntl(fd, F_ADD_SEALS, MB_SEALS | F_SEAL_SEAL) == -1) {
+        perror("seal");
+        munmap(shm, sizeof(Shared));
+        close(fd);
+        return -1;
+    }
+    BrokerRing* r = &g_rings[i];
+    memset(r, 0, sizeof(*r));
+    r->used = 1;
+    r->uid = uid;
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->memfd = fd;
+    r->shm = shm;
+    fprintf(stderr, "[broker] created ring '@%s' for uid %u\n", name, (unsigned)uid);
+    return i;
+}
+
+static void ring_drop(int i, const char* why){
+    BrokerRing* r = &g_rings[i];
+    fprintf(stderr, "[broker] released ring '@%s' (uid %u, %s)\n", r->name, (unsigned)r->uid, why);
+    munmap(r->shm, sizeof(Shared));
+    close(r->memfd);
+    r->used = 0;
+}
+
+// Client cuối cùng rời đi: nhả ngay nếu không còn gì để đọc, không thì chờ linger
+static void ring_unref(int i, int linger){
+    BrokerRing* r = &g_rings[i];
+    if (--r->refs > 0) return;
+    if (linger == 0 || shm_drained(r->shm)) ring_drop(i, "last client left");
+    else r->idle_since = time(NULL);
+}
+
+static void send_reply(int fd, char code, int memfd){
+    if (memfd >= 0) {
+        // send_fd (doorbell.h) gửi kèm một byte bất kỳ; ở đây byte đó là mã trả lời
+        struct iovec iov = { &code, 1 };
+        union { char buf[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } u;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = u.buf;
+        msg.msg_controllen = sizeof(u.buf);
+        struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(c), &memfd, sizeof(int));
+        if (sendmsg(fd, &msg, MSG_NOSIGNAL) != 1) perror("broker sendmsg");
+    } else if (send(fd, &code, 1, MSG_NOSIGNAL) != 1) {
+        perror("broker send");
+    }
+}
+
+// Xử lý yêu cầu của client; trả về 1 nếu kết nối cần được giữ (client giữ tham chiếu)
+static int serve_request(BrokerClient* c){
+    MbRequest req;
+    ssize_t n = recv(c->fd, &req, sizeof(req), MSG_DONTWAIT);
+    if (n != (ssize_t)sizeof(req) || req.magic != MB_MAGIC || req.role > MB_ROLE_OBSERVER
+        || memchr(req.name, '\0', sizeof(req.name)) == NULL || !req.name[0]) {
+        send_reply(c->fd, MB_REPLY_FAIL, -1);
+        return 0;
+    }
+    struct ucred cred;
+    socklen_t clen = sizeof(cred);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_PEERCRED, &cred, &clen) == -1) {
+        perror("SO_PEERCRED");
+        send_reply(c->fd, MB_REPLY_FAIL, -1);
+        return 0;
+    }
+    int i = ring_find(cred.uid, req.name);
+    char code = MB_REPLY_ATTACHED;
+    if (i < 0) {
+        if (req.role == MB_ROLE_OBSERVER) { send_reply(c->fd, MB_REPLY_NOENT, -1); return 0; }
+        i = ring_create(cred.uid, req.name, req.base_offset);
+        if (i < 0) { send_reply(c->fd, MB_REPLY_FAIL, -1); return 0; }
+        code = MB_REPLY_CREATED;
+    }
+    send_reply(c->fd, code, g_rings[i].memfd);
+    if (req.role == MB_ROLE_OBSERVER) return 0;
+    g_rings[i].refs++;
+    g_rings[i].idle_since = 0;
+    c->ring = i;
+    return 1;
+}
+
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s [-b broker] [-l secs]\n"
+        "  -b  tên broker (socket trừu tượng \"\\0" MB_PREFIX "<tên>\"); client chọn broker bằng\n"
+        "      biến môi trường SHM_BROKER (mặc định: %s)\n"
+        "  -l  giữ vòng đệm còn bản ghi chưa đọc thêm chừng này giây sau khi client cuối\n"
+        "      rời đi (mặc định: %d, 0: nhả ngay)\n",
+        prog, MB_DEFAULT, MB_LINGER);
+}
+
+int main(int argc, char** argv){
+    const char* broker = mb_broker_name();
+    int linger = MB_LINGER;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:l:h")) != -1){
+        if (opt == 'b') broker = optarg;
+        else if (opt == 'l') linger = atoi(optarg);
+        else { usage(argv[0]); return 1; }
+    }
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr;
+    socklen_t alen = mb_addr(&addr, broker);
+    if (lfd < 0 || bind(lfd, (struct sockaddr*)&addr, alen) == -1 || listen(lfd, 64) == -1) {
+        perror("broker listen (already running?)");
+        return 1;
+    }
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev) == -1) { perror("epoll"); return 1; }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    fprintf(stderr, "[broker] serving '%s'\n", broker);
+
+    struct epoll_event evs[64];
+    while (!g_stop) {
+        int k = epoll_wait(ep, evs, 64, 1000);
+        if (k < 0 && errno != EINTR) { perror("epoll_wait"); break; }
+        for (int j = 0; j < k; ++j) {
+            BrokerClient* c = evs[j].data.ptr;
+            if (!c) {
+                int fd;
+                while ((fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+                    c = malloc(sizeof(*c));
+                    if (!c) { close(fd); continue; }
+                    c->fd = fd;
+                    c->ring = -1;
+                    struct epoll_event cev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = c };
+                    if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev) == -1) { close(fd); free(c); }
+                }
+                continue;
+            }
+            if (c->ring < 0 && !(evs[j].events & (EPOLLHUP | EPOLLERR)) && serve_request(c)) continue;
+            // Yêu cầu xong (observer, lỗi) hoặc client đã đóng kết nối / chết
+            if (c->ring >= 0) ring_unref(c->ring, linger);
+            epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+            close(c->fd);
+            free(c);
+        }
+        // Vòng đệm không còn client: nhả khi reader đã đọc hết hoặc hết thời gian linger
+        time_t now = time(NULL);
+        for (int i = 0; i < MB_MAX_RINGS; ++i) {
+            BrokerRing* r = &g_rings[i];
+            if (!r->used || r->refs || !r->idle_since) continue;
+            if (shm_drained(r->shm)) ring_drop(i, "drained");
+            else if (now - r->idle_since >= linger) ring_drop(i, "linger expired");
+        }
+    }
+    fprintf(stderr, "[broker] shutting down (attached clients keep their mappings)\n");
+    return 0;
+}
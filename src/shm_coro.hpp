@@ -0,0 +1,297 @@
+#pragma once
+// shm_coro.hpp — consumer dạng coroutine (C++20) cho vòng đệm văn bản Shared.
+//
+//   shm_reactor r;                          // một reactor = một thread epoll
+//   spawn: shm_task consume(shm_reactor& r, const char* name) {
+//       shm_async_ring ring(r, name);
+//       while (auto rec = co_await ring.next()) { ... rec->view() ... }
+//   }
+//   r.run();                                // trả về khi mọi vòng đệm đã đóng
+//
+// Mỗi vòng đệm có một eventfd chuông báo (doorbell.h): coroutine gặp vòng đệm
+// rỗng thì arm chuông và treo; writer gõ chuông, reactor lấy bản ghi rồi mới
+// resume coroutine. Nhờ vậy hàng nghìn consumer dùng chung vài thread, mỗi
+// thread chạy một reactor riêng.
+//
+// Quy ước luồng: mọi thứ của một reactor (tạo shm_async_ring, chạy coroutine)
+// chỉ diễn ra trên thread gọi run(), hoặc trước khi run() bắt đầu.
+#include <sys/epoll.h>
+#include <time.h>
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "shm_ring.hpp"
+#include "doorbell.h"
+#include "lzframe.h"
+
+static inline uint64_t shm_mono_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Khác 0: mọi vòng đệm ngừng chờ bản ghi mới, lấy nốt những gì đang có tới thời
+// điểm này (CLOCK_MONOTONIC, ns) rồi kết thúc như hết luồng. Gọi được từ signal
+// handler (shm_request_drain).
+inline std::atomic<uint64_t> shm_drain_deadline{0};
+
+inline void shm_request_drain(unsigned ms) {
+    uint64_t none = 0;
+    shm_drain_deadline.compare_exchange_strong(none, shm_mono_ns() + (uint64_t)ms * 1000000ull);
+}
+
+// Coroutine chạy ngay khi gọi và tự hủy khi kết thúc (fire-and-forget).
+struct shm_task {
+    struct promise_type {
+        shm_task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+struct shm_record {
+    RecMeta meta;
+    char data[MSG_MAX];
+    std::string_view view() const { return std::string_view(data, meta.len); }
+};
+
+class shm_async_ring;
+
+class shm_reactor {
+public:
+    static constexpr int kSafetyMs = 1000; // phòng writer chưa nhận được eventfd
+
+    shm_reactor() : ep_(epoll_create1(EPOLL_CLOEXEC)) {
+        if (ep_ < 0) perror("epoll_create1");
+    }
+    ~shm_reactor() { if (ep_ >= 0) close(ep_); }
+    shm_reactor(const shm_reactor&) = delete;
+    shm_reactor& operator=(const shm_reactor&) = delete;
+
+    // Chạy tới khi không còn vòng đệm nào gắn vào reactor.
+    inline void run();
+
+    // Đưa coroutine vào hàng đợi chạy (dùng để nhường thread cho vòng đệm khác).
+    void schedule(std::coroutine_handle<> h) { ready_.push_back(h); }
+
+private:
+    friend class shm_async_ring;
+
+    // Phân biệt eventfd và socket lắng nghe của cùng một vòng đệm trong epoll
+    struct fd_slot {
+        shm_async_ring* ring;
+        bool listen;
+    };
+
+    int ep_;
+    std::vector<shm_async_ring*> rings_;
+    std::deque<std::coroutine_handle<>> ready_;
+};
+
+class shm_async_ring {
+public:
+    static constexpr int kYieldEvery = 64; // số bản ghi liên tiếp trước khi nhường thread
+
+    // Gắn làm consumer của vòng đệm name (chờ tối đa wait_secs giây) và phục vụ
+    // chuông báo cho writer. ok() == false nếu không mở được.
+    shm_async_ring(shm_reactor& r, const char* name, int wait_secs = 5, const char* tag = nullptr)
+        : reactor_(r), name_(name), efd_slot_{this, false}, lfd_slot_{this, true} {
+        ring_ = shm_ring<shm_text, CAP>::open(name, SEG_CONSUMER, wait_secs, tag);
+        if (!ring_) return;
+        fa_.seq = &seq_;
+        Shared* shm = ring_->get();
+        if ((__atomic_load_n(&shm->ctl, __ATOMIC_ACQUIRE) & SHM_CTL_DRAIN) && shm_drained(shm))
+            fprintf(stderr, "[shm_coro] previous stream on '%s' has ended, waiting for a writer...\n", name);
+        efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        lfd_ = db_listen(name);
+        if (efd_ < 0 || lfd_ < 0) {
+            fprintf(stderr, "[shm_coro] cannot set up doorbell for '%s'\n", name);
+            ring_.reset();
+            return;
+        }
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &efd_slot_;
+        epoll_ctl(reactor_.ep_, EPOLL_CTL_ADD, efd_, &ev);
+        ev.data.ptr = &lfd_slot_;
+        epoll_ctl(reactor_.ep_, EPOLL_CTL_ADD, lfd_, &ev);
+        db_publish_gen(ring_->get());
+        reactor_.rings_.push_back(this);
+    }
+
+    ~shm_async_ring() {
+        if (ring_) {
+            db_disarm(ring_->get());
+            auto& v = reactor_.rings_;
+            for (size_t i = 0; i < v.size(); ++i)
+                if (v[i] == this) { v[i] = v.back(); v.pop_back(); break; }
+        }
+        if (efd_ >= 0) close(efd_);
+        if (lfd_ >= 0) close(lfd_);
+    }
+    shm_async_ring(const shm_async_ring&) = delete;
+    shm_async_ring& operator=(const shm_async_ring&) = delete;
+
+    bool ok() const { return ring_.has_value(); }
+    const char* name() const { return name_; }
+    Shared* shm() const { return ring_ ? ring_->get() : nullptr; }
+    const LzStats& lz_stats() const { return fa_.st; }
+    const SeqTrack& seq_stats() const { return seq_; }
+    // Bỏ bản ghi lặp seq thay vì giao cho coroutine (reader --dedup).
+    void set_dedup(bool on) { seq_.dedup = on ? 1 : 0; }
+
+    // co_await ring.next(): bản ghi kế tiếp, nullopt khi hết luồng hoặc lỗi.
+    auto next() { return awaiter<false>(*this, 1); }
+    // co_await ring.next_batch(max): chờ ít nhất một bản ghi rồi lấy thêm những
+    // bản ghi đã sẵn có (tối đa max). Vector rỗng khi hết luồng hoặc lỗi.
+    auto next_batch(size_t max = 64) { return awaiter<true>(*this, max ? max : 1); }
+
+private:
+    friend class shm_reactor;
+
+    // 0: có bản ghi, 1: rỗng, -1: hết (hết luồng hoặc lỗi).
+    // Như reader.c: ring_pop_frames() giải frame nén (writer -z) và kiểm tra seq
+    // từng ô (seqtrack.h). RING_EOS của luồng đã kết thúc từ trước khi gắn vào
+    // (segment cũ chưa cleanup) chỉ là rỗng: chờ writer mới như stream_wait_open().
+    // Sau shm_request_drain(): không chờ thêm, vòng đệm cạn hoặc hết hạn là hết.
+    int try_pop(shm_record& out) {
+        if (eof_ || !ring_) return -1;
+        uint64_t deadline = shm_drain_deadline.load(std::memory_order_relaxed);
+        if (deadline && shm_mono_ns() >= deadline) { eof_ = true; return -1; }
+        if (!live_ && !(__atomic_load_n(&shm()->ctl, __ATOMIC_ACQUIRE) & SHM_CTL_DRAIN)) live_ = true;
+        int rc = ring_pop_frames(shm(), &fa_, &out.meta, out.data, 1);
+        if (rc == -1) { perror("ring_pop"); eof_ = true; return -1; }
+        if (rc == RING_EOS && !live_ && !deadline) return 1;
+        if (rc == RING_EOS || (rc == 1 && deadline)) { eof_ = true; return -1; }
+        if (rc == 0) live_ = true;
+        return rc;
+    }
+
+    template <bool Batch>
+    struct awaiter {
+        shm_async_ring& r;
+        size_t max;
+        shm_record first;
+        int state = 1;     // kết quả try_pop cho bản ghi đầu tiên
+        bool yielded = false;
+
+        awaiter(shm_async_ring& ring, size_t m) : r(ring), max(m) {}
+
+        bool await_ready() {
+            state = r.try_pop(first);
+            if (state == 1) return false;
+            if (++r.streak_ < kYieldEvery) return true;
+            // Đã có bản ghi nhưng chạy liên tục quá lâu: nhường reactor một vòng
+            r.streak_ = 0;
+            yielded = true;
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            if (yielded) {
+                r.reactor_.schedule(h);
+                return true;
+            }
+            r.streak_ = 0;
+            // Arm rồi kiểm tra lại: writer publish trước khi đọc armed (xem doorbell.h)
+            db_arm(r.shm());
+            state = r.try_pop(first);
+            if (state != 1) { db_disarm(r.shm()); return false; }
+            r.waiter_ = h;
+            r.slot_ = &first;
+            r.state_ = &state;
+            return true;
+        }
+
+        auto await_resume() {
+            if constexpr (Batch) {
+                std::vector<shm_record> out;
+                if (state != 0) return out;
+                out.reserve(max);
+                out.push_back(first);
+                while (out.size() < max) {
+                    shm_record rec;
+                    if (r.try_pop(rec) != 0) break;
+                    out.push_back(rec);
+                }
+                return out;
+            } else {
+                return state == 0 ? std::optional<shm_record>(first) : std::nullopt;
+            }
+        }
+    };
+
+    // Reactor báo chuông (hoặc hết hạn an toàn): lấy bản ghi cho coroutine đang
+    // chờ; nếu vòng đệm vẫn rỗng thì arm lại và chờ tiếp.
+    void wake() {
+        if (!waiter_) return;
+        int st = try_pop(*slot_);
+        if (st == 1) {
+            db_arm(shm());
+            st = try_pop(*slot_);
+            if (st == 1) return;
+        }
+        db_disarm(shm());
+        *state_ = st;
+        auto h = waiter_;
+        waiter_ = nullptr;
+        reactor_.schedule(h);
+    }
+
+    shm_reactor& reactor_;
+    const char* name_;
+    std::optional<shm_ring<shm_text, CAP>> ring_;
+    int efd_ = -1;
+    int lfd_ = -1;
+    shm_reactor::fd_slot efd_slot_, lfd_slot_;
+    bool eof_ = false;
+    int streak_ = 0;
+    FrameAsm fa_{};
+    SeqTrack seq_{};
+    bool live_ = false; // đã thấy luồng đang mở (không phải luồng cũ đã kết thúc)
+    std::coroutine_handle<> waiter_;
+    shm_record* slot_ = nullptr;
+    int* state_ = nullptr;
+};
+
+inline void shm_reactor::run() {
+    struct epoll_event evs[64];
+    while (!rings_.empty() || !ready_.empty()) {
+        // Chạy các coroutine đã sẵn sàng; coroutine được đưa vào hàng trong lúc
+        // chạy sẽ đợi vòng sau, để epoll vẫn được phục vụ.
+        size_t n = ready_.size();
+        for (size_t i = 0; i < n; ++i) {
+            auto h = ready_.front();
+            ready_.pop_front();
+            h.resume();
+        }
+        if (rings_.empty()) continue;
+
+        int k = epoll_wait(ep_, evs, 64, ready_.empty() ? kSafetyMs : 0);
+        if (k < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            return;
+        }
+        // Bị tín hiệu ngắt (có thể vừa shm_request_drain): thử lại mọi vòng đệm
+        if ((k == 0 && ready_.empty()) || k < 0) {
+            for (size_t i = 0; i < rings_.size(); ++i) rings_[i]->wake();
+            continue;
+        }
+        for (int j = 0; j < k; ++j) {
+            auto* s = static_cast<fd_slot*>(evs[j].data.ptr);
+            if (s->listen) {
+                db_serve(s->ring->lfd_, s->ring->efd_);
+            } else {
+                db_ack(s->ring->efd_);
+                s->ring->wake();
+            }
+        }
+    }
+}
@@ -0,0 +1,501 @@
+#pragma once
+// shm_ring.hpp — thư viện C++17 header-only bọc vòng đệm dùng chung.
+//
+//   shm_ring<T, N>         vòng đệm N phần tử kiểu T (T trivially copyable) trong
+//                          segment riêng; push/pop là phép gán T, không memcpy.
+//   shm_ring<shm_text, CAP> chính segment Shared của writer/reader (C), đi qua
+//                          seg_open/ring_push/ring_pop nên hai bên dùng lẫn được.
+//   shm_observer           map Shared chỉ đọc và chụp bằng seqlock (GUI, công cụ).
+//   shm_arena_view         liệt kê các kênh của một arena (arena.h), chỉ đọc.
+//
+// Mở/ftruncate/mmap/khởi tạo semaphore chỉ nằm ở đây và trong segment.h.
+// Segment tự munmap/close khi đối tượng bị hủy; handle producer/consumer chỉ
+// di chuyển được (move-only) và phải sống ngắn hơn vòng đệm sinh ra chúng.
+//
+//   auto ring = shm_ring<Tick, 1024>::open("/ticks", SEG_PRODUCER);
+//   auto tx = ring->producer();
+//   tx.push(Tick{...});
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "segment.h"
+#include "stream.h"
+
+// Tag cho vòng đệm văn bản (layout Shared của writer/reader).
+struct shm_text {};
+
+namespace shm_detail {
+
+inline void set_err(std::string* err, const char* what) {
+    if (err) *err = std::string(what) + ": " + std::strerror(errno);
+}
+
+// Vùng mmap + fd, tự giải phóng.
+class mapping {
+public:
+    mapping() = default;
+    mapping(void* addr, std::size_t size, int fd) : addr_(addr), size_(size), fd_(fd) {}
+    mapping(mapping&& o) noexcept { swap(o); }
+    mapping& operator=(mapping&& o) noexcept { if (this != &o) { reset(); swap(o); } return *this; }
+    mapping(const mapping&) = delete;
+    mapping& operator=(const mapping&) = delete;
+    ~mapping() { reset(); }
+
+    void* get() const { return addr_; }
+    void reset() {
+        if (addr_) munmap(addr_, size_);
+        if (fd_ >= 0) close(fd_);
+        addr_ = nullptr;
+        fd_ = -1;
+    }
+
+private:
+    void swap(mapping& o) noexcept {
+        std::swap(addr_, o.addr_);
+        std::swap(size_, o.size_);
+        std::swap(fd_, o.fd_);
+    }
+    void* addr_ = nullptr;
+    std::size_t size_ = 0;
+    int fd_ = -1;
+};
+
+constexpr unsigned kTypedMagic = 0x53485254u; // "SHRT"
+
+// Header của vòng đệm kiểu T. slot_size/capacity được kiểm tra khi attach để
+// hai process biên dịch với T khác nhau không đọc nhầm dữ liệu của nhau.
+struct typed_header {
+    unsigned magic; // kTypedMagic, ghi sau cùng khi khởi tạo xong
+    unsigned seq;   // seqlock như Shared.seq
+    uint32_t slot_size;
+    uint32_t capacity;
+    sem_t empty, full, mutex;
+    uint64_t in, out;
+};
+
+template <class T, std::size_t N>
+struct typed_layout {
+    typed_header hdr;
+    T slots[N];
+};
+
+template <class T, std::size_t N>
+struct geometry {
+    static_assert(N > 0, "capacity must be positive");
+    static constexpr std::size_t capacity = N;
+    static constexpr std::size_t slot_size = sizeof(T);
+    static constexpr bool pow2 = (N & (N - 1)) == 0;
+    static constexpr std::size_t slot(uint64_t i) noexcept {
+        if constexpr (pow2) return static_cast<std::size_t>(i & (N - 1));
+        else return static_cast<std::size_t>(i % N);
+    }
+};
+
+inline void seq_begin(unsigned* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+inline void seq_end(unsigned* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+} // namespace shm_detail
+
+template <class T, std::size_t Capacity, bool = std::is_trivially_copyable_v<T>>
+class shm_ring;
+
+// T có constructor/destructor không tầm thường: không thể đặt vào bộ nhớ dùng chung.
+template <class T, std::size_t Capacity>
+class shm_ring<T, Capacity, false> {
+    static_assert(sizeof(T) == 0, "shm_ring<T>: T must be trivially copyable");
+};
+
+// ---- Vòng đệm kiểu T ----
+// Cùng giao thức với Shared (empty/full/mutex, in/out tăng dần, seqlock) nhưng
+// ô là T: với struct kích thước cố định, push/pop biên dịch thành load/store thẳng.
+template <class T, std::size_t Capacity>
+class shm_ring<T, Capacity, true> : public shm_detail::geometry<T, Capacity> {
+    using layout = shm_detail::typed_layout<T, Capacity>;
+    using geo = shm_detail::geometry<T, Capacity>;
+
+public:
+    static constexpr std::size_t segment_size = sizeof(layout);
+
+    class producer_handle {
+    public:
+        producer_handle() = default;
+        producer_handle(producer_handle&& o) noexcept : l_(std::exchange(o.l_, nullptr)) {}
+        producer_handle& operator=(producer_handle&& o) noexcept { l_ = std::exchange(o.l_, nullptr); return *this; }
+        producer_handle(const producer_handle&) = delete;
+        producer_handle& operator=(const producer_handle&) = delete;
+
+        explicit operator bool() const { return l_ != nullptr; }
+
+        // Chờ ô trống rồi ghi v. Trả về false nếu sem_wait lỗi (errno giữ nguyên).
+        bool push(const T& v) {
+            if (sem_wait(&l_->hdr.empty) == -1) return false;
+            return put(v);
+        }
+        // Không chờ: false (errno = EAGAIN) nếu vòng đệm đầy.
+        bool try_push(const T& v) {
+            if (sem_trywait(&l_->hdr.empty) == -1) return false;
+            return put(v);
+        }
+
+    private:
+        friend class shm_ring;
+        explicit producer_handle(layout* l) : l_(l) {}
+        bool put(const T& v) {
+            if (sem_wait(&l_->hdr.mutex) == -1) return false;
+            shm_detail::seq_begin(&l_->hdr.seq);
+            l_->slots[geo::slot(l_->hdr.in)] = v;
+            l_->hdr.in++;
+            shm_detail::seq_end(&l_->hdr.seq);
+            sem_post(&l_->hdr.mutex);
+            sem_post(&l_->hdr.full);
+            return true;
+        }
+        layout* l_ = nullptr;
+    };
+
+    class consumer_handle {
+    public:
+        consumer_handle() = default;
+        consumer_handle(consumer_handle&& o) noexcept : l_(std::exchange(o.l_, nullptr)) {}
+        consumer_handle& operator=(consumer_handle&& o) noexcept { l_ = std::exchange(o.l_, nullptr); return *this; }
+        consumer_handle(const consumer_handle&) = delete;
+        consumer_handle& operator=(const consumer_handle&) = delete;
+
+        explicit operator bool() const { return l_ != nullptr; }
+
+        bool pop(T& out) {
+            if (sem_wait(&l_->hdr.full) == -1) return false;
+            return take(out);
+        }
+        bool try_pop(T& out) {
+            if (sem_trywait(&l_->hdr.full) == -1) return false;
+            return take(out);
+        }
+
+    private:
+        friend class shm_ring;
+        explicit consumer_handle(layout* l) : l_(l) {}
+        bool take(T& out) {
+            if (sem_wait(&l_->hdr.mutex) == -1) return false;
+            out = l_->slots[geo::slot(l_->hdr.out)];
+            shm_detail::seq_begin(&l_->hdr.seq);
+            l_->hdr.out++;
+            shm_detail::seq_end(&l_->hdr.seq);
+            sem_post(&l_->hdr.mutex);
+            sem_post(&l_->hdr.empty);
+            return true;
+        }
+        layout* l_ = nullptr;
+    };
+
+    // Producer tạo segment nếu chưa có; consumer chờ tối đa wait_secs giây.
+    static std::optional<shm_ring> open(const char* name, int role, int wait_secs = 5, std::string* err = nullptr) {
+        bool creator = false;
+        int fd = -1;
+        if (role == SEG_PRODUCER) {
+            fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+            if (fd >= 0) creator = true;
+            else if (errno == EEXIST) fd = shm_open(name, O_RDWR, 0666);
+        } else {
+            for (int i = 0; i <= wait_secs * 10; ++i) {
+                fd = shm_open(name, O_RDWR, 0666);
+                if (fd >= 0 || errno != ENOENT) break;
+                usleep(100 * 1000);
+            }
+        }
+        if (fd < 0) { shm_detail::set_err(err, "shm_open"); return std::nullopt; }
+
+        if (creator) {
+            if (ftruncate(fd, segment_size) == -1) { shm_detail::set_err(err, "ftruncate"); close(fd); return std::nullopt; }
+        } else {
+            struct stat st;
+            for (int i = 0; i <= wait_secs * 100; ++i) {
+                if (fstat(fd, &st) == -1) { shm_detail::set_err(err, "fstat"); close(fd); return std::nullopt; }
+                if ((std::size_t)st.st_size >= segment_size) break;
+                usleep(10 * 1000);
+            }
+            if ((std::size_t)st.st_size < segment_size) {
+                if (err) *err = "segment too small for this ring geometry";
+                close(fd);
+                return std::nullopt;
+            }
+        }
+
+        void* p = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) { shm_detail::set_err(err, "mmap"); close(fd); return std::nullopt; }
+        shm_detail::mapping m(p, segment_size, fd);
+        auto* l = static_cast<layout*>(p);
+
+        if (creator) {
+            std::memset(static_cast<void*>(&l->hdr), 0, sizeof(l->hdr));
+            l->hdr.slot_size = (uint32_t)geo::slot_size;
+            l->hdr.capacity = (uint32_t)Capacity;
+            if (sem_init(&l->hdr.empty, 1, (unsigned)Capacity) == -1 ||
+                sem_init(&l->hdr.full, 1, 0) == -1 ||
+                sem_init(&l->hdr.mutex, 1, 1) == -1) {
+                shm_detail::set_err(err, "sem_init");
+                return std::nullopt;
+            }
+            __atomic_store_n(&l->hdr.magic, shm_detail::kTypedMagic, __ATOMIC_RELEASE);
+        } else {
+            int ready = 0;
+            for (int i = 0; i <= (wait_secs > 0 ? wait_secs : 1) * 100 && !ready; ++i) {
+                ready = __atomic_load_n(&l->hdr.magic, __ATOMIC_ACQUIRE) == shm_detail::kTypedMagic;
+                if (!ready) usleep(10 * 1000);
+            }
+            if (!ready) { if (err) *err = "ring not initialized (bad magic)"; return std::nullopt; }
+            if (l->hdr.slot_size != geo::slot_size || l->hdr.capacity != Capacity) {
+                if (err) *err = "ring geometry mismatch (different T or Capacity)";
+                return std::nullopt;
+            }
+        }
+        return shm_ring(std::move(m), creator);
+    }
+
+    static int unlink(const char* name) { return shm_unlink(name); }
+
+    producer_handle producer() { return producer_handle(l()); }
+    consumer_handle consumer() { return consumer_handle(l()); }
+
+    bool creator() const { return creator_; }
+    // Số phần tử đang nằm trong vòng đệm (đọc không khóa, chỉ để quan sát).
+    uint64_t size() const {
+        return __atomic_load_n(&l()->hdr.in, __ATOMIC_RELAXED) - __atomic_load_n(&l()->hdr.out, __ATOMIC_RELAXED);
+    }
+
+private:
+    shm_ring(shm_detail::mapping m, bool creator) : map_(std::move(m)), creator_(creator) {}
+    layout* l() const { return static_cast<layout*>(map_.get()); }
+
+    shm_detail::mapping map_;
+    bool creator_ = false;
+};
+
+// ---- Vòng đệm văn bản (Shared) ----
+// Bọc Segment của segment.h: cùng file/tên shm, cùng RecMeta, nên một client
+// C++ nói chuyện được với writer/reader C và ngược lại.
+template <std::size_t Capacity>
+class shm_ring<shm_text, Capacity, true> {
+    static_assert(Capacity == CAP, "shm_ring<shm_text>: capacity is fixed by shared.h (CAP)");
+
+public:
+    static constexpr std::size_t capacity = CAP;
+    static constexpr std::size_t slot_size = MSG_MAX;
+    static constexpr std::size_t segment_size = sizeof(Shared);
+
+    // Giữ một ô luồng như writer (stream.h): mở khi tạo handle, kết thúc khi
+    // handle bị hủy, bị gán đè hoặc gọi close(), để reader nhận RING_EOS.
+    class producer_handle {
+    public:
+        producer_handle() = default;
+        producer_handle(producer_handle&& o) noexcept
+            : shm_(std::exchange(o.shm_, nullptr)), stream_(std::exchange(o.stream_, -1)) {}
+        producer_handle& operator=(producer_handle&& o) noexcept {
+            if (this != &o) {
+                close();
+                shm_ = std::exchange(o.shm_, nullptr);
+                stream_ = std::exchange(o.stream_, -1);
+            }
+            return *this;
+        }
+        producer_handle(const producer_handle&) = delete;
+        producer_handle& operator=(const producer_handle&) = delete;
+        ~producer_handle() { close(); }
+
+        explicit operator bool() const { return shm_ != nullptr; }
+
+        // Kết thúc luồng của producer này; handle không dùng được nữa. Trả về true
+        // nếu đây là producer cuối (như stream_end). Consumer doorbell cần được gõ
+        // chuông sau đó (db_ring).
+        bool close() {
+            if (!shm_) return false;
+            return stream_end(std::exchange(shm_, nullptr), std::exchange(stream_, -1)) != 0;
+        }
+
+        // msg dài hơn MSG_MAX-1 bị cắt. in_pos như ring_push.
+        bool push(std::string_view msg, uint32_t flags = 0, uint32_t crc = 0, uint64_t in_pos = 0) {
+            RecMeta meta = {};
+            meta.len = (uint32_t)msg.size();
+            meta.crc = crc;
+            meta.flags = flags;
+            return ring_push(shm_, &meta, msg.data(), in_pos) == 0;
+        }
+        // Làn ưu tiên 1..PRIO_LANES (shared.h); reader lấy trước vòng đệm chính.
+        bool push_lane(unsigned lane, std::string_view msg, uint32_t flags = 0, uint32_t crc = 0) {
+            if (lane == 0 || lane > PRIO_LANES) return push(msg, flags, crc);
+            RecMeta meta = {};
+            meta.len = (uint32_t)msg.size();
+            meta.crc = crc;
+            meta.flags = flags;
+            return ring_push_lane(shm_, lane, &meta, msg.data()) == 0;
+        }
+
+    private:
+        friend class shm_ring;
+        explicit producer_handle(Shared* shm) : shm_(shm), stream_(stream_open(shm)) {}
+        Shared* shm_ = nullptr;
+        int stream_ = -1;
+    };
+
+    class consumer_handle {
+    public:
+        consumer_handle() = default;
+        consumer_handle(consumer_handle&& o) noexcept : seg_(std::exchange(o.seg_, nullptr)) {}
+        consumer_handle& operator=(consumer_handle&& o) noexcept { seg_ = std::exchange(o.seg_, nullptr); return *this; }
+        consumer_handle(const consumer_handle&) = delete;
+        consumer_handle& operator=(const consumer_handle&) = delete;
+
+        explicit operator bool() const { return seg_ != nullptr; }
+
+        // 0: có bản ghi, 1: rỗng (chỉ khi nonblock), RING_EOS: hết luồng, -1: lỗi. Như ring_pop.
+        int pop(char (&msg)[MSG_MAX], RecMeta* meta = nullptr, bool nonblock = false) {
+            RecMeta m;
+            int rc = ring_pop(seg_->shm, &m, msg, nonblock);
+            if (rc == 0 && meta) *meta = m;
+            return rc;
+        }
+        // Durable: trả các ô đã xử lý cho writer (xem ring_commit).
+        int commit() { return ring_commit(seg_); }
+
+    private:
+        friend class shm_ring;
+        explicit consumer_handle(Segment* seg) : seg_(seg) {}
+        Segment* seg_ = nullptr;
+    };
+
+    static std::optional<shm_ring> open(const SegConfig& cfg) {
+        shm_ring r;
+        if (seg_open(&r.seg_, &cfg) == -1) return std::nullopt;
+        return r;
+    }
+
+    // tag = nullptr: không in thông báo tạo/gắn segment (chỉ in lỗi).
+    static std::optional<shm_ring> open(const char* name, int role, int wait_secs = 5, const char* tag = "shm_ring") {
+        SegConfig cfg = {};
+        cfg.name = name;
+        cfg.role = role;
+        cfg.wait_secs = wait_secs;
+        cfg.tag = tag;
+        return open(cfg);
+    }
+
+    shm_ring(shm_ring&& o) noexcept : seg_(o.seg_) { o.seg_.shm = nullptr; o.seg_.fd = -1; o.seg_.broker = -1; o.seg_.arena = nullptr; }
+    shm_ring& operator=(shm_ring&& o) noexcept {
+        if (this != &o) { seg_close(&seg_); seg_ = o.seg_; o.seg_.shm = nullptr; o.seg_.fd = -1; o.seg_.broker = -1; o.seg_.arena = nullptr; }
+        return *this;
+    }
+    shm_ring(const shm_ring&) = delete;
+    shm_ring& operator=(const shm_ring&) = delete;
+    ~shm_ring() { seg_close(&seg_); }
+
+    // Handle trỏ vào seg_ nên vòng đệm không được di chuyển khi còn handle.
+    producer_handle producer() { return producer_handle(seg_.shm); }
+    consumer_handle consumer() { return consumer_handle(&seg_); }
+
+    Shared* get() const { return seg_.shm; }
+    bool creator() const { return seg_.creator != 0; }
+
+private:
+    shm_ring() { std::memset(&seg_, 0, sizeof(seg_)); seg_.fd = -1; seg_.broker = -1; }
+    Segment seg_;
+};
+
+// ---- Observer chỉ đọc ----
+// Map Shared với PROT_READ; không đụng semaphore nên không làm chậm writer/reader.
+class shm_observer {
+public:
+    // durable = true: name là đường dẫn file vòng đệm (-f). "arena:kênh": kênh trong arena,
+    // "@tên": vòng đệm của shm_broker.
+    static std::optional<shm_observer> open(const char* name, bool durable = false, std::string* err = nullptr) {
+        char arena[256], chan[ARENA_NAME_MAX];
+        if (!durable && arena_split(name, arena, sizeof(arena), chan, sizeof(chan))) {
+            std::size_t size = 0;
+            ArenaHeader* h = arena_map_raw(arena, 0, PROT_READ, 0, &size, nullptr);
+            if (!h) { if (err) *err = "cannot map arena"; return std::nullopt; }
+            shm_detail::mapping m(h, size, -1);
+            const ArenaDirEntry* e = arena_lookup(h, chan);
+            if (!e) { if (err) *err = "no such channel"; return std::nullopt; }
+            return shm_observer(std::move(m), arena_block(h, e->block));
+        }
+        if (!durable && name[0] != '@') {
+            // POSIX shm: vùng điều khiển + vùng dữ liệu nối tiếp nhau (segment.h)
+            const char* what = nullptr;
+            const Shared* shm = seg_map_observer(name, &what);
+            if (!shm) { shm_detail::set_err(err, what); return std::nullopt; }
+            return shm_observer(shm_detail::mapping(const_cast<Shared*>(shm), sizeof(Shared), -1), shm);
+        }
+        int conn = -1;
+        int fd = durable ? ::open(name, O_RDONLY | O_CLOEXEC) : mb_request(name + 1, MB_ROLE_OBSERVER, 0, &conn, nullptr);
+        if (fd < 0) { shm_detail::set_err(err, durable ? "open" : "shm_broker"); return std::nullopt; }
+        struct stat st;
+        if (fstat(fd, &st) == -1) { shm_detail::set_err(err, "fstat"); close(fd); return std::nullopt; }
+        if ((std::size_t)st.st_size < sizeof(Shared)) {
+            if (err) *err = "segment too small";
+            close(fd);
+            return std::nullopt;
+        }
+        void* p = mmap(nullptr, sizeof(Shared), PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) { shm_detail::set_err(err, "mmap"); close(fd); return std::nullopt; }
+        return shm_observer(shm_detail::mapping(p, sizeof(Shared), fd), static_cast<const Shared*>(p));
+    }
+
+    const Shared* get() const { return shm_; }
+    // Như shm_snapshot(): true nếu bản chụp nhất quán.
+    bool snapshot(ShmSnapshot& out, int max_tries = 64) const { return shm_snapshot(get(), &out, max_tries) != 0; }
+
+private:
+    shm_observer(shm_detail::mapping m, const Shared* shm) : map_(std::move(m)), shm_(shm) {}
+    shm_detail::mapping map_;
+    const Shared* shm_ = nullptr;
+};
+
+// ---- Danh sách kênh của một arena (chỉ đọc) ----
+class shm_arena_view {
+public:
+    struct channel {
+        std::string name;
+        const Shared* shm;
+    };
+
+    static std::optional<shm_arena_view> open(const char* arena, std::string* err = nullptr) {
+        std::size_t size = 0;
+        ArenaHeader* h = arena_map_raw(arena, 0, PROT_READ, 0, &size, nullptr);
+        if (!h) { if (err) *err = "cannot map arena"; return std::nullopt; }
+        return shm_arena_view(shm_detail::mapping(h, size, -1));
+    }
+
+    // Bản chụp danh sách kênh; con trỏ Shared còn hợp lệ khi view còn sống.
+    std::vector<channel> channels() const {
+        std::vector<channel> out;
+        arena_foreach(header(), [](void* ctx, const char* name, const Shared* shm) {
+            static_cast<std::vector<channel>*>(ctx)->push_back(channel{name, shm});
+            return 0;
+        }, &out);
+        return out;
+    }
+
+    const ArenaHeader* header() const { return static_cast<const ArenaHeader*>(map_.get()); }
+
+private:
+    explicit shm_arena_view(shm_detail::mapping m) : map_(std::move(m)) {}
+    shm_detail::mapping map_;
+};
@@ -0,0 +1,141 @@
+// shmstat.c
+// gcc shmstat.c -o shmstat -pthread
+// Observer chỉ đọc: map SHM với PROT_READ và lấy bản chụp nhất quán bằng seqlock,
+// không đụng tới semaphore nên không làm chậm writer/reader.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include "shared.h"
+#include "segment.h"
+
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s [-n /shm_name | -f ring.dat] [-i ms] [-c count]\n"
+        "  -n  tên POSIX shm, arena:kênh hoặc @tên (vòng đệm của shm_broker) (mặc định: %s)\n"
+        "  -f  vòng đệm durable trong file\n"
+        "  -i  chu kỳ lặp lại, mili giây (mặc định: chụp 1 lần)\n"
+        "  -c  số lần chụp khi có -i (mặc định: vô hạn)\n",
+        prog, SHM_NAME);
+}
+
+static int show(const Shared* shm, int interval_ms, long count){
+    ShmSnapshot snap;
+    for (long n = 0; count < 0 || n < count; ++n) {
+        int ok = shm_snapshot(shm, &snap, 1000);
+        printf("seq=%u in=%llu out=%llu used=%llu%s\n", snap.seq,
+               (unsigned long long)snap.in, (unsigned long long)snap.out,
+               (unsigned long long)(snap.in - snap.out), ok ? "" : " (torn)");
+        printf("  crc_errors=%llu\n", (unsigned long long)__atomic_load_n(&shm->stats.crc_errors, __ATOMIC_RELAXED));
+        uint64_t lz_raw = __atomic_load_n(&shm->stats.lz_raw_bytes, __ATOMIC_RELAXED);
+        uint64_t lz_wire = __atomic_load_n(&shm->stats.lz_wire_bytes, __ATOMIC_RELAXED);
+        if (lz_raw) printf("  lz_raw_bytes=%llu lz_wire_bytes=%llu (%.1f%%)\n", (unsigned long long)lz_raw,
+                           (unsigned long long)lz_wire, 100.0 * (double)lz_wire / (double)lz_raw);
+        uint64_t dict_refs = __atomic_load_n(&shm->stats.dict_refs, __ATOMIC_RELAXED);
+        if (dict_refs) printf("  dict_refs=%llu dict_saved=%llu dict_misses=%llu\n", (unsigned long long)dict_refs,
+                              (unsigned long long)__atomic_load_n(&shm->stats.dict_saved, __ATOMIC_RELAXED),
+                              (unsigned long long)__atomic_load_n(&shm->stats.dict_misses, __ATOMIC_RELAXED));
+        uint64_t seq_missing = __atomic_load_n(&shm->stats.seq_missing, __ATOMIC_RELAXED);
+        uint64_t seq_dups = __atomic_load_n(&shm->stats.seq_dups, __ATOMIC_RELAXED);
+        uint64_t seq_restarts = __atomic_load_n(&shm->stats.seq_restarts, __ATOMIC_RELAXED);
+        printf("  epoch=%u last_seq=%llu", __atomic_load_n(&shm->producer_epoch, __ATOMIC_RELAXED),
+               (unsigned long long)__atomic_load_n(&shm->in_seq, __ATOMIC_RELAXED));
+        if (seq_missing || seq_dups || seq_restarts)
+            printf(" seq_missing=%llu seq_dups=%llu seq_skipped=%llu seq_restarts=%llu", (unsigned long long)seq_missing,
+                   (unsigned long long)seq_dups,
+                   (unsigned long long)__atomic_load_n(&shm->stats.seq_skipped, __ATOMIC_RELAXED),
+                   (unsigned long long)seq_restarts);
+        printf("\n");
+        for (unsigned k = 0; k < MAX_PRODUCERS; ++k) {
+            const ProducerSlot* ps = &shm->producers[k];
+            int pid = __atomic_load_n(&ps->pid, __ATOMIC_RELAXED);
+            if (pid) printf("  producer pid=%d inflight=%llu sent=%llu credit_waits=%llu\n", pid,
+                            (unsigned long long)__atomic_load_n(&ps->inflight, __ATOMIC_RELAXED),
+                            (unsigned long long)__atomic_load_n(&ps->sent, __ATOMIC_RELAXED),
+                            (unsigned long long)__atomic_load_n(&ps->waits, __ATOMIC_RELAXED));
+        }
+        for (unsigned k = 0; k < PRIO_LANES; ++k) {
+            const Lane* l = &shm->lanes[k];
+            uint64_t pops = __atomic_load_n(&shm->stats.lane_pops[k], __ATOMIC_RELAXED);
+            if (pops || l->in != l->out)
+                printf("  lane %u: pending=%llu popped=%llu\n", k + 1, (unsigned long long)(l->in - l->out), (unsigned long long)pops);
+        }
+        size_t in_slot = snap.in % CAP, out_slot = snap.out % CAP;
+        for (size_t i = 0; i < CAP; ++i) {
+            snap.buf[i][MSG_MAX-1] = '\0';
+            printf("  [%zu]%s %s\n", i,
+                   i == in_slot && i == out_slot ? " <>" : i == in_slot ? " > " : i == out_slot ? " < " : "   ",
+                   snap.buf[i]);
+        }
+        fflush(stdout);
+        if (interval_ms <= 0) break;
+        usleep((useconds_t)interval_ms * 1000);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv){
+    const char* shm_name = SHM_NAME;
+    const char* ring_path = NULL;
+    int interval_ms = 0;
+    long count = -1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:i:c:h")) != -1){
+        if (opt == 'n') shm_name = optarg;
+        else if (opt == 'f') ring_path = optarg;
+        else if (opt == 'i') interval_ms = atoi(optarg);
+        else if (opt == 'c') count = atol(optarg);
+        else { usage(argv[0]); return 1; }
+    }
+
+    char arena[256], chan[ARENA_NAME_MAX];
+    if (!ring_path && arena_split(shm_name, arena, sizeof(arena), chan, sizeof(chan))) {
+        size_t size;
+        const ArenaHeader* h = arena_map_raw(arena, 0, PROT_READ, 0, &size, NULL);
+        if (!h) return 1;
+        const ArenaDirEntry* e = arena_lookup(h, chan);
+        if (!e) { fprintf(stderr, "No channel '%s' in arena '%s'\n", chan, arena); return 1; }
+        return show(arena_block(h, e->block), interval_ms, count);
+    }
+
+    if (!ring_path && shm_name[0] != '@') {
+        // POSIX shm: vùng điều khiển và vùng dữ liệu, cả hai map PROT_READ
+        const char* what;
+        const Shared* shm = seg_map_observer(shm_name, &what);
+        if (!shm) { perror(what); return 1; }
+        int rc = show(shm, interval_ms, count);
+        munmap((void*)shm, sizeof(*shm));
+        return rc;
+    }
+
+    int shmfd, conn;
+    if (!ring_path) {
+        // Vòng đệm ẩn danh: xin fd từ broker, không giữ vòng đệm sống
+        shmfd = mb_request(shm_name + 1, MB_ROLE_OBSERVER, 0, &conn, NULL);
+        if (shmfd < 0) return 1;
+    } else {
+        shmfd = open(ring_path, O_RDONLY);
+        if (shmfd < 0) { perror("open ring file"); return 1; }
+    }
+
+    struct stat st;
+    if (fstat(shmfd, &st) == -1) { perror("fstat"); return 1; }
+    if ((size_t)st.st_size < sizeof(Shared)) {
+        fprintf(stderr, "SHM size too small.\n");
+        return 1;
+    }
+
+    const Shared* shm = mmap(NULL, sizeof(Shared), PROT_READ, MAP_SHARED, shmfd, 0);
+    if (shm == MAP_FAILED) { perror("mmap"); return 1; }
+    close(shmfd);
+
+    int rc = show(shm, interval_ms, count);
+    munmap((void*)shm, sizeof(*shm));
+    return rc;
+}
@@ -0,0 +1,145 @@
+#pragma once
+// splicesink.h — đưa output của reader ra file/pipe bằng vmsplice + splice.
+// Bản ghi được ring_pop chép thẳng từ ô vòng đệm vào các chunk căn trang (lần
+// chép duy nhất), chunk đầy thì vmsplice các trang đó vào pipe:
+//  - output là pipe (vd. stdout | consumer): vmsplice thẳng vào pipe đó. Kernel chỉ
+//    giữ tham chiếu tới trang nên chunk chỉ được dùng lại khi pipe chắc chắn đã
+//    nhả nó: vòng chunk lớn hơn dung lượng pipe.
+//  - output là file: vmsplice vào pipe trung gian rồi splice sang file; splice
+//    trả về thì dữ liệu đã vào page cache, chunk dùng lại được ngay.
+// Ô vòng đệm (MSG_MAX byte, dùng lại ngay) không thể tặng nguyên trang cho kernel,
+// nên layout căn trang nằm ở chunk của reader chứ không ở Shared.
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define SPLICE_CHUNK (64 * 1024)
+#define SPLICE_PIPE (1024 * 1024) // dung lượng pipe xin thêm bằng F_SETPIPE_SZ
+
+typedef struct {
+    int out_fd;
+    int to_pipe;           // 1: out_fd là pipe, vmsplice thẳng
+    int pfd[2];            // pipe trung gian khi out_fd là file
+    int use_write;         // file không hỗ trợ splice: write() thường
+    char* pool;            // nchunks * SPLICE_CHUNK, căn trang
+    size_t nchunks, cur, len;
+    uint64_t bytes, chunks;
+} SpliceSink;
+
+static inline char* splice_chunk(SpliceSink* ss, size_t i) { return ss->pool + i * SPLICE_CHUNK; }
+
+// path "-": stdout. mode như fopen ("w" hoặc "a").
+static inline int splice_sink_open(SpliceSink* ss, const char* path, const char* mode) {
+    memset(ss, 0, sizeof(*ss));
+    ss->pfd[0] = ss->pfd[1] = -1;
+    if (strcmp(path, "-") == 0) ss->out_fd = STDOUT_FILENO;
+    else ss->out_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (mode[0] == 'a' ? O_APPEND : O_TRUNC), 0644);
+    if (ss->out_fd < 0) return -1;
+    struct stat st;
+    if (fstat(ss->out_fd, &st) == -1) return -1;
+    ss->to_pipe = S_ISFIFO(st.st_mode);
+
+    int pipe_bytes;
+    if (ss->to_pipe) {
+        fcntl(ss->out_fd, F_SETPIPE_SZ, SPLICE_PIPE); // không được thì giữ dung lượng cũ
+        pipe_bytes = fcntl(ss->out_fd, F_GETPIPE_SZ);
+    } else {
+        if (pipe2(ss->pfd, O_CLOEXEC) == -1) return -1;
+        fcntl(ss->pfd[1], F_SETPIPE_SZ, SPLICE_CHUNK);
+        pipe_bytes = SPLICE_CHUNK;
+    }
+    if (pipe_bytes < SPLICE_CHUNK) pipe_bytes = SPLICE_CHUNK;
+    // Pipe giữ tối đa pipe_bytes / trang tham chiếu; thêm 2 chunk để chunk đang ghi
+    // và chunk vừa vmsplice không bao giờ còn nằm trong pipe khi được dùng lại.
+    ss->nchunks = ss->to_pipe ? (size_t)pipe_bytes / 4096 + 2 : 1;
+    if (posix_memalign((void**)&ss->pool, 4096, ss->nchunks * SPLICE_CHUNK) != 0) {
+        ss->pool = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+static inline int splice_write_all(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t k = write(fd, p, n);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+// Chuyển n byte đang nằm trong pipe trung gian sang file.
+static inline int splice_drain(SpliceSink* ss, size_t n) {
+    while (n > 0) {
+        ssize_t k = splice(ss->pfd[0], NULL, ss->out_fd, NULL, n, SPLICE_F_MOVE);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (k == 0) { errno = EIO; return -1; }
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+// Đẩy chunk hiện tại ra output rồi chuyển sang chunk kế tiếp.
+static inline int splice_sink_flush(SpliceSink* ss) {
+    if (ss->len == 0) return 0;
+    char* p = splice_chunk(ss, ss->cur);
+    size_t n = ss->len;
+    ss->bytes += n;
+    ss->chunks++;
+    ss->len = 0;
+    ss->cur = (ss->cur + 1) % ss->nchunks;
+    if (ss->use_write) return splice_write_all(ss->out_fd, p, n);
+    int target = ss->to_pipe ? ss->out_fd : ss->pfd[1];
+    while (n > 0) {
+        struct iovec iov = { p, n };
+        ssize_t k = vmsplice(target, &iov, 1, 0);
+        if (k < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (!ss->to_pipe && splice_drain(ss, (size_t)k) == -1) {
+            if (errno != EINVAL) return -1;
+            // Hệ thống file không nhận splice: lấy lại phần đã vào pipe, từ nay write() thường
+            char tmp[SPLICE_CHUNK];
+            ssize_t got = read(ss->pfd[0], tmp, (size_t)k);
+            if (got < 0 || splice_write_all(ss->out_fd, tmp, (size_t)got) == -1) return -1;
+            ss->use_write = 1;
+            return splice_write_all(ss->out_fd, p + k, n - (size_t)k);
+        }
+        p += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+// Chỗ ghi cho tối đa need byte (need <= SPLICE_CHUNK) trong chunk hiện tại.
+static inline char* splice_sink_reserve(SpliceSink* ss, size_t need) {
+    if (SPLICE_CHUNK - ss->len < need && splice_sink_flush(ss) == -1) return NULL;
+    return splice_chunk(ss, ss->cur) + ss->len;
+}
+
+static inline void splice_sink_commit(SpliceSink* ss, size_t n) { ss->len += n; }
+
+static inline int splice_sink_close(SpliceSink* ss) {
+    int rc = ss->pool ? splice_sink_flush(ss) : 0;
+    if (ss->pfd[0] >= 0) close(ss->pfd[0]);
+    if (ss->pfd[1] >= 0) close(ss->pfd[1]);
+    if (ss->out_fd > STDERR_FILENO && close(ss->out_fd) == -1) rc = -1;
+    free(ss->pool);
+    ss->pool = NULL;
+    return rc;
+}
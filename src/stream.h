@@ -0,0 +1,84 @@
+#pragma once
+// stream.h — kết thúc luồng ngoài dải dữ liệu (thay cho bản ghi "END" trước đây).
+//
+// Mỗi producer mở luồng bằng stream_open() (giữ một ô pid trong Shared.streams)
+// và tự đánh dấu kết thúc của mình bằng stream_end(). Khi không còn producer nào
+// đang mở (ô của process đã chết không tính), SHM_CTL_DRAIN được bật: consumer
+// lấy nốt mọi bản ghi còn lại, kể cả ở làn ưu tiên, rồi ring_pop trả RING_EOS.
+// Không có bản ghi đặc biệt nào trong vòng đệm, nên dòng input đúng bằng "END" đi
+// qua như mọi dòng khác và mọi consumer (không chỉ consumer lấy được END) đều thấy
+// hết luồng. Đánh thức không cần hỏi vòng: stream_end post thêm một token full,
+// consumer nhận RING_EOS trả token đó lại cho consumer kế tiếp. Producer chết mà
+// không kịp stream_end thì consumer đang chờ dọn ô của nó (stream_reap, shared.h).
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "shared.h"
+
+static inline long stream_futex(unsigned* addr, int op, unsigned val) {
+    return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+#define STREAM_BUSY (-2) // stream_open_excl: vòng đệm đang có producer khác
+
+// Mở luồng cho producer này (bỏ DRAIN nếu luồng trước đã kết thúc). Trả về ô để
+// truyền cho stream_end, -1 nếu bảng đầy: vẫn đẩy được, nhưng consumer có thể
+// thấy hết luồng trước khi producer này xong.
+// excl != 0: producer cần là producer duy nhất của vòng đệm (writer -l lấy offset
+// log từ shm->in ngoài mutex vòng đệm). Trả về STREAM_BUSY nếu còn producer khác
+// đang mở luồng, và khi producer độc quyền còn sống thì mọi producer khác cũng
+// nhận STREAM_BUSY. *holder (nếu khác NULL) nhận pid của producer gây xung đột.
+static inline int stream_open_excl(Shared* shm, int excl, int* holder) {
+    int me = (int)getpid(), slot = -1, busy = 0;
+    sem_wait(&shm->mutex);
+    if (shm->stream_excl != me && stream_pid_alive(shm->stream_excl)) busy = shm->stream_excl;
+    for (int k = 0; k < MAX_PRODUCERS && excl && !busy; ++k)
+        if (shm->streams[k] != me && stream_pid_alive(shm->streams[k])) busy = shm->streams[k];
+    if (busy) {
+        sem_post(&shm->mutex);
+        if (holder) *holder = busy;
+        return STREAM_BUSY;
+    }
+    for (int k = 0; k < MAX_PRODUCERS && slot < 0; ++k)
+        if (!stream_pid_alive(shm->streams[k])) slot = k;
+    if (slot >= 0) shm->streams[slot] = me;
+    if (excl) shm->stream_excl = me;
+    unsigned ctl = shm->ctl;
+    __atomic_store_n(&shm->ctl, ctl & ~SHM_CTL_DRAIN, __ATOMIC_RELEASE);
+    sem_post(&shm->mutex);
+    if (ctl & SHM_CTL_DRAIN) stream_futex(&shm->ctl, FUTEX_WAKE, INT_MAX); // stream_wait_open
+    return slot;
+}
+
+static inline int stream_open(Shared* shm) {
+    return stream_open_excl(shm, 0, NULL);
+}
+
+// Producer này đã đẩy xong. Trả về 1 nếu nó là producer cuối (luồng kết thúc).
+// Quét bảng trong mutex để không đè lên producer đang stream_open cùng lúc.
+static inline int stream_end(Shared* shm, int slot) {
+    sem_wait(&shm->mutex);
+    if (slot >= 0) shm->streams[slot] = 0;
+    if (shm->stream_excl == (int)getpid()) shm->stream_excl = 0;
+    int open = 0;
+    for (int k = 0; k < MAX_PRODUCERS && !open; ++k) open = stream_pid_alive(shm->streams[k]);
+    int first = !open && !(shm->ctl & SHM_CTL_DRAIN);
+    if (first) __atomic_store_n(&shm->ctl, shm->ctl | SHM_CTL_DRAIN, __ATOMIC_RELEASE);
+    sem_post(&shm->mutex);
+    if (first) sem_post(&shm->full);
+    return !open;
+}
+
+// Consumer vừa gắn vào segment của luồng đã kết thúc và đã cạn (segment cũ chưa
+// cleanup): ngủ trên futex tới khi có producer mới thay vì thoát ngay.
+// Trả về -1 nếu bị tín hiệu ngắt.
+static inline int stream_wait_open(Shared* shm) {
+    for (;;) {
+        unsigned ctl = __atomic_load_n(&shm->ctl, __ATOMIC_ACQUIRE);
+        if (!(ctl & SHM_CTL_DRAIN) || !shm_drained(shm)) return 0;
+        if (stream_futex(&shm->ctl, FUTEX_WAIT, ctl) == -1 && errno == EINTR) return -1;
+    }
+}
@@ -0,0 +1,392 @@
+// stress.c — chạy dài giao thức vòng đệm với nhiều writer, kèm tiêm lỗi, và kiểm
+// tra từng bản ghi từ đầu tới cuối.
+// gcc stress.c -o stress -pthread
+// gcc -O1 -g -fsanitize=thread stress.c -o stress_tsan -pthread   (dùng với -T)
+//
+// Mỗi writer đẩy bản ghi "w<id> e<epoch> s<seq> <đệm>" dài ngẫu nhiên, có CRC32C;
+// phần đệm suy ra được từ (id, epoch, seq) nên reader phát hiện cả dữ liệu hỏng.
+// epoch tăng mỗi lần writer bị SIGKILL rồi chạy lại, seq đếm lại từ 0.
+// Reader kiểm tra seq của từng (writer, epoch) phải liên tục: thiếu (gap), lặp (dup),
+// đến muộn (reorder). Kết thúc: đối chiếu số bản ghi reader nhận với số writer đã
+// đẩy xong (writer bị kill có thể đã đẩy thêm đúng một bản ghi chưa kịp đếm).
+//
+// Lỗi được tiêm theo lịch sinh từ -s seed: SIGSTOP/SIGCONT writer hoặc reader,
+// SIGKILL writer rồi chạy lại. Không có tiến triển sau -t giây thì báo STALL kèm
+// trạng thái semaphore: SIGKILL giữa sem_wait(empty)/mutex và sem_post là kiểu lỗi
+// giao thức semaphore hiện tại không tự phục hồi được.
+// -T: writer/reader là thread trong một process (dùng chung một mapping) để chạy
+// dưới ThreadSanitizer; lỗi tiêm là tạm dừng thread.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "segment.h"
+#include "crc32c.h"
+
+#define ST_MAX_WRITERS 16
+#define ST_MAX_EPOCHS 256
+#define ST_MAX_HOLES 4096 // số seq thiếu tối đa được theo dõi mỗi luồng (để phân biệt reorder/dup)
+
+// Vùng chung giữa supervisor, writer và reader (MAP_SHARED ẩn danh trước fork)
+typedef struct {
+    uint64_t pushed[ST_MAX_WRITERS][ST_MAX_EPOCHS]; // writer: số bản ghi đã đẩy xong
+    uint64_t next[ST_MAX_WRITERS][ST_MAX_EPOCHS];   // reader: seq kế tiếp mong đợi
+    unsigned killed[ST_MAX_WRITERS][ST_MAX_EPOCHS]; // epoch này kết thúc bằng SIGKILL
+    unsigned epoch[ST_MAX_WRITERS];                 // epoch hiện tại của mỗi writer
+    unsigned paused[ST_MAX_WRITERS + 1];            // -T: thread cần tạm dừng (ms), [n] = reader
+    uint64_t delivered, dups, reorders, bad;
+    uint64_t holes; // reader: seq còn thiếu lúc hết luồng
+    uint64_t stops, kills;
+    int stop;   // supervisor yêu cầu writer dừng
+    int done;   // reader đã thấy hết luồng
+} StressShared;
+
+typedef struct {
+    const char* name;
+    int writers;
+    int threads;
+    uint64_t seed;
+    Shared* shm; // -T: mapping dùng chung
+    StressShared* st;
+} StressCfg;
+
+// Lỗ hổng seq của một luồng (writer, epoch), chỉ reader dùng
+typedef struct {
+    uint64_t* seq;
+    unsigned n;
+} Holes;
+
+static uint64_t splitmix(uint64_t* s){
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(unsigned ms){
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+// Độ dài và phần đệm chỉ phụ thuộc (seed, id, epoch, seq): reader tính lại để so
+static size_t stress_fill(char* buf, uint64_t seed, unsigned id, unsigned epoch, uint64_t seq){
+    uint64_t s = seed ^ ((uint64_t)id << 56) ^ ((uint64_t)epoch << 40) ^ seq;
+    size_t len = 24 + splitmix(&s) % (MSG_MAX - 24);
+    int h = snprintf(buf, MSG_MAX, "w%02u e%03u s%llu ", id, epoch, (unsigned long long)seq);
+    for (size_t i = (size_t)h; i < len; ++i) buf[i] = (char)('a' + (seq + i) % 26);
+    buf[len] = '\0';
+    return len;
+}
+
+static void writer_main(const StressCfg* c, unsigned id, unsigned epoch){
+    Segment seg;
+    Shared* shm = c->shm;
+    if (!shm) {
+        SegConfig cfg = { .name = c->name, .role = SEG_PRODUCER };
+        if (seg_open(&seg, &cfg) == -1) _exit(1);
+        shm = seg.shm;
+    }
+    StressShared* st = c->st;
+    char msg[MSG_MAX];
+    for (uint64_t seq = 0; !__atomic_load_n(&st->stop, __ATOMIC_ACQUIRE); ++seq) {
+        unsigned pause = c->threads ? __atomic_exchange_n(&st->paused[id], 0u, __ATOMIC_ACQ_REL) : 0;
+        if (pause) sleep_ms(pause);
+        size_t len = stress_fill(msg, c->seed, id, epoch, seq);
+        RecMeta meta = { .len = (uint32_t)len, .crc = crc32c(msg, len), .flags = REC_F_CRC };
+        if (ring_push(shm, &meta, msg, 0) == -1) { perror("ring_push"); break; }
+        __atomic_store_n(&st->pushed[id][epoch], seq + 1, __ATOMIC_RELEASE);
+    }
+    if (!c->shm) seg_close(&seg);
+}
+
+// Kiểm tra một bản ghi
+static void verify(const StressCfg* c, Holes (*holes)[ST_MAX_EPOCHS], const RecMeta* meta, const char* msg){
+    StressShared* st = c->st;
+    unsigned id, epoch;
+    unsigned long long seq;
+    char expect[MSG_MAX];
+    if (!(meta->flags & REC_F_CRC) || crc32c(msg, meta->len) != meta->crc
+        || sscanf(msg, "w%u e%u s%llu ", &id, &epoch, &seq) != 3
+        || id >= (unsigned)c->writers || epoch >= ST_MAX_EPOCHS
+        || stress_fill(expect, c->seed, id, epoch, seq) != meta->len || memcmp(expect, msg, meta->len) != 0) {
+        if (__atomic_fetch_add(&st->bad, 1, __ATOMIC_RELAXED) < 5) fprintf(stderr, "[stress] corrupt record: %.40s\n", msg);
+        return;
+    }
+    uint64_t* next = &st->next[id][epoch];
+    Holes* h = &holes[id][epoch];
+    if (seq == *next) {
+        __atomic_store_n(next, seq + 1, __ATOMIC_RELEASE);
+    } else if (seq > *next) {
+        // Thiếu [next, seq): ghi nhớ để phân biệt bản ghi đến muộn với bản ghi mất
+        for (uint64_t s = *next; s < seq && h->n < ST_MAX_HOLES; ++s) {
+            if (!h->seq) h->seq = malloc(ST_MAX_HOLES * sizeof(uint64_t));
+            if (h->seq) h->seq[h->n++] = s;
+        }
+        __atomic_store_n(next, seq + 1, __ATOMIC_RELEASE);
+    } else {
+        unsigned k = 0;
+        while (k < h->n && h->seq[k] != seq) ++k;
+        if (k < h->n) {
+            h->seq[k] = h->seq[--h->n];
+            __atomic_fetch_add(&st->reorders, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_add(&st->dups, 1, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_fetch_add(&st->delivered, 1, __ATOMIC_RELEASE);
+}
+
+static void reader_main(const StressCfg* c){
+    Segment seg;
+    Shared* shm = c->shm;
+    if (!shm) {
+        SegConfig cfg = { .name = c->name, .role = SEG_CONSUMER, .wait_secs = 5 };
+        if (seg_open(&seg, &cfg) == -1) _exit(1);
+        shm = seg.shm;
+    }
+    Holes (*holes)[ST_MAX_EPOCHS] = calloc(ST_MAX_WRITERS, sizeof(*holes));
+    if (!holes) { perror("calloc"); _exit(1); }
+    RecMeta meta;
+    char msg[MSG_MAX];
+    for (;;) {
+        unsigned pause = c->threads ? __atomic_exchange_n(&c->st->paused[c->writers], 0u, __ATOMIC_ACQ_REL) : 0;
+        if (pause) sleep_ms(pause);
+        int r = ring_pop(shm, &meta, msg, 0);
+        if (r == -1) { perror("ring_pop"); break; }
+        if (r == RING_EOS) break;
+        verify(c, holes, &meta, msg);
+    }
+    uint64_t lost = 0;
+    for (int i = 0; i < ST_MAX_WRITERS; ++i)
+        for (int e = 0; e < ST_MAX_EPOCHS; ++e) {
+            lost += holes[i][e].n;
+            free(holes[i][e].seq);
+        }
+    free(holes);
+    c->st->holes = lost;
+    __atomic_store_n(&c->st->done, 1, __ATOMIC_RELEASE);
+    if (!c->shm) seg_close(&seg);
+}
+
+static pid_t spawn_writer(const StressCfg* c, unsigned id){
+    pid_t pid = fork();
+    if (pid == 0) {
+        writer_main(c, id, c->st->epoch[id]);
+        _exit(0);
+    }
+    if (pid < 0) perror("fork");
+    return pid;
+}
+
+typedef struct {
+    const StressCfg* c;
+    unsigned id;
+} ThreadArg;
+
+static void* writer_thread(void* p){
+    ThreadArg* a = p;
+    writer_main(a->c, a->id, 0);
+    return NULL;
+}
+
+static void* reader_thread(void* p){
+    ThreadArg* a = p;
+    reader_main(a->c);
+    return NULL;
+}
+
+// Không có tiến triển: in trạng thái vòng đệm để biết ai đang giữ gì
+static void report_stall(const char* name, double secs){
+    const char* what;
+    const Shared* shm = seg_map_observer(name, &what);
+    fprintf(stderr, "[stress] STALL: no record delivered for %.0f s\n", secs);
+    if (!shm) return;
+    int e = -1, f = -1, m = -1;
+    sem_getvalue((sem_t*)&shm->empty, &e);
+    sem_getvalue((sem_t*)&shm->full, &f);
+    sem_getvalue((sem_t*)&shm->mutex, &m);
+    fprintf(stderr, "[stress] in=%llu out=%llu released=%llu sem empty=%d full=%d mutex=%d\n",
+            (unsigned long long)shm->in, (unsigned long long)shm->out, (unsigned long long)shm->released, e, f, m);
+    if (m == 0) fprintf(stderr, "[stress] mutex held (by a killed writer?)\n");
+    else if (e + (int)(shm->in - shm->released) < CAP) fprintf(stderr, "[stress] empty token(s) lost (writer killed after sem_wait(empty))\n");
+    munmap((void*)shm, sizeof(Shared));
+}
+
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s [-n /shm_name] [-w writers] [-d secs] [-s seed] [-r faults/s] [-F stop,kill] [-t secs] [-T]\n"
+        "  -n  vòng đệm dùng để thử (mặc định: /shm_stress, bị xóa trước khi chạy)\n"
+        "  -w  số writer (mặc định: 2, tối đa %d)\n"
+        "  -d  thời gian chạy, giây (mặc định: 10)\n"
+        "  -s  seed cho độ dài bản ghi và lịch tiêm lỗi (mặc định: 1)\n"
+        "  -r  số lỗi tiêm mỗi giây (mặc định: 5, 0: không tiêm)\n"
+        "  -F  loại lỗi: stop (SIGSTOP/SIGCONT writer hoặc reader), kill (SIGKILL writer rồi\n"
+        "      chạy lại với epoch mới) (mặc định: stop,kill)\n"
+        "  -t  báo STALL nếu không có bản ghi nào tới reader trong chừng này giây (mặc định: 5)\n"
+        "  -T  writer/reader là thread (cho ThreadSanitizer); lỗi tiêm là tạm dừng thread\n",
+        prog, ST_MAX_WRITERS);
+}
+
+int main(int argc, char** argv){
+    StressCfg c = { .name = "/shm_stress", .writers = 2, .seed = 1 };
+    double duration = 10, rate = 5, stall_secs = 5;
+    int f_stop = 1, f_kill = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:d:s:r:F:t:Th")) != -1){
+        if (opt == 'n') c.name = optarg;
+        else if (opt == 'w') c.writers = atoi(optarg);
+        else if (opt == 'd') duration = atof(optarg);
+        else if (opt == 's') c.seed = strtoull(optarg, NULL, 10);
+        else if (opt == 'r') rate = atof(optarg);
+        else if (opt == 'F') { f_stop = strstr(optarg, "stop") != NULL; f_kill = strstr(optarg, "kill") != NULL; }
+        else if (opt == 't') stall_secs = atof(optarg);
+        else if (opt == 'T') c.threads = 1;
+        else { usage(argv[0]); return 1; }
+    }
+    if (c.writers < 1 || c.writers > ST_MAX_WRITERS) { usage(argv[0]); return 1; }
+    if (c.name[0] != '/') { fprintf(stderr, "-n: stress needs a POSIX shm name\n"); return 1; }
+
+    StressShared* st = mmap(NULL, sizeof(StressShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (st == MAP_FAILED) { perror("mmap"); return 1; }
+    c.st = st;
+    crc32c("", 0); // chọn đường CRC một lần trước khi có nhiều thread
+    seg_unlink(c.name);
+    uint64_t rng = c.seed;
+
+    // Supervisor tạo vòng đệm và giữ luồng mở (stream.h) tới khi mọi writer đã dừng,
+    // nên writer bị kill rồi chạy lại không làm reader thấy hết luồng giữa chừng
+    Segment seg;
+    SegConfig cfg = { .name = c.name, .role = SEG_PRODUCER, .tag = "stress" };
+    if (seg_open(&seg, &cfg) == -1) return 1;
+    int stream = stream_open(seg.shm);
+    if (c.threads) c.shm = seg.shm;
+
+    pid_t wpid[ST_MAX_WRITERS], rpid = -1;
+    pthread_t wth[ST_MAX_WRITERS], rth;
+    ThreadArg targ[ST_MAX_WRITERS + 1];
+    if (c.threads) {
+        targ[c.writers] = (ThreadArg){ &c, 0 };
+        pthread_create(&rth, NULL, reader_thread, &targ[c.writers]);
+        for (int i = 0; i < c.writers; ++i) {
+            targ[i] = (ThreadArg){ &c, (unsigned)i };
+            pthread_create(&wth[i], NULL, writer_thread, &targ[i]);
+        }
+    } else {
+        rpid = fork();
+        if (rpid == 0) {
+            reader_main(&c);
+            _exit(0);
+        }
+        for (int i = 0; i < c.writers; ++i) wpid[i] = spawn_writer(&c, (unsigned)i);
+    }
+    fprintf(stderr, "[stress] %d writer %s, %.0f s, seed %llu, %.1f fault(s)/s (%s%s)\n", c.writers,
+            c.threads ? "thread(s)" : "process(es)", duration, (unsigned long long)c.seed, rate,
+            f_stop ? "stop " : "", f_kill && !c.threads ? "kill" : "");
+
+    double t0 = now_sec(), last_print = t0, last_progress = t0, next_fault = t0;
+    uint64_t last_delivered = 0, printed = 0;
+    int stalled = 0;
+    while (now_sec() - t0 < duration) {
+        sleep_ms(10);
+        double t = now_sec();
+        uint64_t d = __atomic_load_n(&st->delivered, __ATOMIC_ACQUIRE);
+        if (d != last_delivered) { last_delivered = d; last_progress = t; }
+        if (t - last_progress > stall_secs) { stalled = 1; break; }
+        if (t - last_print >= 1.0) {
+            printf("t=%5.1fs delivered=%llu (%.0f rec/s) stops=%llu kills=%llu\n", t - t0,
+                   (unsigned long long)d, (d - printed) / (t - last_print),
+                   (unsigned long long)st->stops, (unsigned long long)st->kills);
+            fflush(stdout);
+            printed = d;
+            last_print = t;
+        }
+        if (rate <= 0 || t < next_fault || (!f_stop && !(f_kill && !c.threads))) continue;
+        next_fault = t + (double)(splitmix(&rng) % 2000) / 1000.0 / rate; // trung bình 1/rate giây
+        unsigned who = (unsigned)(splitmix(&rng) % (unsigned)(c.writers + 1)); // == writers: reader
+        unsigned ms = 1 + (unsigned)(splitmix(&rng) % 50);
+        int kill_it = f_kill && !c.threads && who < (unsigned)c.writers && (!f_stop || splitmix(&rng) % 2)
+                      && st->epoch[who] + 1 < ST_MAX_EPOCHS;
+        if (c.threads) {
+            __atomic_store_n(&st->paused[who], ms, __ATOMIC_RELEASE);
+            st->stops++;
+        } else if (kill_it) {
+            kill(wpid[who], SIGKILL);
+            waitpid(wpid[who], NULL, 0);
+            st->killed[who][st->epoch[who]] = 1;
+            st->epoch[who]++;
+            st->kills++;
+            wpid[who] = spawn_writer(&c, who);
+        } else if (f_stop) {
+            pid_t p = who < (unsigned)c.writers ? wpid[who] : rpid;
+            kill(p, SIGSTOP);
+            sleep_ms(ms);
+            kill(p, SIGCONT);
+            st->stops++;
+        }
+    }
+
+    if (stalled) {
+        report_stall(c.name, now_sec() - last_progress);
+        if (c.threads) _exit(2); // thread bị kẹt trong sem_wait không join được
+        for (int i = 0; i < c.writers; ++i) kill(wpid[i], SIGKILL);
+        kill(rpid, SIGKILL);
+        while (wait(NULL) > 0) {}
+        seg_close(&seg);
+        seg_unlink(c.name);
+        return 2;
+    }
+
+    // Dừng writer, chờ chúng đẩy nốt rồi kết thúc luồng
+    __atomic_store_n(&st->stop, 1, __ATOMIC_RELEASE);
+    int reader_ok = 1;
+    if (c.threads) {
+        for (int i = 0; i < c.writers; ++i) pthread_join(wth[i], NULL);
+    } else {
+        for (int i = 0; i < c.writers; ++i) waitpid(wpid[i], NULL, 0);
+    }
+    stream_end(seg.shm, stream);
+    if (c.threads) {
+        pthread_join(rth, NULL);
+    } else {
+        int status = 0;
+        waitpid(rpid, &status, 0);
+        reader_ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    if (!reader_ok || !st->done) fprintf(stderr, "[stress] reader failed\n");
+    double dt = now_sec() - t0;
+
+    // Đối chiếu: reader phải nhận đúng số bản ghi writer đã đẩy xong; epoch kết thúc
+    // bằng SIGKILL được phép nhiều hơn đúng một (đã đẩy nhưng chưa kịp đếm).
+    uint64_t short_by = 0, extra = 0, pushed = 0;
+    for (int i = 0; i < c.writers; ++i)
+        for (unsigned e = 0; e <= st->epoch[i]; ++e) {
+            uint64_t p = st->pushed[i][e], n = st->next[i][e];
+            pushed += p;
+            if (n < p) short_by += p - n;
+            else if (n > p + (st->killed[i][e] ? 1 : 0)) extra += n - p;
+        }
+    uint64_t lost = short_by + st->holes;
+    int ok = reader_ok && st->done && st->bad == 0 && st->dups == 0 && st->reorders == 0 && lost == 0 && extra == 0;
+    printf("[stress] %s: %llu record(s) in %.1f s (%.0f rec/s), pushed %llu, stops %llu, kills %llu\n",
+           ok ? "PASS" : "FAIL", (unsigned long long)st->delivered, dt, st->delivered / dt,
+           (unsigned long long)pushed, (unsigned long long)st->stops, (unsigned long long)st->kills);
+    printf("[stress] lost %llu, duplicated %llu, reordered %llu, corrupt %llu, unexpected %llu\n",
+           (unsigned long long)lost, (unsigned long long)st->dups, (unsigned long long)st->reorders,
+           (unsigned long long)st->bad, (unsigned long long)extra);
+    seg_close(&seg);
+    seg_unlink(c.name);
+    return ok ? 0 : 1;
+}
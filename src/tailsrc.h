@@ -0,0 +1,369 @@
+#pragma once
+// tailsrc.h — theo dõi nhiều file/glob/thư mục như `tail -F` cho writer -t.
+//  - Mỗi file một thread đọc: đọc hết dữ liệu mới, hết thì ngủ trên inotify của
+//    thư mục chứa file (chỉ thức khi chính file đó đổi) hoặc tối đa 1 giây.
+//  - Xoay vòng log (rename + tạo file mới cùng tên): đọc nốt file cũ tới EOF rồi
+//    mở file mới từ đầu. File bị cắt ngắn (truncate) thì đọc lại từ đầu.
+//  - Một thread khám phá theo dõi thư mục của mỗi mẫu, file mới khớp mẫu thì
+//    tạo thread đọc mới (đọc từ đầu). File được nhận diện theo inode, không theo
+//    tên: file cùng inode với file đang theo dõi, hay với một trong
+//    TAIL_OLD_INODES file nó đã đọc trước khi xoay vòng (vd. app.log.1 xuất hiện
+//    sau khi thread đã mở app.log mới), bị bỏ qua để không đọc lặp.
+// Mỗi dòng được đưa cho callback emit() cùng số hiệu và tên nguồn (basename).
+// Chỉ phần tên file của mẫu được là glob; phần thư mục phải là đường dẫn thật.
+#include <dirent.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define TAIL_WAIT_MS 1000
+#define TAIL_READ_CHUNK 65536
+#define TAIL_OLD_INODES 8
+
+// Trả về -1 để dừng thread nguồn này (vd. vòng đệm lỗi). line == NULL: nguồn
+// vừa đọc hết dữ liệu hiện có và sắp ngủ (để caller đẩy phần đang gom, vd. -z).
+typedef int (*TailEmitFn)(void* ctx, uint32_t src, const char* tag, const char* line, size_t len);
+
+struct Tail;
+
+typedef struct {
+    struct Tail* t;
+    char path[PATH_MAX];
+    char dir[PATH_MAX];
+    char base[NAME_MAX + 1];
+    uint32_t id;         // 1, 2, ... theo thứ tự phát hiện
+    int from_end;        // lần mở đầu tiên: bắt đầu ở cuối file
+    pthread_t th;
+    dev_t dev;           // inode đang đọc (đọc/ghi dưới Tail.mu)
+    ino_t ino;
+    struct { dev_t dev; ino_t ino; } old[TAIL_OLD_INODES]; // inode đã đọc xong do xoay vòng (dưới Tail.mu)
+    unsigned nold;
+    uint64_t lines;
+} TailFile;
+
+typedef struct {
+    char dir[PATH_MAX];
+    char pat[NAME_MAX + 1];
+    int wd;
+} TailSpec;
+
+typedef struct Tail {
+    TailEmitFn emit;
+    void* ctx;
+    size_t max_line;     // độ dài tối đa một bản ghi (dòng dài hơn bị chia nhỏ)
+    int from_start;      // đọc file có sẵn từ đầu thay vì từ cuối
+    int stop_fd;         // eventfd: báo mọi thread dừng
+    int stopping;
+    pthread_mutex_t mu;  // bảo vệ files/nfiles và dev/ino
+    TailFile** files;
+    int nfiles, cap;
+    TailSpec* specs;
+    int nspecs;
+    pthread_t disc;
+    int disc_started;
+} Tail;
+
+static inline int tail_init(Tail* t, TailEmitFn emit, void* ctx, size_t max_line, int from_start) {
+    memset(t, 0, sizeof(*t));
+    t->emit = emit;
+    t->ctx = ctx;
+    t->max_line = max_line;
+    t->from_start = from_start;
+    t->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (t->stop_fd < 0) { perror("eventfd"); return -1; }
+    pthread_mutex_init(&t->mu, NULL);
+    return 0;
+}
+
+static inline void tail_split(const char* path, char* dir, size_t dcap, char* base, size_t bcap) {
+    const char* slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(dir, dcap, ".");
+        snprintf(base, bcap, "%s", path);
+    } else {
+        snprintf(dir, dcap, "%.*s", slash == path ? 1 : (int)(slash - path), path);
+        snprintf(base, bcap, "%s", slash + 1);
+    }
+}
+
+// spec: file, glob (vd. logs/*.log) hoặc thư mục (mọi file trong đó).
+static inline int tail_add_spec(Tail* t, const char* spec) {
+    TailSpec* ns = (TailSpec*)realloc(t->specs, (size_t)(t->nspecs + 1) * sizeof(TailSpec));
+    if (!ns) return -1;
+    t->specs = ns;
+    TailSpec* s = &t->specs[t->nspecs++];
+    memset(s, 0, sizeof(*s));
+    struct stat st;
+    if (stat(spec, &st) == 0 && S_ISDIR(st.st_mode)) {
+        snprintf(s->dir, sizeof(s->dir), "%s", spec);
+        size_t n = strlen(s->dir);
+        while (n > 1 && s->dir[n - 1] == '/') s->dir[--n] = '\0';
+        snprintf(s->pat, sizeof(s->pat), "*");
+    } else {
+        tail_split(spec, s->dir, sizeof(s->dir), s->pat, sizeof(s->pat));
+    }
+    s->wd = -1;
+    return 0;
+}
+
+static inline int tail_stopping(Tail* t) {
+    return __atomic_load_n(&t->stopping, __ATOMIC_ACQUIRE);
+}
+
+// Chờ inotify (sự kiện liên quan tới name, hoặc mọi sự kiện nếu name == NULL),
+// stop_fd, hoặc hết ms. Trả về 1 nếu nên kiểm tra lại, 0 nếu đang dừng.
+static inline int tail_wait(Tail* t, int ino_fd, const char* name, int ms) {
+    struct pollfd pfd[2] = { { t->stop_fd, POLLIN, 0 }, { ino_fd, POLLIN, 0 } };
+    for (;;) {
+        if (tail_stopping(t)) return 0;
+        int k = poll(pfd, ino_fd >= 0 ? 2 : 1, ms);
+        if (k < 0 && errno != EINTR) return 1;
+        if (k <= 0) return 1;
+        if (pfd[0].revents) return 0;
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t n = read(ino_fd, buf, sizeof(buf));
+        if (n <= 0) return 1;
+        for (char* p = buf; p < buf + n; ) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (!name || (ev->len && strcmp(ev->name, name) == 0) || (ev->mask & IN_Q_OVERFLOW)) return 1;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+}
+
+// Gọi khi giữ t->mu.
+static inline int tail_inode_known(Tail* t, dev_t dev, ino_t ino, const TailFile* except) {
+    for (int i = 0; i < t->nfiles; ++i) {
+        const TailFile* f = t->files[i];
+        if (f == except) continue;
+        if (f->ino == ino && f->dev == dev) return 1;
+        unsigned n = f->nold < TAIL_OLD_INODES ? f->nold : TAIL_OLD_INODES;
+        for (unsigned k = 0; k < n; ++k)
+            if (f->old[k].ino == ino && f->old[k].dev == dev) return 1;
+    }
+    return 0;
+}
+
+static inline void* tail_file_thread(void* arg) {
+    TailFile* f = (TailFile*)arg;
+    Tail* t = f->t;
+    int ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ino_fd >= 0 && inotify_add_watch(ino_fd, f->dir, IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM |
+                                         IN_DELETE | IN_ATTRIB | IN_CLOSE_WRITE) < 0) {
+        close(ino_fd);
+        ino_fd = -1; // vẫn chạy được nhờ hẹn giờ
+    }
+    char* buf = (char*)malloc(TAIL_READ_CHUNK);
+    char* line = (char*)malloc(t->max_line + 1);
+    size_t have = 0;
+    int fd = -1;
+    int opened = 0; // f->dev/ino là inode thread này đã đọc, không chỉ giữ chỗ
+    if (!buf || !line) goto out;
+
+    while (!tail_stopping(t)) {
+        if (fd < 0) {
+            fd = open(f->path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                if (errno != ENOENT) perror(f->path);
+                if (!tail_wait(t, ino_fd, f->base, TAIL_WAIT_MS)) break;
+                continue;
+            }
+            struct stat st;
+            fstat(fd, &st);
+            if (f->from_end) lseek(fd, 0, SEEK_END);
+            f->from_end = 0;
+            pthread_mutex_lock(&t->mu);
+            if (opened && (f->ino != st.st_ino || f->dev != st.st_dev)) {
+                // Inode cũ (đã đọc tới EOF) vẫn tính là đã theo dõi khi nó hiện ra dưới tên khác
+                unsigned k = f->nold++ % TAIL_OLD_INODES;
+                f->old[k].dev = f->dev;
+                f->old[k].ino = f->ino;
+            }
+            f->dev = st.st_dev;
+            f->ino = st.st_ino;
+            pthread_mutex_unlock(&t->mu);
+            opened = 1;
+            have = 0;
+        }
+
+        ssize_t n = read(fd, buf, TAIL_READ_CHUNK);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror(f->path);
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        if (n > 0) {
+            // Tách dòng; dòng dài hơn max_line được gửi thành nhiều bản ghi (như fgets)
+            for (ssize_t i = 0; i < n; ) {
+                char* nl = (char*)memchr(buf + i, '\n', (size_t)(n - i));
+                size_t seg = nl ? (size_t)(nl - (buf + i)) : (size_t)(n - i);
+                while (seg > 0) {
+                    size_t take = seg < t->max_line - have ? seg : t->max_line - have;
+                    memcpy(line + have, buf + i, take);
+                    have += take;
+                    i += (ssize_t)take;
+                    seg -= take;
+                    if (have == t->max_line) {
+                        if (t->emit(t->ctx, f->id, f->base, line, have) == -1) goto out;
+                        f->lines++;
+                        have = 0;
+                    }
+                }
+                if (nl) {
+                    if (have > 0 && line[have - 1] == '\r') have--;
+                    if (t->emit(t->ctx, f->id, f->base, line, have) == -1) goto out;
+                    f->lines++;
+                    have = 0;
+                    i++;
+                }
+            }
+            continue;
+        }
+
+        // EOF: xoay vòng, cắt ngắn, hay chỉ chưa có dữ liệu mới?
+        struct stat cur, now;
+        fstat(fd, &cur);
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        if (stat(f->path, &now) == 0 && (now.st_ino != cur.st_ino || now.st_dev != cur.st_dev)) {
+            if (have > 0) {
+                if (t->emit(t->ctx, f->id, f->base, line, have) == -1) goto out;
+                f->lines++;
+            }
+            fprintf(stderr, "[writer] %s rotated, reopening\n", f->path);
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        if (cur.st_size < pos) {
+            fprintf(stderr, "[writer] %s truncated, reading from start\n", f->path);
+            lseek(fd, 0, SEEK_SET);
+            have = 0;
+            continue;
+        }
+        if (t->emit(t->ctx, f->id, f->base, NULL, 0) == -1) goto out;
+        if (!tail_wait(t, ino_fd, f->base, TAIL_WAIT_MS)) break;
+    }
+    // Dừng: dòng cuối chưa có '\n' vẫn được gửi để không mất dữ liệu
+    if (have > 0 && t->emit(t->ctx, f->id, f->base, line, have) == 0) f->lines++;
+
+out:
+    if (fd >= 0) close(fd);
+    if (ino_fd >= 0) close(ino_fd);
+    free(buf);
+    free(line);
+    return NULL;
+}
+
+// Gọi khi giữ t->mu. 0 nếu đã theo dõi (hoặc bỏ qua), 1 nếu tạo thread mới.
+static inline int tail_spawn_locked(Tail* t, const char* path, int from_end) {
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) return 0;
+    for (int i = 0; i < t->nfiles; ++i)
+        if (strcmp(t->files[i]->path, path) == 0) return 0;
+    if (tail_inode_known(t, st.st_dev, st.st_ino, NULL)) return 0;
+
+    if (t->nfiles == t->cap) {
+        int nc = t->cap ? t->cap * 2 : 8;
+        TailFile** nf = (TailFile**)realloc(t->files, (size_t)nc * sizeof(*nf));
+        if (!nf) return -1;
+        t->files = nf;
+        t->cap = nc;
+    }
+    TailFile* f = (TailFile*)calloc(1, sizeof(TailFile));
+    if (!f) return -1;
+    f->t = t;
+    snprintf(f->path, sizeof(f->path), "%s", path);
+    tail_split(path, f->dir, sizeof(f->dir), f->base, sizeof(f->base));
+    f->id = (uint32_t)t->nfiles + 1;
+    f->from_end = from_end;
+    f->dev = st.st_dev; // giữ chỗ tới khi thread mở file
+    f->ino = st.st_ino;
+    if (pthread_create(&f->th, NULL, tail_file_thread, f) != 0) { free(f); return -1; }
+    t->files[t->nfiles++] = f;
+    fprintf(stderr, "[writer] tailing %s (source %u%s)\n", path, f->id, from_end ? ", from end" : "");
+    return 1;
+}
+
+static inline void* tail_discovery_thread(void* arg) {
+    Tail* t = (Tail*)arg;
+    int ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ino_fd < 0) { perror("inotify_init1"); return NULL; }
+    for (int i = 0; i < t->nspecs; ++i) {
+        t->specs[i].wd = inotify_add_watch(ino_fd, t->specs[i].dir, IN_CREATE | IN_MOVED_TO);
+        if (t->specs[i].wd < 0) perror(t->specs[i].dir);
+    }
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd[2] = { { t->stop_fd, POLLIN, 0 }, { ino_fd, POLLIN, 0 } };
+    while (!tail_stopping(t)) {
+        int k = poll(pfd, 2, -1);
+        if (k < 0) { if (errno == EINTR) continue; perror("poll"); break; }
+        if (pfd[0].revents) break;
+        ssize_t n = read(ino_fd, buf, sizeof(buf));
+        if (n <= 0) continue;
+        for (char* p = buf; p < buf + n; ) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(*ev) + ev->len;
+            if (!ev->len) continue;
+            for (int i = 0; i < t->nspecs; ++i) {
+                TailSpec* s = &t->specs[i];
+                if (s->wd != ev->wd || fnmatch(s->pat, ev->name, 0) != 0) continue;
+                char path[PATH_MAX];
+                if (snprintf(path, sizeof(path), "%s/%s", s->dir, ev->name) >= (int)sizeof(path)) break;
+                pthread_mutex_lock(&t->mu);
+                tail_spawn_locked(t, path, 0);
+                pthread_mutex_unlock(&t->mu);
+                break;
+            }
+        }
+    }
+    close(ino_fd);
+    return NULL;
+}
+
+// Mở các file đang có rồi bắt đầu theo dõi file mới.
+static inline int tail_start(Tail* t) {
+    pthread_mutex_lock(&t->mu);
+    for (int i = 0; i < t->nspecs; ++i) {
+        char pattern[PATH_MAX + NAME_MAX + 2];
+        snprintf(pattern, sizeof(pattern), "%s/%s", t->specs[i].dir, t->specs[i].pat);
+        glob_t g;
+        if (glob(pattern, 0, NULL, &g) == 0) {
+            for (size_t k = 0; k < g.gl_pathc; ++k) tail_spawn_locked(t, g.gl_pathv[k], !t->from_start);
+            globfree(&g);
+        }
+    }
+    pthread_mutex_unlock(&t->mu);
+    if (pthread_create(&t->disc, NULL, tail_discovery_thread, t) != 0) return -1;
+    t->disc_started = 1;
+    return 0;
+}
+
+static inline void tail_stop(Tail* t) {
+    __atomic_store_n(&t->stopping, 1, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    if (write(t->stop_fd, &one, sizeof(one)) < 0) perror("tail stop");
+    if (t->disc_started) pthread_join(t->disc, NULL);
+    for (int i = 0; i < t->nfiles; ++i) {
+        pthread_join(t->files[i]->th, NULL);
+        fprintf(stderr, "[writer] %s: %llu line(s)\n", t->files[i]->path, (unsigned long long)t->files[i]->lines);
+        free(t->files[i]);
+    }
+    free(t->files);
+    free(t->specs);
+    close(t->stop_fd);
+    pthread_mutex_destroy(&t->mu);
+}
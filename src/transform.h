@@ -0,0 +1,78 @@
+#pragma once
+// transform.h — biến đổi từng bản ghi trước khi ghi ra output (reader -x).
+// Thêm biến đổi mới: viết một hàm TransformFn rồi thêm một dòng vào tx_table.
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crc32c.h"
+
+#define TX_OUT_MAX (4 * MSG_MAX) // kích thước tối đa của một dòng sau biến đổi
+
+// Ghi kết quả vào out[cap], trả về độ dài (không tính '\0'). arg: tham số sau
+// dấu ':' trong "-x tên:arg" (0 nếu không có). Phải an toàn khi gọi song song.
+typedef size_t (*TransformFn)(const char* in, size_t len, char* out, size_t cap, long arg);
+
+typedef struct {
+    const char* name;
+    TransformFn fn;
+    const char* help;
+} Transform;
+
+static inline size_t tx_identity(const char* in, size_t len, char* out, size_t cap, long arg) {
+    (void)arg;
+    if (len >= cap) len = cap - 1;
+    memcpy(out, in, len);
+    out[len] = '\0';
+    return len;
+}
+
+static inline size_t tx_upper(const char* in, size_t len, char* out, size_t cap, long arg) {
+    (void)arg;
+    if (len >= cap) len = cap - 1;
+    for (size_t i = 0; i < len; ++i) out[i] = (char)toupper((unsigned char)in[i]);
+    out[len] = '\0';
+    return len;
+}
+
+static inline size_t tx_rot13(const char* in, size_t len, char* out, size_t cap, long arg) {
+    (void)arg;
+    if (len >= cap) len = cap - 1;
+    for (size_t i = 0; i < len; ++i) {
+        char c = in[i];
+        if (c >= 'a' && c <= 'z') c = (char)('a' + (c - 'a' + 13) % 26);
+        else if (c >= 'A' && c <= 'Z') c = (char)('A' + (c - 'A' + 13) % 26);
+        out[i] = c;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Tốn CPU có chủ đích: băm dòng arg lần (mặc định 1000) và nối mã băm vào cuối.
+static inline size_t tx_hash(const char* in, size_t len, char* out, size_t cap, long arg) {
+    long rounds = arg > 0 ? arg : 1000;
+    uint32_t h = 0;
+    for (long i = 0; i < rounds; ++i) h = crc32c_extend(h, in, len);
+    int n = snprintf(out, cap, "%.*s %08x", (int)len, in, h);
+    return n < 0 ? 0 : (size_t)n < cap ? (size_t)n : cap - 1;
+}
+
+static const Transform tx_table[] = {
+    { "none",  tx_identity, "giữ nguyên" },
+    { "upper", tx_upper,    "chữ hoa" },
+    { "rot13", tx_rot13,    "ROT13" },
+    { "hash",  tx_hash,     "hash[:N] nối CRC32C lặp N lần (tốn CPU, để đo)" },
+};
+
+// Tìm theo "tên" hoặc "tên:arg". NULL nếu không có. Gọi trước khi tạo thread
+// (khởi tạo sẵn các bảng tra dùng chung).
+static inline const Transform* tx_find(const char* spec, long* arg) {
+    crc32c_sw(0, "", 0);
+    (void)crc32c_hw_available();
+    const char* colon = strchr(spec, ':');
+    size_t n = colon ? (size_t)(colon - spec) : strlen(spec);
+    *arg = colon ? atol(colon + 1) : 0;
+    for (size_t i = 0; i < sizeof(tx_table) / sizeof(tx_table[0]); ++i)
+        if (strlen(tx_table[i].name) == n && strncmp(tx_table[i].name, spec, n) == 0) return &tx_table[i];
+    return NULL;
+}
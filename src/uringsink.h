@@ -0,0 +1,318 @@
+#pragma once
+// uringsink.h — ghi output qua io_uring (syscall trực tiếp, không cần liburing).
+// Dữ liệu được chép vào một trong URING_DEPTH buffer đã đăng ký với kernel
+// (IORING_REGISTER_BUFFERS); buffer đầy thì gửi IORING_OP_WRITE_FIXED và thread
+// đọc vòng đệm chạy tiếp ngay. Chỉ khi mọi buffer đều đang chờ đĩa mới phải đợi,
+// nên một lần đĩa chậm không làm vòng đệm đứng (trừ khi kéo dài quá URING_DEPTH buffer).
+//
+// uring_fopen() trả về FILE* (fopencookie) để code dùng fprintf/fwrite giữ nguyên.
+// O_DIRECT: buffer căn theo trang, mỗi lần ghi là bội số URING_ALIGN; phần đuôi
+// lẻ được ghi thường sau khi bỏ O_DIRECT lúc đóng file.
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#define URING_DEPTH 8
+#define URING_BUF (256 * 1024)
+#define URING_ALIGN 4096
+
+typedef struct {
+    const char* tag;
+    int ring_fd, out_fd, direct;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_sz, cq_sz, sqes_sz;
+    char* bufs;                 // URING_DEPTH * URING_BUF, căn theo URING_ALIGN
+    uint32_t len[URING_DEPTH];  // số byte trong buffer
+    uint32_t done[URING_DEPTH]; // số byte kernel đã ghi (ghi ngắn thì gửi lại phần còn lại)
+    uint64_t off[URING_DEPTH];  // offset trong file
+    int busy[URING_DEPTH];
+    int cur, next, inflight, err;
+    uint64_t file_off;
+    uint64_t writes, bytes, stalls, max_inflight;
+} UringSink;
+
+static inline int uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline int uring_register(int fd, unsigned op, void* arg, unsigned n) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+static inline char* uring_buf(UringSink* us, int i) { return us->bufs + (size_t)i * URING_BUF; }
+
+static inline void uring_unmap(UringSink* us) {
+    if (us->sqes && us->sqes != MAP_FAILED) munmap(us->sqes, us->sqes_sz);
+    if (us->cq_ptr && us->cq_ptr != MAP_FAILED && us->cq_ptr != us->sq_ptr) munmap(us->cq_ptr, us->cq_sz);
+    if (us->sq_ptr && us->sq_ptr != MAP_FAILED) munmap(us->sq_ptr, us->sq_sz);
+    us->sqes = NULL;
+    us->sq_ptr = us->cq_ptr = NULL;
+}
+
+// Gửi (phần còn lại của) buffer i.
+static inline int uring_submit(UringSink* us, int i) {
+    unsigned tail = *us->sq_tail;
+    unsigned idx = tail & *us->sq_mask;
+    struct io_uring_sqe* sqe = &us->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = 0; // chỉ số trong bảng file đã đăng ký
+    sqe->addr = (uint64_t)(uintptr_t)(uring_buf(us, i) + us->done[i]);
+    sqe->len = us->len[i] - us->done[i];
+    sqe->off = us->off[i] + us->done[i];
+    sqe->buf_index = (uint16_t)i;
+    sqe->user_data = (uint64_t)i;
+    us->sq_array[idx] = idx;
+    __atomic_store_n(us->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    for (;;) {
+        int rc = uring_enter(us->ring_fd, 1, 0, 0);
+        if (rc >= 0) break;
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) { us->err = errno; return -1; }
+    }
+    return 0;
+}
+
+// Xử lý completion; min > 0: chờ tới khi có ít nhất min completion (completion
+// lỗi cũng tính, lỗi nằm ở us->err). Không còn ghi nào đang bay thì không chờ.
+static inline int uring_reap(UringSink* us, unsigned min) {
+    for (;;) {
+        unsigned head = *us->cq_head;
+        unsigned tail = __atomic_load_n(us->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (min == 0 || us->inflight == 0) return 0;
+            if (uring_enter(us->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR) {
+                us->err = errno;
+                return -1;
+            }
+            continue;
+        }
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe* cqe = &us->cqes[head & *us->cq_mask];
+            int i = (int)cqe->user_data;
+            int res = cqe->res;
+            __atomic_store_n(us->cq_head, head + 1, __ATOMIC_RELEASE);
+            if (res == -EINTR || res == -EAGAIN) {
+                if (uring_submit(us, i) == -1) return -1;
+                continue;
+            }
+            if (res < 0) {
+                us->err = -res;
+                us->busy[i] = 0;
+                us->inflight--;
+                if (min) --min;
+                continue;
+            }
+            us->done[i] += (uint32_t)res;
+            if (res > 0 && us->done[i] < us->len[i]) {
+                if (uring_submit(us, i) == -1) return -1;
+                continue;
+            }
+            if (res == 0 && us->done[i] < us->len[i]) us->err = EIO;
+            us->busy[i] = 0;
+            us->inflight--;
+            if (min) --min;
+        }
+        if (min == 0) return 0;
+    }
+}
+
+// Gửi buffer đang gom (len phải là bội URING_ALIGN nếu O_DIRECT).
+static inline int uring_flush_cur(UringSink* us) {
+    int i = us->cur;
+    if (i < 0 || us->len[i] == 0) return 0;
+    us->cur = -1;
+    us->off[i] = us->file_off;
+    us->file_off += us->len[i];
+    us->done[i] = 0;
+    us->busy[i] = 1;
+    if (++us->inflight > (int)us->max_inflight) us->max_inflight = (uint64_t)us->inflight;
+    us->writes++;
+    us->bytes += us->len[i];
+    return uring_submit(us, i);
+}
+
+static inline int uring_sink_write(UringSink* us, const char* data, size_t n) {
+    while (n > 0) {
+        if (us->err) { errno = us->err; return -1; }
+        if (us->cur < 0) {
+            int i = us->next;
+            if (uring_reap(us, 0) == -1) return -1;
+            if (us->busy[i]) {
+                us->stalls++; // mọi buffer đều đang chờ đĩa
+                while (us->busy[i]) if (uring_reap(us, 1) == -1) return -1;
+            }
+            us->cur = i;
+            us->len[i] = 0;
+            us->next = (i + 1) % URING_DEPTH;
+        }
+        int i = us->cur;
+        size_t k = URING_BUF - us->len[i];
+        if (k > n) k = n;
+        memcpy(uring_buf(us, i) + us->len[i], data, k);
+        us->len[i] += (uint32_t)k;
+        data += k;
+        n -= k;
+        if (us->len[i] == URING_BUF && uring_flush_cur(us) == -1) return -1;
+    }
+    return 0;
+}
+
+// Mở file output và io_uring. -1 nếu kernel không hỗ trợ (errno giữ nguyên).
+static inline int uring_sink_open(UringSink* us, const char* path, const char* mode, int direct, const char* tag) {
+    memset(us, 0, sizeof(*us));
+    us->tag = tag;
+    us->cur = -1;
+    us->ring_fd = -1;
+    us->direct = direct;
+    int append = mode[0] == 'a';
+    us->out_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC) | (direct ? O_DIRECT : 0), 0644);
+    if (us->out_fd < 0) return -1;
+    if (append) {
+        off_t end = lseek(us->out_fd, 0, SEEK_END);
+        if (end < 0 || (direct && end % URING_ALIGN)) { // O_DIRECT cần offset căn trang
+            if (end >= 0) errno = EINVAL;
+            goto fail;
+        }
+        us->file_off = (uint64_t)end;
+    }
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    us->ring_fd = uring_setup(URING_DEPTH, &p);
+    if (us->ring_fd < 0) goto fail;
+
+    us->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    us->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (us->cq_sz > us->sq_sz) us->sq_sz = us->cq_sz;
+        us->cq_sz = us->sq_sz;
+    }
+    us->sq_ptr = mmap(NULL, us->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, us->ring_fd, IORING_OFF_SQ_RING);
+    if (us->sq_ptr == MAP_FAILED) goto fail;
+    us->cq_ptr = (p.features & IORING_FEAT_SINGLE_MMAP) ? us->sq_ptr
+               : mmap(NULL, us->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, us->ring_fd, IORING_OFF_CQ_RING);
+    if (us->cq_ptr == MAP_FAILED) goto fail;
+    us->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    us->sqes = (struct io_uring_sqe*)mmap(NULL, us->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                          us->ring_fd, IORING_OFF_SQES);
+    if (us->sqes == MAP_FAILED) goto fail;
+
+    char* sq = (char*)us->sq_ptr;
+    char* cq = (char*)us->cq_ptr;
+    us->sq_head = (unsigned*)(sq + p.sq_off.head);
+    us->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    us->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    us->sq_array = (unsigned*)(sq + p.sq_off.array);
+    us->cq_head = (unsigned*)(cq + p.cq_off.head);
+    us->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    us->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    us->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    if (posix_memalign((void**)&us->bufs, URING_ALIGN, (size_t)URING_DEPTH * URING_BUF) != 0) {
+        us->bufs = NULL;
+        errno = ENOMEM;
+        goto fail;
+    }
+    struct iovec iov[URING_DEPTH];
+    for (int i = 0; i < URING_DEPTH; ++i) {
+        iov[i].iov_base = uring_buf(us, i);
+        iov[i].iov_len = URING_BUF;
+    }
+    if (uring_register(us->ring_fd, IORING_REGISTER_BUFFERS, iov, URING_DEPTH) == -1) goto fail;
+    if (uring_register(us->ring_fd, IORING_REGISTER_FILES, &us->out_fd, 1) == -1) goto fail;
+    return 0;
+
+fail: {
+        int e = errno;
+        uring_unmap(us);
+        free(us->bufs);
+        if (us->ring_fd >= 0) close(us->ring_fd);
+        close(us->out_fd);
+        errno = e;
+        return -1;
+    }
+}
+
+// Ghi nốt, chờ mọi lần ghi hoàn tất, đóng file. -1 nếu có lần ghi lỗi.
+static inline int uring_sink_close(UringSink* us) {
+    int i = us->cur;
+    size_t tail = 0;
+    if (i >= 0 && us->direct) {
+        // Chỉ gửi phần căn trang qua O_DIRECT, phần đuôi ghi thường bên dưới
+        tail = us->len[i] % URING_ALIGN;
+        us->len[i] -= (uint32_t)tail;
+    }
+    uring_flush_cur(us);
+    while (us->inflight > 0 && uring_reap(us, 1) == 0) {}
+    if (tail && !us->err) {
+        int fl = fcntl(us->out_fd, F_GETFL);
+        const char* p = uring_buf(us, i) + us->len[i];
+        if (fl == -1 || fcntl(us->out_fd, F_SETFL, fl & ~O_DIRECT) == -1 ||
+            pwrite(us->out_fd, p, tail, (off_t)us->file_off) != (ssize_t)tail) us->err = errno ? errno : EIO;
+        else {
+            us->bytes += tail;
+            us->file_off += tail;
+        }
+    }
+    if (us->tag)
+        fprintf(stderr, "[%s] io_uring%s: %llu write(s), %.1f MiB, max %llu in flight, %llu stall(s) on full queue\n",
+                us->tag, us->direct ? " O_DIRECT" : "", (unsigned long long)us->writes, (double)us->bytes / (1 << 20),
+                (unsigned long long)us->max_inflight, (unsigned long long)us->stalls);
+    int err = us->err;
+    uring_unmap(us);
+    free(us->bufs);
+    close(us->ring_fd);
+    if (close(us->out_fd) == -1 && !err) err = errno;
+    if (err) { errno = err; return -1; }
+    return 0;
+}
+
+static inline ssize_t uring_cookie_write(void* c, const char* buf, size_t n) {
+    return uring_sink_write((UringSink*)c, buf, n) == 0 ? (ssize_t)n : -1;
+}
+
+static inline int uring_cookie_close(void* c) {
+    int rc = uring_sink_close((UringSink*)c);
+    if (rc == -1) perror("io_uring output");
+    free(c);
+    return rc;
+}
+
+// FILE* ghi qua io_uring (không đệm stdio: mỗi fwrite/fprintf chép thẳng vào
+// buffer đã đăng ký). NULL nếu không mở được (errno giữ nguyên).
+static inline FILE* uring_fopen(const char* path, const char* mode, int direct, const char* tag) {
+    UringSink* us = (UringSink*)malloc(sizeof(UringSink));
+    if (!us) return NULL;
+    if (uring_sink_open(us, path, mode, direct, tag) == -1) {
+        int e = errno;
+        free(us);
+        errno = e;
+        return NULL;
+    }
+    cookie_io_functions_t io = { NULL, uring_cookie_write, NULL, uring_cookie_close };
+    FILE* f = fopencookie(us, "w", io);
+    if (!f) {
+        uring_sink_close(us);
+        free(us);
+        return NULL;
+    }
+    setvbuf(f, NULL, _IONBF, 0);
+    return f;
+}
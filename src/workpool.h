@@ -0,0 +1,139 @@
+#pragma once
+// workpool.h — pool thread work-stealing cho việc chia nhỏ dạng chỉ số.
+// Mỗi worker có một hàng đợi riêng; việc được giao lần lượt cho từng worker,
+// worker lấy việc cũ nhất của mình trước, hết việc thì lấy trộm việc cũ nhất
+// của worker khác (nên worker chậm không giữ lại việc mà worker rảnh làm được).
+// Việc ở đây là cả một lô bản ghi nên chi phí khóa mỗi hàng đợi là không đáng kể.
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+    pthread_mutex_t mu;
+    uint32_t* items;
+    unsigned cap;        // lũy thừa của 2
+    uint64_t head, tail; // [head, tail) đang chờ
+} WsQueue;
+
+struct WorkPool;
+typedef void (*WorkFn)(void* ctx, uint32_t item, int worker);
+
+typedef struct {
+    struct WorkPool* pool;
+    int id;
+    uint64_t executed, stolen;
+} Worker;
+
+typedef struct WorkPool {
+    int n;
+    WsQueue* q;
+    Worker* w;
+    pthread_t* th;
+    WorkFn fn;
+    void* ctx;
+    pthread_mutex_t mu; // bảo vệ pending/stop, cho worker ngủ khi hết việc
+    pthread_cond_t cv;
+    int pending; // có thể tạm âm: worker lấy việc trước khi người giao kịp tăng
+    int stop;
+    unsigned next; // worker nhận việc kế tiếp
+} WorkPool;
+
+static inline int wsq_take(WsQueue* q, uint32_t* item) {
+    int ok = 0;
+    pthread_mutex_lock(&q->mu);
+    if (q->head < q->tail) { *item = q->items[q->head++ & (q->cap - 1)]; ok = 1; }
+    pthread_mutex_unlock(&q->mu);
+    return ok;
+}
+
+static inline int wp_get(WorkPool* wp, Worker* self, uint32_t* item) {
+    if (wsq_take(&wp->q[self->id], item)) return 1;
+    for (int k = 1; k < wp->n; ++k) {
+        if (wsq_take(&wp->q[(self->id + k) % wp->n], item)) { self->stolen++; return 1; }
+    }
+    return 0;
+}
+
+static inline void* wp_worker(void* arg) {
+    Worker* self = (Worker*)arg;
+    WorkPool* wp = self->pool;
+    for (;;) {
+        uint32_t item;
+        if (wp_get(wp, self, &item)) {
+            pthread_mutex_lock(&wp->mu);
+            wp->pending--;
+            pthread_mutex_unlock(&wp->mu);
+            wp->fn(wp->ctx, item, self->id);
+            self->executed++;
+            continue;
+        }
+        pthread_mutex_lock(&wp->mu);
+        while (wp->pending <= 0 && !wp->stop) pthread_cond_wait(&wp->cv, &wp->mu);
+        int done = wp->stop && wp->pending <= 0;
+        pthread_mutex_unlock(&wp->mu);
+        if (done) return NULL;
+    }
+}
+
+// qcap: số việc tối đa đang chờ trong một hàng đợi (caller tự giới hạn tổng số việc).
+static inline int wp_start(WorkPool* wp, int n, unsigned qcap, WorkFn fn, void* ctx) {
+    unsigned cap = 1;
+    while (cap < qcap) cap <<= 1;
+    wp->n = n;
+    wp->fn = fn;
+    wp->ctx = ctx;
+    wp->pending = 0;
+    wp->stop = 0;
+    wp->next = 0;
+    wp->q = (WsQueue*)calloc((size_t)n, sizeof(WsQueue));
+    wp->w = (Worker*)calloc((size_t)n, sizeof(Worker));
+    wp->th = (pthread_t*)calloc((size_t)n, sizeof(pthread_t));
+    if (!wp->q || !wp->w || !wp->th) return -1;
+    pthread_mutex_init(&wp->mu, NULL);
+    pthread_cond_init(&wp->cv, NULL);
+    for (int i = 0; i < n; ++i) {
+        pthread_mutex_init(&wp->q[i].mu, NULL);
+        wp->q[i].cap = cap;
+        wp->q[i].items = (uint32_t*)calloc(cap, sizeof(uint32_t));
+        if (!wp->q[i].items) return -1;
+        wp->w[i].pool = wp;
+        wp->w[i].id = i;
+    }
+    for (int i = 0; i < n; ++i)
+        if (pthread_create(&wp->th[i], NULL, wp_worker, &wp->w[i]) != 0) return -1;
+    return 0;
+}
+
+static inline void wp_submit(WorkPool* wp, uint32_t item) {
+    WsQueue* q = &wp->q[wp->next++ % (unsigned)wp->n];
+    pthread_mutex_lock(&q->mu);
+    q->items[q->tail++ & (q->cap - 1)] = item;
+    pthread_mutex_unlock(&q->mu);
+    pthread_mutex_lock(&wp->mu);
+    wp->pending++;
+    pthread_cond_signal(&wp->cv);
+    pthread_mutex_unlock(&wp->mu);
+}
+
+// Chờ làm hết việc đã giao rồi dừng mọi worker.
+static inline void wp_stop(WorkPool* wp) {
+    pthread_mutex_lock(&wp->mu);
+    wp->stop = 1;
+    pthread_cond_broadcast(&wp->cv);
+    pthread_mutex_unlock(&wp->mu);
+    for (int i = 0; i < wp->n; ++i) pthread_join(wp->th[i], NULL);
+    for (int i = 0; i < wp->n; ++i) {
+        pthread_mutex_destroy(&wp->q[i].mu);
+        free(wp->q[i].items);
+    }
+    pthread_mutex_destroy(&wp->mu);
+    pthread_cond_destroy(&wp->cv);
+    free(wp->q);
+    free(wp->th);
+}
+
+// Worker còn sống tới khi wp_free (để đọc thống kê sau wp_stop).
+static inline void wp_free(WorkPool* wp) {
+    free(wp->w);
+    wp->w = NULL;
+}
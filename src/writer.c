@@ -9,103 +9,482 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
-#include "shared.h"
+#include <pthread.h>
+#include <signal.h>
+#include <getopt.h>
+#include "segment.h"
+#include "msglog.h"
+#include "crc32c.h"
+#include "doorbell.h"
+#include "tailsrc.h"
+#include "lzframe.h"
+#include "intern.h"
+#include "flowctl.h"
+
+static volatile sig_atomic_t g_stop = 0;
+static void on_signal(int sig){ (void)sig; g_stop = 1; }
 
 static void usage(const char* prog){
     fprintf(stderr,
-        "Usage: %s [-i input.txt] [-n /shm_name]\n"
+        "Usage: %s [-i input.txt | -t file|glob|dir ... [-s]] [-n /shm_name] [-f ring.dat [-k N]] [-l logdir [-L MiB]] [-c] [-z N] [-d] [-p PREFIX[=LANE]]... [-P] [--rate N [--burst N]] [--mode OCT] [--data-mode OCT] [--group G] [--producer ID]\n"
         "  -i  đường dẫn file input (mặc định: input.txt)\n"
-        "  -n  tên POSIX shm (mặc định: %s)\n",
-        prog, SHM_NAME);
+        "  -n  tên POSIX shm, arena:kênh hoặc @tên (vòng đệm memfd của shm_broker) (mặc định: %s)\n"
+        "  -f  vòng đệm durable trong file (thay cho -n), đọc tiếp input sau khi khởi động lại\n"
+        "  -k  msync checkpoint sau mỗi N bản ghi (mặc định: %d)\n"
+        "  -l  ghi thêm mọi bản ghi vào log append-only trong thư mục này (để phát lại);\n"
+        "      phải là writer duy nhất của vòng đệm (có writer khác thì bên khởi động sau bị từ chối)\n"
+        "  -L  kích thước mỗi segment log, MiB (mặc định: %u)\n"
+        "  -c  gắn CRC32C cho từng bản ghi để reader phát hiện ô hỏng\n"
+        "  -t  theo dõi file/glob/thư mục như tail -F (lặp lại được), mỗi file một thread;\n"
+        "      bản ghi có dạng \"tên_file<TAB>dòng\", chạy tới khi nhận SIGINT/SIGTERM\n"
+        "  -s  với -t: đọc các file có sẵn từ đầu (mặc định: chỉ dòng mới)\n"
+        "  -z  nén theo lô: gom tối đa N bản ghi (<= %d) thành một frame LZ77, chia\n"
+        "      thành nhiều ô vòng đệm; reader tự giải nén (không dùng chung với -f);\n"
+        "      nhiều writer -z / nhiều reader trên một vòng đệm: mảnh của frame không xen nhau\n"
+        "  -d  bảng intern trong segment: dòng lặp lại chỉ gửi tham chiếu 8 byte;\n"
+        "      phải là writer duy nhất của vòng đệm (như -l)\n"
+        "  -p  PREFIX[=LANE]: dòng bắt đầu bằng PREFIX đi làn ưu tiên LANE (1..%d, mặc định\n"
+        "      %d = cao nhất), vượt qua dữ liệu hàng loạt đang chờ (lặp lại được)\n"
+        "  -P  mỗi dòng bắt đầu bằng trường ưu tiên \"N<TAB>\" (N = 0..%d, 0 = làn thường);\n"
+        "      trường này được bỏ trước khi gửi. -p/-P không dùng chung với -f/-l\n"
+        "  --rate N   tối đa N dòng/giây (token bucket, đồng hồ TSC)\n"
+        "  --burst N  số dòng được gửi dồn sau một lúc rảnh (mặc định: N/10, tối thiểu 1)\n"
+        "  --mode OCT       quyền vùng điều khiển khi tạo SHM mới (mặc định: %o; reader cần ghi)\n"
+        "  --data-mode OCT  quyền vùng dữ liệu \"tên.data\" (mặc định: %o; reader/observer chỉ cần đọc)\n"
+        "  --group G        nhóm sở hữu SHM mới (nhóm của các process tham gia)\n"
+        "  --producer ID    số hiệu cố định của writer (1..%u): chạy lại với cùng ID và cùng\n"
+        "                   input thì bản ghi mang lại đúng seq cũ, reader --dedup bỏ bản lặp\n",
+        prog, SHM_NAME, CKPT_EVERY, LOG_SEG_BYTES_DEFAULT >> 20, LZF_MAX_RECS,
+        PRIO_LANES, PRIO_LANES, PRIO_LANES, SEG_MODE, SEG_DATA_MODE, UINT32_MAX);
+}
+
+// Đích chung của mọi nguồn: một mutex tuần tự hóa log + vòng đệm vì offset log
+// lấy từ shm->in. Với -l/-d writer giữ luồng độc quyền (stream_open_excl) nên không
+// process nào khác đẩy vào vòng đệm chính giữa lúc đọc shm->in và lúc đẩy, hay
+// sửa bảng intern giữa lúc tra và lúc đẩy tham chiếu.
+typedef struct {
+    const char* prefix;
+    size_t len;
+    unsigned lane;
+} PrioRule;
+
+typedef struct {
+    Shared* shm;
+    MsgLog* lg; // NULL nếu không ghi log
+    Doorbell* db;
+    int use_crc;
+    FrameBuf* fb; // -z, NULL: mỗi bản ghi một ô
+    Interner* dict; // -d, NULL: luôn gửi nguyên dòng
+    const PrioRule* rules; // -p
+    int nrules;
+    int prio_field; // -P
+    uint64_t lane_lines[PRIO_LANES + 1];
+    TokenBucket* tb; // --rate, NULL: không giới hạn
+    Credit credit;   // phần vòng đệm của writer này khi có nhiều writer
+    uint32_t id, epoch; // --producer và lần khởi động này (seqtrack.h)
+    uint64_t seq;       // seq của bản ghi vòng đệm chính gần nhất
+    const volatile sig_atomic_t* stop; // khác 0: push đang chờ chỗ trống thì bỏ cuộc
+    pthread_mutex_t mu;
+} Producer;
+
+// Chọn làn cho một dòng. Với -P thì bỏ trường "N<TAB>" khỏi dòng; trường không
+// hợp lệ thì dòng đi làn thường và giữ nguyên.
+static unsigned line_lane(const Producer* p, const char** line, size_t* len) {
+    const char* s = *line;
+    if (p->prio_field && *len >= 2 && s[0] >= '0' && s[0] <= '0' + PRIO_LANES && s[1] == '\t') {
+        *line = s + 2;
+        *len -= 2;
+        return (unsigned)(s[0] - '0');
+    }
+    for (int i = 0; i < p->nrules; ++i)
+        if (*len >= p->rules[i].len && memcmp(s, p->rules[i].prefix, p->rules[i].len) == 0) return p->rules[i].lane;
+    return 0;
+}
+
+// Gọi khi giữ p->mu. shm->in chính là offset bản ghi sắp đẩy. Ghi log trước khi
+// publish để bản ghi nào reader thấy trong vòng đệm cũng đã có trong log. Log luôn
+// giữ dòng đầy đủ; chỉ vòng đệm nhận tham chiếu intern.
+static int push_locked(Producer* p, const RecMeta* meta, const char* msg, uint64_t in_pos) {
+    if (p->lg && mlog_append(p->lg, p->shm->in, msg, meta->len, meta->crc, meta->flags) == -1) { perror("log append"); return -1; }
+    RecMeta out = *meta;
+    char ref[sizeof(DictRef)];
+    if (p->dict && intern_ref(p->dict, p->shm, meta, msg, &out, ref)) msg = ref;
+    out.flags |= REC_F_SEQ;
+    out.producer = p->id;
+    out.epoch = p->epoch;
+    out.seq = ++p->seq;
+    if (credit_acquire(&p->credit, &out, p->stop) == -1) return -1;
+    if (ring_push_stop(p->shm, &out, msg, in_pos, p->stop) == -1) {
+        credit_cancel(&p->credit);
+        if (!g_stop) perror("ring_push");
+        return -1;
+    }
+    db_ring(p->db, p->shm);
+    return 0;
+}
+
+// Nén frame đang gom và đẩy từng mảnh liên tiếp (cùng trong mutex nên các mảnh
+// của một frame không xen với bản ghi khác của writer này; shm->frame_tx giữ cho
+// chúng không xen với mảnh của writer -z khác).
+static int flush_locked(Producer* p) {
+    if (!p->fb) return 0;
+    uint64_t raw_before = p->fb->st.raw_bytes;
+    size_t n = frame_build(p->fb);
+    if (n == 0) return 0;
+    shm_stat_add(&p->shm->stats.lz_raw_bytes, p->fb->st.raw_bytes - raw_before);
+    shm_stat_add(&p->shm->stats.lz_wire_bytes, n);
+    const char* w = (const char*)p->fb->wire;
+    if (frame_lock(&p->shm->frame_tx, 0, p->stop) == -1) {
+        if (!*p->stop) perror("frame lock");
+        return -1;
+    }
+    int rc = 0;
+    for (size_t off = 0; off < n && rc == 0; off += LZF_FRAG) {
+        RecMeta meta = { .len = (uint32_t)(n - off < LZF_FRAG ? n - off : LZF_FRAG), .flags = REC_F_FRAME };
+        if (off == 0) meta.flags |= REC_F_FRAME_FIRST;
+        if (off + meta.len == n) meta.flags |= REC_F_FRAME_LAST;
+        if (p->use_crc) {
+            meta.crc = crc32c(w + off, meta.len);
+            meta.flags |= REC_F_CRC;
+        }
+        rc = push_locked(p, &meta, w + off, 0);
+    }
+    frame_unlock(&p->shm->frame_tx);
+    return rc;
+}
+
+// Bản ghi khẩn: đi thẳng vào làn ưu tiên, không qua frame nén hay bảng intern.
+static int produce_lane(Producer* p, unsigned lane, const RecMeta* m, const char* msg) {
+    RecMeta meta = *m;
+    if (p->use_crc) {
+        meta.crc = crc32c(msg, meta.len);
+        meta.flags |= REC_F_CRC;
+    }
+    pthread_mutex_lock(&p->mu);
+    if (p->tb) tb_take(p->tb);
+    int rc = ring_push_lane_stop(p->shm, lane, &meta, msg, p->stop);
+    if (rc == -1 && !g_stop) perror("ring_push_lane");
+    else {
+        db_ring(p->db, p->shm);
+        p->lane_lines[lane]++;
+    }
+    pthread_mutex_unlock(&p->mu);
+    return rc;
+}
+
+static int produce(Producer* p, const RecMeta* m, const char* msg, uint64_t in_pos) {
+    RecMeta meta = *m;
+    int rc;
+    if (p->fb) {
+        pthread_mutex_lock(&p->mu);
+        if (p->tb) tb_take(p->tb);
+        rc = frame_add(p->fb, &meta, msg) ? flush_locked(p) : 0;
+        pthread_mutex_unlock(&p->mu);
+        return rc;
+    }
+    // CRC tính ngoài vùng tới hạn
+    if (p->use_crc) {
+        meta.crc = crc32c(msg, meta.len);
+        meta.flags |= REC_F_CRC;
+    }
+    pthread_mutex_lock(&p->mu);
+    if (p->tb) tb_take(p->tb);
+    rc = push_locked(p, &meta, msg, in_pos);
+    pthread_mutex_unlock(&p->mu);
+    return rc;
+}
+
+static int producer_flush(Producer* p) {
+    pthread_mutex_lock(&p->mu);
+    int rc = flush_locked(p);
+    pthread_mutex_unlock(&p->mu);
+    return rc;
+}
+
+// Callback của tailsrc.h: gắn tên nguồn, dòng dài thì chia thành nhiều bản ghi.
+static int tail_emit(void* ctx, uint32_t src, const char* tag, const char* line, size_t len) {
+    Producer* p = (Producer*)ctx;
+    if (!line) return producer_flush(p); // nguồn tạm hết dữ liệu: không giữ frame dở
+    unsigned lane = line_lane(p, &line, &len);
+    char msg[MSG_MAX];
+    size_t tl = strlen(tag);
+    if (tl > MSG_MAX / 2) tl = MSG_MAX / 2;
+    size_t room = MSG_MAX - 1 - tl - 1;
+    memcpy(msg, tag, tl);
+    msg[tl] = '\t';
+    do {
+        size_t n = len < room ? len : room;
+        memcpy(msg + tl + 1, line, n);
+        msg[tl + 1 + n] = '\0';
+        RecMeta meta = { .len = (uint32_t)(tl + 1 + n), .flags = REC_F_TAGGED, .src = src };
+        if ((lane ? produce_lane(p, lane, &meta, msg) : produce(p, &meta, msg, 0)) == -1) return -1;
+        line += n;
+        len -= n;
+    } while (len > 0);
+    return 0;
 }
 
 int main(int argc, char** argv){
     const char* in_path = "input.txt";
     const char* shm_name = SHM_NAME;
+    const char* ring_path = NULL;
+    unsigned long ckpt_every = CKPT_EVERY;
+    const char* log_dir = NULL;
+    size_t log_seg_bytes = LOG_SEG_BYTES_DEFAULT;
+    int use_crc = 0;
+    unsigned lz_batch = 0;
+    int use_dict = 0;
+    PrioRule* rules = calloc((size_t)argc, sizeof(PrioRule));
+    int nrules = 0, prio_field = 0;
+    double rate = 0, burst = 0;
+    unsigned seg_mode = 0, data_mode = 0;
+    const char* seg_group = NULL;
+    unsigned long producer_id = 0;
+    Tail tail;
+    int tailing = 0, tail_from_start = 0;
+    // Dòng dài được tail_emit chia theo chỗ còn lại sau tên nguồn
+    if (tail_init(&tail, tail_emit, NULL, 16 * MSG_MAX, 0) == -1) return 1;
 
+    static const struct option long_opts[] = {
+        { "rate", required_argument, NULL, 'R' },
+        { "burst", required_argument, NULL, 'B' },
+        { "mode", required_argument, NULL, 'M' },
+        { "data-mode", required_argument, NULL, 'D' },
+        { "group", required_argument, NULL, 'G' },
+        { "producer", required_argument, NULL, 'I' },
+        { NULL, 0, NULL, 0 }
+    };
     int opt;
-    while ((opt = getopt(argc, argv, "i:n:h")) != -1){
+    while ((opt = getopt_long(argc, argv, "i:n:f:k:l:L:ct:sz:dp:Ph", long_opts, NULL)) != -1){
         if (opt == 'i') in_path = optarg;
         else if (opt == 'n') shm_name = optarg;
+        else if (opt == 'f') ring_path = optarg;
+        else if (opt == 'k') ckpt_every = strtoul(optarg, NULL, 10);
+        else if (opt == 'l') log_dir = optarg;
+        else if (opt == 'L') log_seg_bytes = (size_t)strtoul(optarg, NULL, 10) << 20;
+        else if (opt == 'c') use_crc = 1;
+        else if (opt == 't') { if (tail_add_spec(&tail, optarg) == -1) return 1; tailing = 1; }
+        else if (opt == 's') tail_from_start = 1;
+        else if (opt == 'z') lz_batch = (unsigned)strtoul(optarg, NULL, 10);
+        else if (opt == 'd') use_dict = 1;
+        else if (opt == 'p') {
+            PrioRule* r = &rules[nrules++];
+            char* eq = strrchr(optarg, '=');
+            r->lane = PRIO_LANES;
+            if (eq) {
+                r->lane = (unsigned)strtoul(eq + 1, NULL, 10);
+                *eq = '\0';
+            }
+            if (r->lane < 1 || r->lane > PRIO_LANES || !optarg[0]) {
+                fprintf(stderr, "-p: expected PREFIX[=LANE] with LANE in 1..%d\n", PRIO_LANES);
+                return 1;
+            }
+            r->prefix = optarg;
+            r->len = strlen(optarg);
+        }
+        else if (opt == 'P') prio_field = 1;
+        else if (opt == 'R') rate = atof(optarg);
+        else if (opt == 'B') burst = atof(optarg);
+        else if (opt == 'M') seg_mode = (unsigned)strtoul(optarg, NULL, 8);
+        else if (opt == 'D') data_mode = (unsigned)strtoul(optarg, NULL, 8);
+        else if (opt == 'G') seg_group = optarg;
+        else if (opt == 'I') producer_id = strtoul(optarg, NULL, 10);
         else { usage(argv[0]); return 1; }
     }
-
-    // 1) Mở/khởi tạo shared memory (tạo mới nếu chưa có)
-    int creator = 0;
-    int shmfd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0666);
-    if (shmfd >= 0) {
-        creator = 1;
-    } else if (errno == EEXIST) {
-        shmfd = shm_open(shm_name, O_RDWR, 0666);
-        if (shmfd < 0) { perror("shm_open existing"); return 1; }
-    } else {
-        perror("shm_open");
+    if ((nrules || prio_field) && (ring_path || log_dir)) {
+        // Làn ưu tiên không có offset trong vòng đệm chính nên không ghi log/checkpoint được
+        fprintf(stderr, "-p/-P cannot be combined with -f/-l\n");
+        return 1;
+    }
+    if (tailing && ring_path) {
+        // Vị trí đọc tiếp của nhiều file không vừa một in_pos
+        fprintf(stderr, "-t cannot be combined with -f\n");
+        return 1;
+    }
+    if (lz_batch && ring_path) {
+        // Reader durable commit theo từng ô, có thể dừng giữa frame
+        fprintf(stderr, "-z cannot be combined with -f\n");
+        return 1;
+    }
+    if (producer_id > UINT32_MAX || (producer_id && tailing)) {
+        // Seq chỉ lặp lại được khi đọc lại cùng một input theo cùng thứ tự
+        fprintf(stderr, "--producer: expected 1..%u, cannot be combined with -t\n", UINT32_MAX);
+        return 1;
+    }
+    if (lz_batch && use_dict) {
+        // Frame LZ77 đã khử dòng lặp trong lô; mảnh frame không đi qua bảng intern
+        fprintf(stderr, "-d cannot be combined with -z\n");
         return 1;
     }
 
-    if (creator) {
-        if (ftruncate(shmfd, sizeof(Shared)) == -1) { perror("ftruncate"); return 1; }
-    } else {
-        // nếu không phải creator, đảm bảo đối tượng đã có size đúng
-        struct stat st; 
-        if (fstat(shmfd, &st) == -1) { perror("fstat"); return 1; }
-        if ((size_t)st.st_size < sizeof(Shared)) {
-            fprintf(stderr, "SHM size too small.\n");
-            return 1;
-        }
+    // Log append-only: offset trong log = offset trong vòng đệm
+    MsgLog lg;
+    int logging = 0;
+    if (log_dir) {
+        if (mlog_open_writer(&lg, log_dir, log_seg_bytes) == -1) return 1;
+        logging = 1;
     }
 
-    Shared* shm = mmap(NULL, sizeof(Shared), PROT_READ|PROT_WRITE, MAP_SHARED, shmfd, 0);
-    if (shm == MAP_FAILED) { perror("mmap"); return 1; }
+    // 1) Mở/khởi tạo segment (shm hoặc file durable). Vòng đệm mới (vd. sau
+    // reboot) mà log đã có lịch sử thì đánh số tiếp theo log để offset không trùng.
+    SegConfig cfg = {
+        .name = ring_path ? ring_path : shm_name,
+        .durable = ring_path != NULL,
+        .role = SEG_PRODUCER,
+        .base_offset = logging ? lg.next : 0,
+        .tag = "writer",
+        .mode = seg_mode,
+        .data_mode = data_mode,
+        .group = seg_group,
+    };
+    Segment seg;
+    if (seg_open(&seg, &cfg) == -1) return 1;
+    Shared* shm = seg.shm;
 
-    if (creator) {
-        // init cấu trúc dùng chung
-        memset(shm, 0, sizeof(*shm));
-        if (sem_init(&shm->empty, 1, CAP) == -1) { perror("sem_init empty"); return 1; }
-        if (sem_init(&shm->full,  1, 0  ) == -1) { perror("sem_init full");  return 1; }
-        if (sem_init(&shm->mutex, 1, 1  ) == -1) { perror("sem_init mutex"); return 1; }
-        fprintf(stderr, "[writer] created and initialized SHM '%s'\n", shm_name);
-    } else {
-        fprintf(stderr, "[writer] attached to existing SHM '%s'\n", shm_name);
+    // Chuông báo cho reader -E (không có reader epoll thì chỉ tốn một load mỗi bản ghi)
+    Doorbell db;
+    db_producer_init(&db, shm, cfg.name);
+
+    if (use_crc) fprintf(stderr, "[writer] CRC32C on (%s)\n", crc32c_hw_available() ? "sse4.2" : "table");
+
+    Producer prod = { .shm = shm, .lg = logging ? &lg : NULL, .db = &db, .use_crc = use_crc,
+                      .rules = rules, .nrules = nrules, .prio_field = prio_field, .id = (uint32_t)producer_id, .stop = &g_stop };
+    pthread_mutex_init(&prod.mu, NULL);
+    if (lz_batch) {
+        prod.fb = (FrameBuf*)malloc(sizeof(FrameBuf));
+        if (!prod.fb) { perror("malloc"); return 1; }
+        frame_buf_init(prod.fb, lz_batch);
+        fprintf(stderr, "[writer] lz frames of up to %u record(s)\n", prod.fb->max_recs);
+    }
+    if (use_dict) {
+        prod.dict = (Interner*)calloc(1, sizeof(Interner));
+        if (!prod.dict) { perror("calloc"); return 1; }
     }
+    TokenBucket tb;
+    if (rate > 0) {
+        tb_init(&tb, rate, burst > 0 ? burst : rate / 10);
+        prod.tb = &tb;
+        fprintf(stderr, "[writer] rate limit %.0f line(s)/s, burst %.0f (%s clock)\n", rate, tb.burst,
+                tb.clk.use_tsc ? "tsc" : "monotonic");
+    }
+    // Epoch mới cho mỗi lần khởi động; durable đọc tiếp input thì đánh số tiếp theo
+    // bản ghi cuối đã vào vòng đệm (seq = thứ tự bản ghi trong input)
+    prod.epoch = __atomic_add_fetch(&shm->producer_epoch, 1, __ATOMIC_RELAXED);
+    if (seg.durable && !seg.creator && !tailing) prod.seq = __atomic_load_n(&shm->in_seq, __ATOMIC_RELAXED);
+    if (producer_id) fprintf(stderr, "[writer] producer %u epoch %u, seq from %llu\n", prod.id, prod.epoch,
+                             (unsigned long long)prod.seq + 1);
+    int holder = 0;
+    int stream = stream_open_excl(shm, logging || use_dict, &holder);
+    if (stream == STREAM_BUSY) {
+        // Offset log và last_ref của bảng intern lấy từ shm->in: chỉ đúng khi không
+        // ai khác đẩy vào vòng đệm chính
+        fprintf(stderr, "[writer] ring '%s' is in use by writer pid %d; a -l/-d writer must be the only writer\n",
+                cfg.name, holder);
+        return 1;
+    }
+    if (stream < 0) fprintf(stderr, "[writer] stream table full (%d), readers may stop before this writer ends\n", MAX_PRODUCERS);
+    if (credit_register(&prod.credit, shm) == -1)
+        fprintf(stderr, "[writer] producer table full (%d), running without credits\n", MAX_PRODUCERS);
+
+    FILE* fin = NULL;
+    if (tailing) {
+        // 2') Theo dõi các nguồn tới khi bị ngắt. Chặn tín hiệu trước khi tạo
+        // thread để chỉ main nhận (sigwait), rồi dừng thread và kết thúc luồng như thường.
+        sigset_t sigs;
+        sigemptyset(&sigs);
+        sigaddset(&sigs, SIGINT);
+        sigaddset(&sigs, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+        tail.ctx = &prod;
+        tail.from_start = tail_from_start;
+        if (tail_start(&tail) == -1) { perror("tail"); return 1; }
+        int sig;
+        sigwait(&sigs, &sig);
+        fprintf(stderr, "[writer] signal %d, stopping sources\n", sig);
+        // Thread nguồn có thể đang kẹt trong push khi vòng đệm đầy mà không còn
+        // reader: g_stop làm push bỏ cuộc để tail_stop join được
+        g_stop = 1;
+        tail_stop(&tail);
+    } else {
+        tail_stop(&tail);
 
-    // 2) Đọc file input và đẩy vào vòng đệm
-    FILE* fin = fopen(in_path, "r");
-    if (!fin) { perror("open input"); return 1; }
+        // SIGINT/SIGTERM: ngừng đọc input, đẩy nốt frame đang gom rồi kết thúc luồng
+        // (không SA_RESTART: sem_wait đang chờ ô trống trả về EINTR)
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_signal;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
 
-    char line[MSG_MAX];
-    while (fgets(line, sizeof(line), fin)) {
-        line[strcspn(line, "\r\n")] = '\0';
+        // 2) Đọc file input và đẩy vào vòng đệm
+        fin = fopen(in_path, "r");
+        if (!fin) { perror("open input"); return 1; }
 
-        // Đợi có ô trống và vào critical section
-        if (sem_wait(&shm->empty) == -1) { perror("sem_wait empty"); break; }
-        if (sem_wait(&shm->mutex) == -1) { perror("sem_wait mutex"); break; }
+        if (seg.durable && !seg.creator) {
+            // Đọc tiếp input ngay sau bản ghi cuối cùng đã nằm trong vòng đệm
+            if (fseeko(fin, (off_t)shm->in_pos, SEEK_SET) == -1) { perror("fseek input"); return 1; }
+            fprintf(stderr, "[writer] resuming input at byte %llu (record %llu)\n",
+                    (unsigned long long)shm->in_pos, (unsigned long long)shm->in);
+        }
+
+        char line[MSG_MAX];
+        unsigned long since_ckpt = 0;
+        while (!g_stop && fgets(line, sizeof(line), fin)) {
+            size_t len = strcspn(line, "\r\n");
+            line[len] = '\0';
 
-        // Ghi message
-        strncpy(shm->buf[shm->in], line, MSG_MAX-1);
-        shm->buf[shm->in][MSG_MAX-1] = '\0';
-        shm->in = (shm->in + 1) % CAP;
+            const char* msg = line;
+            unsigned lane = line_lane(&prod, &msg, &len);
+            RecMeta meta = { .len = (uint32_t)len };
+            if ((lane ? produce_lane(&prod, lane, &meta, msg)
+                      : produce(&prod, &meta, msg, (uint64_t)ftello(fin))) == -1) break;
 
-        // Thoát critical section và báo có dữ liệu
-        sem_post(&shm->mutex);
-        sem_post(&shm->full);
+            if (seg.durable && ++since_ckpt >= ckpt_every) {
+                seg_checkpoint(&seg);
+                since_ckpt = 0;
+            }
+        }
     }
 
-    // 3) Gửi END_TOKEN để reader thoát
-    if (sem_wait(&shm->empty) == -1) { perror("sem_wait empty(END)"); }
-    if (sem_wait(&shm->mutex) == -1) { perror("sem_wait mutex(END)"); }
-    strncpy(shm->buf[shm->in], END_TOKEN, MSG_MAX);
-    shm->in = (shm->in + 1) % CAP;
-    sem_post(&shm->mutex);
-    sem_post(&shm->full);
+    producer_flush(&prod);
 
-    fclose(fin);
+    // 3) Kết thúc luồng của writer này (stream.h). Writer cuối cùng bật DRAIN:
+    // reader lấy nốt vòng đệm và các làn ưu tiên rồi thoát, không cần bản ghi END.
+    if (g_stop) fprintf(stderr, "[writer] signal, ending stream early\n");
+    for (unsigned k = 1; k <= PRIO_LANES; ++k)
+        if (prod.lane_lines[k]) fprintf(stderr, "[writer] lane %u: %llu line(s)\n", k, (unsigned long long)prod.lane_lines[k]);
+    if (stream_end(shm, stream)) fprintf(stderr, "[writer] last producer, stream ended\n");
+    db_ring(&db, shm);
+    db_producer_close(&db);
+    if (prod.credit.slot >= 0) {
+        const ProducerSlot* ps = &shm->producers[prod.credit.slot];
+        if (ps->waits) fprintf(stderr, "[writer] credits: waited %llu time(s) for a fair share of the ring\n",
+                               (unsigned long long)ps->waits);
+    }
+    credit_unregister(&prod.credit);
+    if (prod.tb && tb.waits) fprintf(stderr, "[writer] rate limit: %llu wait(s), %.1f ms total\n",
+                                     (unsigned long long)tb.waits, (double)tb.wait_ns / 1e6);
+    seg_checkpoint(&seg);
+
+    if (fin) fclose(fin);
+    pthread_mutex_destroy(&prod.mu);
+    if (prod.fb) {
+        lz_report("writer", "compress", &prod.fb->st);
+        free(prod.fb);
+    }
+    if (prod.dict) {
+        fprintf(stderr, "[writer] dict: %llu reference(s), %llu entr%s written, %llu byte(s) not copied\n",
+                (unsigned long long)prod.dict->refs, (unsigned long long)prod.dict->inserts,
+                prod.dict->inserts == 1 ? "y" : "ies", (unsigned long long)prod.dict->saved);
+        free(prod.dict);
+    }
+    if (logging) mlog_close(&lg);
+    free(rules);
 
     // Không sem_destroy hay shm_unlink ở đây để reader còn chạy an toàn.
     // (Sau khi demo xong, chạy tool cleanup riêng hoặc unlink thủ công.)
 
-    munmap(shm, sizeof(*shm));
-    close(shmfd);
+    seg_close(&seg);
 
     fprintf(stderr, "[writer] done.\n");
     return 0;